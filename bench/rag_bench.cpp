@@ -0,0 +1,367 @@
+// Micro-benchmarks for the RAG hot paths on synthetic data: no Ollama needed.
+//
+// Covered: text and code chunking, cosine similarity, top-k retrieval (full
+// scan + sort, as answer() does it), index.json save/load, source file
+// reading, NDJSON stream parsing with <think> filtering, and the page-to-gray
+// conversion in front of OCR.
+//
+// The corpus is random unit vectors of each requested dimension with short
+// chunk texts, so the numbers isolate the code under test from model cost.
+// Every result is one row: name, corpus size, dimension, iterations, time
+// per operation and a throughput in the unit that suits the benchmark.
+#include "rag_session.hpp"
+#include "rag_text.hpp"
+#include "ollama_stream.hpp"
+#include "json.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <optional>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<size_t> chunks{10000, 100000};
+    std::vector<size_t> dims{384, 768, 1024};
+    size_t io_chunks = 10000;   // largest corpus saved/loaded as index.json
+    int queries = 20;
+    double min_seconds = 0.3;   // per benchmark, for the cheap ones
+    size_t max_mb = 2048;       // corpora estimated above this are skipped
+    std::string json_path;
+};
+
+struct Result {
+    std::string name;
+    size_t chunks = 0;
+    size_t dim = 0;
+    uint64_t iterations = 0;
+    double ms_per_op = 0;
+    double rate = 0;   // in unit per second
+    std::string unit;
+};
+
+static std::vector<Result> g_results;
+
+static std::vector<size_t> parseList(const std::string& s) {
+    std::vector<size_t> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        double v = std::stod(item);   // accepts 1e6
+        if (item.back() == 'k' || item.back() == 'K') v *= 1000;
+        if (item.back() == 'm' || item.back() == 'M') v *= 1000000;
+        out.push_back((size_t)v);
+    }
+    return out;
+}
+
+static double secondsSince(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+// Runs fn until min_seconds have passed (at least min_iters times).
+// per_op is the amount of work one call does, in unit.
+static void measure(const std::string& name, size_t chunks, size_t dim, double per_op, const std::string& unit,
+                    double min_seconds, uint64_t min_iters, const std::function<void()>& fn) {
+    fn();   // warm-up: page faults, allocator, caches
+    uint64_t iters = 0;
+    auto t0 = Clock::now();
+    double el = 0;
+    do {
+        fn();
+        ++iters;
+        el = secondsSince(t0);
+    } while (iters < min_iters || el < min_seconds);
+
+    Result r;
+    r.name = name;
+    r.chunks = chunks;
+    r.dim = dim;
+    r.iterations = iters;
+    r.ms_per_op = 1000 * el / iters;
+    r.rate = per_op * iters / el;
+    r.unit = unit;
+    g_results.push_back(r);
+
+    std::cout << std::left << std::setw(14) << r.name << std::right << std::setw(9) << (chunks ? std::to_string(chunks) : "-")
+              << std::setw(6) << (dim ? std::to_string(dim) : "-") << std::setw(8) << iters << std::fixed
+              << std::setprecision(4) << std::setw(14) << r.ms_per_op << std::setprecision(1) << std::setw(14)
+              << r.rate << " " << unit << "\n";
+    std::cout.flush();
+}
+
+// ---- synthetic inputs ----
+
+static const char* kWords[] = {
+    "the", "index", "model", "answer", "vector", "session", "query", "embedding", "chunk", "file",
+    "is", "of", "and", "to", "in", "a", "memory", "score", "context", "document", "serial", "port",
+    "returns", "with", "for", "large", "small", "device", "stream", "token", "prompt", "search"};
+
+static std::string prose(size_t bytes, std::mt19937& rng) {
+    std::string s;
+    s.reserve(bytes + 16);
+    std::uniform_int_distribution<size_t> w(0, sizeof(kWords) / sizeof(kWords[0]) - 1);
+    int in_sentence = 0;
+    while (s.size() < bytes) {
+        s += kWords[w(rng)];
+        if (++in_sentence == 14) {
+            s += ".\n";
+            in_sentence = 0;
+        } else {
+            s += ' ';
+        }
+    }
+    return s;
+}
+
+static std::string code(size_t bytes, std::mt19937& rng) {
+    std::string s;
+    s.reserve(bytes + 128);
+    std::uniform_int_distribution<int> len(0, 60);
+    int fn = 0;
+    while (s.size() < bytes) {
+        s += "static int handler_" + std::to_string(fn++) + "(const std::string& in, size_t n) {\n";
+        for (int i = 0; i < 8; ++i) s += "    value = compute(in, n) + " + std::to_string(len(rng)) + ";\n";
+        s += "    return value;\n}\n\n";
+    }
+    return s;
+}
+
+static std::vector<float> unitVector(size_t dim, std::mt19937& rng) {
+    std::normal_distribution<float> nd(0.f, 1.f);
+    std::vector<float> v(dim);
+    double n = 0;
+    for (auto& x : v) {
+        x = nd(rng);
+        n += (double)x * x;
+    }
+    float inv = (float)(1.0 / std::sqrt(n));
+    for (auto& x : v) x *= inv;
+    return v;
+}
+
+static SessionIndex corpus(size_t chunks, size_t dim, std::mt19937& rng) {
+    SessionIndex idx;
+    idx.session_id = "bench_" + std::to_string(chunks) + "_" + std::to_string(dim);
+    idx.reserve(chunks, chunks * 112);
+    Chunk c;
+    for (size_t i = 0; i < chunks; ++i) {
+        c.id = "doc" + std::to_string(i / 50) + ".txt#" + std::to_string(i % 50);
+        c.text = prose(96, rng);
+        c.embedding = unitVector(dim, rng);
+        idx.add_chunk(c);
+    }
+    return idx;
+}
+
+// Estimated resident size of a corpus: embedding matrix, text arena and the per-chunk columns
+static size_t corpusMB(size_t chunks, size_t dim) {
+    return (chunks * (dim * sizeof(float) + 112 + 48)) >> 20;
+}
+
+// ---- benchmarks ----
+
+static void benchText(const Options& o, std::mt19937& rng) {
+    std::string text = prose(8 << 20, rng);
+    double mb = text.size() / 1e6;
+    measure("split_chunks", 0, 0, mb, "MB/s", o.min_seconds, 3, [&] {
+        auto v = RAGSessionManager::split_chunks(text, 1024, 100);
+        if (v.empty()) std::abort();
+    });
+    std::string src = code(8 << 20, rng);
+    mb = src.size() / 1e6;
+    measure("code_chunks", 0, 0, mb, "MB/s", o.min_seconds, 3, [&] {
+        auto v = rag_text::code_chunks(src, 1200, 120);
+        if (v.empty()) std::abort();
+    });
+}
+
+static void benchReadFiles(const Options& o, const fs::path& dir, std::mt19937& rng) {
+    fs::path d = dir / "files";
+    fs::create_directories(d);
+    const int files = 200;
+    size_t total = 0;
+    for (int i = 0; i < files; ++i) {
+        std::string s = code(32 * 1024 + (rng() % (64 * 1024)), rng);
+        std::ofstream(d / ("f" + std::to_string(i) + ".cpp"), std::ios::binary) << s;
+        total += s.size();
+    }
+    measure("read_text_file", 0, 0, total / 1e6, "MB/s", o.min_seconds, 3, [&] {
+        size_t got = 0;
+        for (int i = 0; i < files; ++i) got += rag_text::read_text_file(d / ("f" + std::to_string(i) + ".cpp")).size();
+        if (got != total) std::abort();
+    });
+}
+
+// NDJSON as /api/chat streams it, with a <think> block up front, fed in
+// arbitrary pieces like curl's write callback delivers them
+static void benchStream(const Options& o, std::mt19937& rng) {
+    const int tokens = 20000;
+    std::string body;
+    std::uniform_int_distribution<size_t> w(0, sizeof(kWords) / sizeof(kWords[0]) - 1);
+    for (int i = 0; i < tokens; ++i) {
+        std::string t = i == 0 ? "<think>" : i == 200 ? "</think>\n\n" : std::string(kWords[w(rng)]) + " ";
+        body += nlohmann::json{{"model", "bench"}, {"created_at", "2024-01-01T00:00:00Z"},
+                               {"message", {{"role", "assistant"}, {"content", t}}}, {"done", false}}.dump() + "\n";
+    }
+    body += nlohmann::json{{"model", "bench"}, {"done", true}, {"eval_count", tokens}}.dump() + "\n";
+    std::vector<size_t> cuts;
+    std::uniform_int_distribution<size_t> piece(1, 1500);
+    for (size_t p = 0; p < body.size(); p += piece(rng)) cuts.push_back(p);
+    cuts.push_back(body.size());
+
+    measure("stream_parse", 0, 0, tokens, "tokens/s", o.min_seconds, 3, [&] {
+        OllamaStreamParser ps;
+        ThinkFilter think;
+        size_t out = 0;
+        ps.on_content = [&](const std::string& t) { out += think.push(t).size(); };
+        for (size_t i = 0; i + 1 < cuts.size(); ++i) ps.feed(body.data() + cuts[i], cuts[i + 1] - cuts[i]);
+        ps.finish();
+        out += think.flush().size();
+        if (!ps.done() || out == 0) std::abort();
+    });
+}
+
+static void benchGray(const Options& o, std::mt19937& rng) {
+    const int w = 2480, h = 3508;   // A4 at 300 dpi, as OCR renders it
+    std::vector<unsigned char> argb((size_t)w * h * 4);
+    for (auto& b : argb) b = (unsigned char)rng();
+    std::vector<unsigned char> gray;
+    measure("img_to_gray", 0, 0, (double)w * h / 1e6, "Mpixel/s", o.min_seconds, 3,
+            [&] { RAGSessionManager::gray_from_pixels(argb.data(), w, h, w * 4, 4, gray); });
+}
+
+static void benchCorpus(const Options& o, size_t chunks, size_t dim, const fs::path& dir, std::mt19937& rng) {
+    size_t mb = corpusMB(chunks, dim);
+    if (mb > o.max_mb) {
+        std::cout << "  (skipping " << chunks << " x " << dim << ": about " << mb << " MB, over --max-mb "
+                  << o.max_mb << ")\n";
+        return;
+    }
+    SessionIndex idx = corpus(chunks, dim, rng);
+    std::vector<std::vector<float>> qs;
+    for (int i = 0; i < std::max(o.queries, 1); ++i) qs.push_back(unitVector(dim, rng));
+
+    size_t pairs = std::min<size_t>(chunks, 10000);
+    measure("cosine", chunks, dim, (double)pairs, "pairs/s", o.min_seconds, 3, [&] {
+        double s = 0;
+        for (size_t i = 0; i < pairs; ++i) s += RAGSessionManager::cosine(qs[0].data(), idx.row(i), dim);
+        if (s == 12345.678) std::abort();
+    });
+
+    size_t qi = 0;
+    measure("top_k", chunks, dim, 1, "queries/s", o.min_seconds, std::min<uint64_t>(qs.size(), 5), [&] {
+        auto hits = RAGSessionManager::top_k(idx, qs[qi++ % qs.size()], 5, -1.0);
+        if (hits.size() != std::min<size_t>(5, chunks)) std::abort();
+    });
+
+    if (chunks > o.io_chunks) return;
+    RAGSessionManager mgr((dir / "sessions").string());
+    mgr.save_index(idx);
+    double file_mb = 0;   // index.json, embeddings.bin, text.bin, lexical.bin
+    for (auto& f : fs::directory_iterator(mgr.sessionDir(idx.session_id))) file_mb += f.file_size() / 1e6;
+    measure("save_index", chunks, dim, file_mb, "MB/s", 0, 1, [&] { mgr.save_index(idx); });
+    std::optional<SessionIndex> got;
+    measure("load_index", chunks, dim, file_mb, "MB/s", 0, 1, [&] {
+        got = mgr.load_index(idx.session_id);
+        if (!got || got->size() != chunks) std::abort();
+    });
+    // Texts of a loaded session stay in text.bin; a hit reads and decompresses its block
+    std::uniform_int_distribution<size_t> pick(0, chunks - 1);
+    measure("hit_text", chunks, dim, 5, "texts/s", o.min_seconds, 3, [&] {
+        size_t n = 0;
+        for (int i = 0; i < 5; ++i) n += got->text(pick(rng)).size();
+        if (n == 0) std::abort();
+    });
+    fs::remove_all(mgr.sessionDir(idx.session_id));
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --chunks LIST    corpus sizes, comma-separated; 10k/1M suffixes work (default 10k,100k)\n"
+              << "  --dims LIST      embedding dimensions (default 384,768,1024)\n"
+              << "  --io-chunks N    largest corpus to save/load as a session (default 10000)\n"
+              << "  --queries N      distinct query vectors for top_k (default 20)\n"
+              << "  --min-time S     minimum time per benchmark in seconds (default 0.3)\n"
+              << "  --max-mb N       skip corpora estimated above N MB (default 2048)\n"
+              << "  --quick          1k,10k chunks x 384 dims, short runs\n"
+              << "  --json FILE      also write the results as JSON" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if (a == "--chunks") o.chunks = parseList(next());
+        else if (a == "--dims") o.dims = parseList(next());
+        else if (a == "--io-chunks") o.io_chunks = (size_t)std::stoul(next());
+        else if (a == "--queries") o.queries = std::stoi(next());
+        else if (a == "--min-time") o.min_seconds = std::stod(next());
+        else if (a == "--max-mb") o.max_mb = (size_t)std::stoul(next());
+        else if (a == "--quick") {
+            o.chunks = {1000, 10000};
+            o.dims = {384};
+            o.min_seconds = 0.1;
+        }
+        else if (a == "--json") o.json_path = next();
+        else {
+            usage(argv[0]);
+            return a == "--help" || a == "-h" ? 0 : 1;
+        }
+    }
+
+    fs::path dir = fs::temp_directory_path() / ("rag_bench_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+    std::mt19937 rng(42);
+
+    std::cout << "rag_bench: chunks";
+    for (size_t c : o.chunks) std::cout << " " << c;
+    std::cout << ", dims";
+    for (size_t d : o.dims) std::cout << " " << d;
+    std::cout << "\n\n"
+              << std::left << std::setw(14) << "benchmark" << std::right << std::setw(9) << "chunks" << std::setw(6)
+              << "dim" << std::setw(8) << "iters" << std::setw(14) << "ms/op" << std::setw(14) << "rate" << "\n";
+
+    benchText(o, rng);
+    benchReadFiles(o, dir, rng);
+    benchStream(o, rng);
+    benchGray(o, rng);
+    for (size_t c : o.chunks)
+        for (size_t d : o.dims) benchCorpus(o, c, d, dir, rng);
+
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+
+    if (!o.json_path.empty()) {
+        nlohmann::json runs = nlohmann::json::array();
+        for (const auto& r : g_results)
+            runs.push_back({{"name", r.name}, {"chunks", r.chunks}, {"dim", r.dim}, {"iterations", r.iterations},
+                            {"ms_per_op", r.ms_per_op}, {"rate", r.rate}, {"unit", r.unit}});
+        std::ofstream f(o.json_path);
+        f << nlohmann::json{{"bench", "rag"}, {"results", runs}}.dump(2) << "\n";
+        if (!f) {
+            std::cerr << "[Error] Could not write " << o.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
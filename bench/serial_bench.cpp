@@ -0,0 +1,324 @@
+// Serial output benchmark on a pty pair: no hardware needed.
+//
+// Each run opens a fresh pty, attaches it with initSerial() and streams
+// simulated tokens through serialSend() at a fixed rate. The far end reads
+// the master side no faster than the configured baud rate would deliver
+// (10 bits per byte), so the pty behaves like a UART: the queue fills,
+// drops and stalls happen as they would on the wire. With --framed the far
+// end is the serial_frame reference decoder and answers ACK/NAK.
+//
+// Reported per run: delivered throughput, line utilisation, per-token
+// latency (serialSend call to last byte read) and transmit queue counters.
+#include "serial_handler.h"
+#include "serial_frame.h"
+#include "json.hpp"
+#include <pty.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const char* kProse =
+    "The answer depends on the size of the input and on how often the model is asked. "
+    "In most cases it is enough to keep the index in memory, but for larger collections "
+    "the embeddings should be stored on disk and loaded on demand. This keeps the start "
+    "time short and the memory use predictable, which matters on small devices. ";
+
+struct Options {
+    std::vector<int> bauds{2400, 9600, 115200};
+    std::vector<int> sizes{4, 16, 64};   // bytes per token
+    double tps = 30;                     // tokens per second
+    double seconds = 5;
+    double drain_seconds = 10;
+    bool framed = false;
+    size_t tx_buffer = 8192;
+    int linger_ms = 50;
+    std::string json_path;
+};
+
+struct Result {
+    int baud = 0;
+    int token_bytes = 0;
+    double tps = 0;
+    bool framed = false;
+    uint64_t offered = 0;           // tokens generated
+    uint64_t queued = 0;            // accepted by serialSend
+    uint64_t delivered_bytes = 0;   // text bytes read at the far end
+    double elapsed_s = 0;
+    double throughput = 0;          // delivered text bytes per second
+    double utilisation = 0;         // wire bytes / line capacity
+    double p50 = 0, p95 = 0, p99 = 0, max = 0;   // ms
+    SerialTxStats tx;
+};
+
+static std::vector<int> parseList(const std::string& s) {
+    std::vector<int> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) if (!item.empty()) out.push_back(std::stoi(item));
+    return out;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// The far end: reads at line rate and records when each byte count arrived
+class PacedReader {
+public:
+    PacedReader(int master, int baud, bool framed) : master_(master), baud_(baud), framed_(framed) {}
+
+    void start() { thread_ = std::thread([this] { run(); }); }
+    void stop() {
+        stop_ = true;
+        if (thread_.joinable()) thread_.join();
+    }
+
+    uint64_t textBytes() const { return text_bytes_; }
+    uint64_t wireBytes() const { return wire_bytes_; }
+    // Arrival time of the byte that completed offset `end`
+    std::vector<std::pair<uint64_t, Clock::time_point>> arrivals() {
+        std::lock_guard<std::mutex> L(mtx_);
+        return arrivals_;
+    }
+
+private:
+    void run() {
+        auto t0 = Clock::now();
+        uint64_t read_total = 0;
+        char buf[4096];
+        while (!stop_) {
+            pollfd p{master_, POLLIN, 0};
+            poll(&p, 1, 2);
+            double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+            // Line credit: baud/10 bytes per second, at most 1/20 s of burst
+            uint64_t credit = (uint64_t)(elapsed * baud_ / 10.0);
+            if (credit > read_total + baud_ / 200 + 1) {
+                uint64_t idle_floor = credit - baud_ / 200 - 1;
+                read_total = std::max(read_total, idle_floor);   // an idle line does not bank time
+            }
+            if (credit <= read_total || !(p.revents & POLLIN)) continue;
+            size_t want = std::min<uint64_t>(sizeof(buf), credit - read_total);
+            ssize_t n = read(master_, buf, want);
+            if (n <= 0) continue;
+            read_total += n;
+            wire_bytes_ += n;
+            auto now = Clock::now();
+            if (framed_) {
+                std::string text, reply;
+                decoder_.feed(buf, (size_t)n, text, reply);
+                if (!reply.empty()) (void)!write(master_, reply.data(), reply.size());
+                if (text.empty()) continue;
+                text_bytes_ += text.size();
+            } else {
+                text_bytes_ += n;
+            }
+            std::lock_guard<std::mutex> L(mtx_);
+            arrivals_.emplace_back(text_bytes_, now);
+        }
+    }
+
+    int master_;
+    int baud_;
+    bool framed_;
+    serial_frame::Decoder decoder_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    std::atomic<uint64_t> text_bytes_{0};
+    std::atomic<uint64_t> wire_bytes_{0};
+    std::mutex mtx_;
+    std::vector<std::pair<uint64_t, Clock::time_point>> arrivals_;
+};
+
+static bool runOne(const Options& o, int baud, int token_bytes, Result& r) {
+    int master = -1, slave = -1;
+    char name[128];
+    if (openpty(&master, &slave, name, nullptr, nullptr) != 0) {
+        std::cerr << "[Error] openpty: " << strerror(errno) << std::endl;
+        return false;
+    }
+    termios t;
+    tcgetattr(slave, &t);
+    cfmakeraw(&t);   // no echo: the decoder's replies must not come back to it
+    tcsetattr(slave, TCSANOW, &t);
+
+    SerialOptions opts;
+    opts.tx_buffer = o.tx_buffer;
+    opts.linger_ms = o.linger_ms;
+    opts.framed = o.framed;
+    if (!initSerial(name, baud, opts)) {
+        close(master);
+        close(slave);
+        return false;
+    }
+
+    PacedReader reader(master, baud, o.framed);
+    reader.start();
+
+    // Token stream: fixed interval, text cut from a paragraph of prose
+    std::string prose(kProse);
+    size_t prose_pos = 0;
+    std::vector<std::pair<uint64_t, Clock::time_point>> sent;   // end offset, send time
+    uint64_t offset = 0;
+    auto interval = std::chrono::duration<double>(1.0 / o.tps);
+    auto t0 = Clock::now();
+    auto next = t0;
+    while (std::chrono::duration<double>(Clock::now() - t0).count() < o.seconds) {
+        std::this_thread::sleep_until(next);
+        next += std::chrono::duration_cast<Clock::duration>(interval);
+        std::string tok;
+        while ((int)tok.size() < token_bytes) {
+            size_t n = std::min(prose.size() - prose_pos, (size_t)token_bytes - tok.size());
+            tok.append(prose, prose_pos, n);
+            prose_pos = (prose_pos + n) % prose.size();
+        }
+        ++r.offered;
+        auto now = Clock::now();
+        if (serialSend(tok)) {
+            offset += tok.size();
+            sent.emplace_back(offset, now);
+            ++r.queued;
+        }
+        serialReadAvailable();   // ACK/NAK from the decoder (framed)
+    }
+
+    // Drain: everything queued should reach the far end
+    auto drain_end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(o.drain_seconds));
+    while (reader.textBytes() < offset && Clock::now() < drain_end) {
+        serialReadAvailable();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    r.elapsed_s = std::chrono::duration<double>(Clock::now() - t0).count();
+    r.tx = serialTxStats();
+    reader.stop();
+    closeSerial();
+    close(slave);
+    close(master);
+
+    r.baud = baud;
+    r.token_bytes = token_bytes;
+    r.tps = o.tps;
+    r.framed = o.framed;
+    r.delivered_bytes = reader.textBytes();
+    r.throughput = r.delivered_bytes / r.elapsed_s;
+    r.utilisation = reader.wireBytes() / (r.elapsed_s * baud / 10.0);
+
+    std::vector<double> lat;
+    auto arrivals = reader.arrivals();
+    size_t a = 0;
+    for (const auto& s : sent) {
+        while (a < arrivals.size() && arrivals[a].first < s.first) ++a;
+        if (a == arrivals.size()) break;   // not delivered in time
+        lat.push_back(std::chrono::duration<double, std::milli>(arrivals[a].second - s.second).count());
+    }
+    std::sort(lat.begin(), lat.end());
+    r.p50 = percentile(lat, 50);
+    r.p95 = percentile(lat, 95);
+    r.p99 = percentile(lat, 99);
+    r.max = lat.empty() ? 0 : lat.back();
+    return true;
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --baud LIST      baud rates, comma-separated (default 2400,9600,115200)\n"
+              << "  --sizes LIST     bytes per token (default 4,16,64)\n"
+              << "  --tps N          tokens per second offered (default 30)\n"
+              << "  --seconds N      length of each run (default 5)\n"
+              << "  --framed         use the framed protocol; the far end decodes and ACKs\n"
+              << "  --tx-buffer N    transmit queue size in bytes (default 8192)\n"
+              << "  --linger MS      coalescing window (default 50)\n"
+              << "  --json FILE      also write the results as JSON" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if (a == "--baud") o.bauds = parseList(next());
+        else if (a == "--sizes") o.sizes = parseList(next());
+        else if (a == "--tps") o.tps = std::stod(next());
+        else if (a == "--seconds") o.seconds = std::stod(next());
+        else if (a == "--framed") o.framed = true;
+        else if (a == "--tx-buffer") o.tx_buffer = (size_t)std::stoul(next());
+        else if (a == "--linger") o.linger_ms = std::stoi(next());
+        else if (a == "--json") o.json_path = next();
+        else {
+            usage(argv[0]);
+            return a == "--help" || a == "-h" ? 0 : 1;
+        }
+    }
+    if (o.tps <= 0 || o.seconds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::cout << "serial_bench: " << o.tps << " tokens/s for " << o.seconds << " s per run"
+              << (o.framed ? ", framed" : "") << ", tx buffer " << o.tx_buffer << " B, linger "
+              << o.linger_ms << " ms\n\n";
+    std::cout << std::left << std::setw(8) << "baud" << std::setw(7) << "tok B" << std::right
+              << std::setw(10) << "offer B/s" << std::setw(10) << "got B/s" << std::setw(7) << "line%"
+              << std::setw(9) << "p50 ms" << std::setw(9) << "p95 ms" << std::setw(9) << "p99 ms"
+              << std::setw(9) << "max ms" << std::setw(9) << "dropped" << std::setw(8) << "stalls"
+              << std::setw(8) << "writes" << "\n";
+
+    nlohmann::json runs = nlohmann::json::array();
+    for (int baud : o.bauds) {
+        for (int size : o.sizes) {
+            Result r;
+            if (!runOne(o, baud, size, r)) return 1;
+            std::cout << std::fixed << std::setprecision(1) << std::left << std::setw(8) << baud
+                      << std::setw(7) << size << std::right << std::setw(10) << o.tps * size
+                      << std::setw(10) << r.throughput << std::setw(7) << 100 * r.utilisation
+                      << std::setw(9) << r.p50 << std::setw(9) << r.p95 << std::setw(9) << r.p99
+                      << std::setw(9) << r.max << std::setw(9) << r.tx.bytes_dropped
+                      << std::setw(8) << r.tx.write_stalls << std::setw(8) << r.tx.writes << "\n";
+            std::cout.flush();
+
+            runs.push_back({
+                {"baud", r.baud}, {"token_bytes", r.token_bytes}, {"tokens_per_sec", r.tps},
+                {"framed", r.framed}, {"tokens_offered", r.offered}, {"tokens_queued", r.queued},
+                {"delivered_bytes", r.delivered_bytes}, {"elapsed_s", r.elapsed_s},
+                {"throughput_bps", r.throughput}, {"line_utilisation", r.utilisation},
+                {"latency_ms", {{"p50", r.p50}, {"p95", r.p95}, {"p99", r.p99}, {"max", r.max}}},
+                {"bytes_dropped", r.tx.bytes_dropped}, {"chunks_dropped", r.tx.chunks_dropped},
+                {"peak_queued", r.tx.peak_queued}, {"write_stalls", r.tx.write_stalls},
+                {"writes", r.tx.writes}, {"wire_bytes", r.tx.bytes_sent},
+                {"frames_resent", r.tx.frames_resent}});
+        }
+    }
+
+    if (!o.json_path.empty()) {
+        std::ofstream f(o.json_path);
+        f << nlohmann::json{{"bench", "serial"}, {"runs", runs}}.dump(2) << "\n";
+        if (!f) {
+            std::cerr << "[Error] Could not write " << o.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -22,12 +22,14 @@ int main(int argc, char** argv) {
         if (argc < 4) { std::cerr << "Provide session_id and question\n"; return 1; }
         std::string q;
         for (int i=3;i<argc;++i) { if (i>3) q += " "; q += argv[i]; }
-        std::string ans = AIMaster_RAG_Ask(argv[2], q);
+        bool streamed = false;
+        std::string ans = AIMaster_RAG_Ask(argv[2], q, 5, 0.2,
+            [&streamed](const std::string& t) { streamed = true; std::cout << t << std::flush; });
         if (ans.empty()) {
             std::cerr << "Error: " << AIMaster_RAG_LastError() << "\n";
             return 2;
         }
-        std::cout << ans << "\n";
+        std::cout << (streamed ? "" : ans) << "\n";
     } else if (cmd == "verbose") {
         if (argc < 3) { std::cerr << "Provide 0 or 1\n"; return 1; }
         AIMaster_RAG_SetVerbose(std::string(argv[2])=="1");
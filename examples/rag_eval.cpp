@@ -0,0 +1,349 @@
+// Recall-vs-latency evaluation for the vector search modes.
+//
+// Loads a session (or builds a synthetic one), takes query embeddings, and
+// computes the exact top-k of each with RAGSessionManager::top_k as ground
+// truth. Every other search mode is then swept over its parameters and
+// reported as recall@k against time per query and memory, so an approximate
+// mode can be judged before it is switched on anywhere.
+//
+// Queries come from --questions (embedded through Ollama, the realistic
+// case), --query-file (JSON arrays, one per line), or are sampled from the
+// corpus itself: a chunk's embedding plus noise, so the exact neighbours are
+// near but not trivially the source chunk, with a few of its words as the
+// query text. Modes that need query text (the lexical pre-filter) are
+// skipped for --query-file.
+#include "rag_session.hpp"
+#include "rag_quant.hpp"
+#include "rag_lexical.hpp"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using Hits = std::vector<std::pair<double, size_t>>;
+
+struct Options {
+    std::string session, base_dir = "chroma_cpp";
+    size_t synthetic = 0, dim = 768, clusters = 200;
+    std::string questions_path, query_file;
+    std::string ollama_url = "http://localhost:11434", embed_model = "mxbai-embed-large";
+    size_t queries = 200;
+    double noise = 0.6;                  // sampled queries: noise norm relative to the chunk's
+    std::vector<size_t> ks{5, 10};
+    std::vector<size_t> rerank{0, 2, 4, 8, 16};   // int8 candidates as multiples of k
+    std::vector<size_t> prefilter{500, 2000, 8000};   // BM25 candidates for the pre-filter
+    std::vector<double> max_df{1.0, 0.5};             // pre-filter: stopword cut-offs (1 = keep all terms)
+    size_t min_candidates = 100;
+    uint32_t seed = 7;
+    std::string json_path;
+};
+
+// A search mode at one parameter setting
+struct Method {
+    std::string name, param;
+    size_t resident_bytes = 0;   // memory the mode needs (floats included if used)
+    // Query number, k; sets fell_back when the mode gave up and did a full scan
+    std::function<Hits(size_t qi, int k, bool& fell_back)> search;
+};
+
+static std::vector<size_t> parseList(const std::string& s) {
+    std::vector<size_t> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) if (!item.empty()) out.push_back((size_t)std::stoul(item));
+    return out;
+}
+
+static std::vector<double> parseDoubles(const std::string& s) {
+    std::vector<double> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ',')) if (!item.empty()) out.push_back(std::stod(item));
+    return out;
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * v.size());
+    return v[std::min(v.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static void normalise(std::vector<float>& v) {
+    double n = 0;
+    for (float x : v) n += (double)x * x;
+    if (n <= 0) return;
+    float inv = (float)(1.0 / std::sqrt(n));
+    for (auto& x : v) x *= inv;
+}
+
+// Clustered unit vectors: real embeddings are far from uniform, and
+// uniform data makes every approximate method look worse than it is
+static SessionIndex synthetic(const Options& o, std::mt19937& rng) {
+    std::normal_distribution<float> nd(0.f, 1.f);
+    std::vector<std::vector<float>> centres(std::max<size_t>(o.clusters, 1), std::vector<float>(o.dim));
+    for (auto& c : centres) {
+        for (auto& x : c) x = nd(rng);
+        normalise(c);
+    }
+    std::uniform_int_distribution<size_t> pick(0, centres.size() - 1);
+    // Text follows the clusters: mostly the cluster's own 30 words, some shared
+    // ones and a few function words that occur in nearly every chunk
+    static const char* const kStop[] = {"the", "of", "and", "to", "in"};
+    std::uniform_int_distribution<int> own(0, 29), shared(0, 199), stop(0, 4), coin(0, 9);
+    SessionIndex idx;
+    idx.session_id = "synthetic";
+    idx.reserve(o.synthetic, o.synthetic * 240);
+    float spread = 1.2f / std::sqrt((float)o.dim);
+    Chunk ch;
+    for (size_t i = 0; i < o.synthetic; ++i) {
+        auto& e = ch.embedding;
+        size_t c = pick(rng);
+        e = centres[c];
+        for (auto& x : e) x += spread * nd(rng);
+        normalise(e);
+        ch.id = "synthetic#" + std::to_string(i);
+        std::string& t = ch.text;
+        t.clear();
+        for (int w = 0; w < 40; ++w) {
+            int r = coin(rng);
+            t += r < 6 ? "c" + std::to_string(c) + "w" + std::to_string(own(rng)) + " "
+               : r < 8 ? "w" + std::to_string(shared(rng)) + " " : std::string(kStop[stop(rng)]) + " ";
+        }
+        idx.add_chunk(ch);
+    }
+    return idx;
+}
+
+static bool loadQueries(const Options& o, const SessionIndex& idx, size_t dim, std::mt19937& rng,
+                        std::vector<std::vector<float>>& qs, std::vector<std::string>& texts) {
+    if (!o.questions_path.empty()) {
+        RAGSessionManager mgr(o.base_dir, o.ollama_url, o.embed_model);
+        mgr.setVerbose(false);
+        std::ifstream in(o.questions_path);
+        std::string line;
+        while (std::getline(in, line) && qs.size() < o.queries) {
+            if (line.empty() || line[0] == '#') continue;
+            auto e = mgr.embed(line);
+            if (e.size() != dim) {
+                std::cerr << "[Error] Embedding failed or has the wrong dimension for: " << line << std::endl;
+                return false;
+            }
+            qs.push_back(std::move(e));
+            texts.push_back(line);
+        }
+        return !qs.empty();
+    }
+    if (!o.query_file.empty()) {
+        std::ifstream in(o.query_file);
+        std::string line;
+        while (std::getline(in, line) && qs.size() < o.queries) {
+            if (line.empty()) continue;
+            auto v = nlohmann::json::parse(line).get<std::vector<float>>();
+            if (v.size() != dim) {
+                std::cerr << "[Error] Query vector of dimension " << v.size() << ", index has " << dim << std::endl;
+                return false;
+            }
+            qs.push_back(std::move(v));
+        }
+        return !qs.empty();
+    }
+    std::uniform_int_distribution<size_t> pick(0, idx.size() - 1);
+    std::normal_distribution<float> nd(0.f, 1.f);
+    float sigma = (float)(o.noise / std::sqrt((double)dim));
+    std::vector<std::string> words;
+    while (qs.size() < o.queries) {
+        size_t src = pick(rng);
+        const float* e = idx.row(src);
+        if (std::all_of(e, e + dim, [](float x) { return x == 0.f; })) continue;   // stored without an embedding
+        words.clear();
+        rag_lexical::tokenize(idx.body(src), words);
+        std::string text;
+        for (int w = 0; w < 4 && !words.empty(); ++w) text += words[rng() % words.size()] + " ";
+        texts.push_back(text);
+        std::vector<float> q(e, e + dim);
+        normalise(q);
+        for (auto& x : q) x += sigma * nd(rng);
+        normalise(q);
+        qs.push_back(std::move(q));
+    }
+    return true;
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " (--session ID | --synthetic N) [options]\n"
+              << "  --session ID        evaluate a stored session\n"
+              << "  --base-dir DIR      where sessions live (default chroma_cpp)\n"
+              << "  --synthetic N       N clustered random vectors instead (--dim D, --clusters C)\n"
+              << "  --questions FILE    embed these questions via Ollama (--ollama URL, --embed-model M)\n"
+              << "  --query-file FILE   query vectors, one JSON array per line\n"
+              << "  --queries N         number of queries (default 200)\n"
+              << "  --noise X           sampled queries: noise relative to the chunk (default 0.6)\n"
+              << "  --k LIST            k values for recall@k (default 5,10)\n"
+              << "  --rerank LIST       int8 candidates as multiples of k; 0 = no re-rank (default 0,2,4,8,16)\n"
+              << "  --prefilter LIST    BM25 candidates for the lexical pre-filter (default 500,2000,8000)\n"
+              << "  --min-candidates N  pre-filter: full scan below N keyword matches (default 100)\n"
+              << "  --max-df LIST       pre-filter: ignore query terms in more than this fraction of chunks (default 1,0.5)\n"
+              << "  --seed N            sampling seed (default 7)\n"
+              << "  --json FILE         also write the results as JSON" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if (a == "--session") o.session = next();
+        else if (a == "--base-dir") o.base_dir = next();
+        else if (a == "--synthetic") o.synthetic = (size_t)std::stoul(next());
+        else if (a == "--dim") o.dim = (size_t)std::stoul(next());
+        else if (a == "--clusters") o.clusters = (size_t)std::stoul(next());
+        else if (a == "--questions") o.questions_path = next();
+        else if (a == "--query-file") o.query_file = next();
+        else if (a == "--ollama") o.ollama_url = next();
+        else if (a == "--embed-model") o.embed_model = next();
+        else if (a == "--queries") o.queries = (size_t)std::stoul(next());
+        else if (a == "--noise") o.noise = std::stod(next());
+        else if (a == "--k") o.ks = parseList(next());
+        else if (a == "--rerank") o.rerank = parseList(next());
+        else if (a == "--prefilter") o.prefilter = parseList(next());
+        else if (a == "--min-candidates") o.min_candidates = (size_t)std::stoul(next());
+        else if (a == "--max-df") o.max_df = parseDoubles(next());
+        else if (a == "--seed") o.seed = (uint32_t)std::stoul(next());
+        else if (a == "--json") o.json_path = next();
+        else {
+            usage(argv[0]);
+            return a == "--help" || a == "-h" ? 0 : 1;
+        }
+    }
+    if (o.session.empty() == (o.synthetic == 0) || o.ks.empty() || o.queries == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::mt19937 rng(o.seed);
+    SessionIndex idx;
+    if (!o.session.empty()) {
+        RAGSessionManager mgr(o.base_dir);
+        auto opt = mgr.load_index(o.session);
+        if (!opt) {
+            std::cerr << "[Error] No index for session " << o.session << " in " << o.base_dir << std::endl;
+            return 1;
+        }
+        idx = std::move(*opt);
+    } else {
+        idx = synthetic(o, rng);
+    }
+    size_t dim = idx.dim;
+    if (dim == 0) {
+        std::cerr << "[Error] Index has no embeddings" << std::endl;
+        return 1;
+    }
+    std::vector<std::vector<float>> qs;
+    std::vector<std::string> texts;   // empty for --query-file
+    if (!loadQueries(o, idx, dim, rng, qs, texts)) return 1;
+
+    size_t float_bytes = idx.size() * dim * sizeof(float);
+    auto t0 = Clock::now();
+    rag_quant::Int8Index q8 = rag_quant::build(idx);
+    double build_ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+    auto lex = idx.lexical ? idx.lexical : rag_lexical::Index::build(idx);
+
+    std::cout << "rag_eval: " << idx.size() << " chunks x " << dim << " dims, " << qs.size() << " queries"
+              << " (int8 build " << std::fixed << std::setprecision(1) << build_ms << " ms)\n\n";
+    std::cout << std::left << std::setw(8) << "method" << std::setw(18) << "param" << std::right << std::setw(5) << "k"
+              << std::setw(10) << "recall" << std::setw(11) << "mean ms" << std::setw(11) << "p95 ms" << std::setw(12)
+              << "memory MB" << std::setw(11) << "fallback%" << "\n";
+
+    const double none = -2.0;   // below any cosine: the threshold never cuts
+    nlohmann::json runs = nlohmann::json::array();
+    for (size_t k : o.ks) {
+        // Ground truth, timed as the baseline row
+        std::vector<std::set<size_t>> truth;
+        std::vector<Method> methods;
+        methods.push_back({"exact", "full scan", float_bytes,
+                           [&](size_t qi, int kk, bool&) { return RAGSessionManager::top_k(idx, qs[qi], kk, none); }});
+        for (size_t m : o.rerank) {
+            size_t cand = m * k;
+            methods.push_back({"int8", m ? "rerank " + std::to_string(cand) : "no rerank", q8.bytes() + (m ? float_bytes : 0),
+                               [&, cand](size_t qi, int kk, bool&) {
+                                   return rag_quant::top_k(q8, idx, qs[qi], kk, none, cand);
+                               }});
+        }
+        // As answer() does it: BM25 picks the candidates, cosine ranks them
+        for (size_t cand : texts.empty() ? std::vector<size_t>{} : o.prefilter) {
+            for (double df : o.max_df) {
+                std::ostringstream param;
+                param << "cand " << cand;
+                if (df < 1) param << " df " << df;
+                methods.push_back({"lexical", param.str(), float_bytes + lex->bytes(),
+                                   [&, cand, df](size_t qi, int kk, bool& fell_back) {
+                                       auto kw = lex->search(texts[qi], cand, nullptr, df);
+                                       return RAGSessionManager::prefiltered_top_k(idx, kw, qs[qi], kk, none, o.min_candidates, &fell_back);
+                                   }});
+            }
+        }
+
+        for (const auto& m : methods) {
+            std::vector<double> ms;
+            double recall = 0;
+            size_t fallbacks = 0;
+            for (size_t qi = 0; qi < qs.size(); ++qi) {
+                bool fell_back = false;
+                auto t = Clock::now();
+                Hits h = m.search(qi, (int)k, fell_back);
+                fallbacks += fell_back;
+                ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - t).count());
+                if (truth.size() <= qi) {   // first method is the exact one
+                    std::set<size_t> s;
+                    for (auto& p : h) s.insert(p.second);
+                    truth.push_back(std::move(s));
+                }
+                size_t found = 0;
+                for (auto& p : h) found += truth[qi].count(p.second);
+                recall += truth[qi].empty() ? 1.0 : (double)found / truth[qi].size();
+            }
+            recall /= qs.size();
+            double mean = 0;
+            for (double x : ms) mean += x;
+            mean /= ms.size();
+            double mb = m.resident_bytes / 1048576.0;
+            std::cout << std::left << std::setw(8) << m.name << std::setw(18) << m.param << std::right << std::setw(5) << k
+                      << std::setprecision(4) << std::setw(10) << recall << std::setprecision(3) << std::setw(11) << mean
+                      << std::setw(11) << percentile(ms, 95) << std::setprecision(1) << std::setw(12) << mb
+                      << std::setw(11) << 100.0 * fallbacks / qs.size() << "\n";
+            std::cout.flush();
+            runs.push_back({{"method", m.name}, {"param", m.param}, {"k", k}, {"recall", recall},
+                            {"mean_ms", mean}, {"p50_ms", percentile(ms, 50)}, {"p95_ms", percentile(ms, 95)},
+                            {"p99_ms", percentile(ms, 99)}, {"memory_bytes", m.resident_bytes},
+                            {"fallback_rate", (double)fallbacks / qs.size()}});
+        }
+    }
+
+    if (!o.json_path.empty()) {
+        std::ofstream f(o.json_path);
+        f << nlohmann::json{{"eval", "rag_search"}, {"chunks", idx.size()}, {"dim", dim},
+                            {"queries", qs.size()}, {"int8_build_ms", build_ms}, {"runs", runs}}.dump(2) << "\n";
+        if (!f) {
+            std::cerr << "[Error] Could not write " << o.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
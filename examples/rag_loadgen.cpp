@@ -0,0 +1,383 @@
+// Load generator for the RAG API: replays questions against one or more
+// sessions and reports throughput and per-stage latency percentiles.
+//
+// Closed loop (default): --concurrency workers, each asks its next question
+// as soon as the previous answer is in. Measures how much one host can do.
+// Open loop (--rate R): questions arrive R per second (Poisson, or evenly
+// with --arrival fixed) regardless of how fast they are answered, and run
+// on the async pool (--concurrency threads). Latency is counted from the
+// scheduled arrival, so a saturated host shows up as growing queue time
+// instead of a silently lower offered load.
+//
+// Works against a real Ollama or tools/mock_ollama (--ollama URL).
+#include "rag_adapter.hpp"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string ollama_url, embed_model, llm_model;
+    std::vector<std::string> sessions, folders;
+    std::string questions_path;
+    int concurrency = 4;
+    double rate = 0;            // open loop when > 0
+    bool poisson = true;
+    int requests = 100;
+    double duration = 0;        // seconds; 0 = until --requests
+    int warmup = 2;
+    double drain = 120;         // open loop: seconds to wait for stragglers
+    int k = 5;
+    double threshold = 0.2;
+    uint32_t seed = 1;
+    bool verbose = false;
+    std::string json_path;
+};
+
+// One answered (or failed) question
+struct Sample {
+    double queue_ms = 0, embed_ms = 0, search_ms = 0, generate_ms = 0;
+    double ttft_ms = -1;   // first streamed fragment; -1 if nothing streamed
+    double total_ms = 0;
+    size_t answer_bytes = 0;
+    bool ok = false;
+    bool context = false;   // some chunk passed the threshold (else no model call)
+};
+
+static const char* kDefaultQuestions[] = {
+    "What does this project do?",
+    "How is the index stored on disk?",
+    "Which functions handle the serial port?",
+    "How are answers streamed to the console?",
+    "What happens when a request is cancelled?",
+    "Summarise the configuration options.",
+    "How are documents split into chunks?",
+    "Which models are used for embeddings and answers?"};
+
+static std::vector<std::string> loadQuestions(const std::string& path) {
+    std::vector<std::string> qs;
+    if (path.empty()) {
+        for (auto* q : kDefaultQuestions) qs.push_back(q);
+        return qs;
+    }
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        qs.push_back(line);
+    }
+    return qs;
+}
+
+static double msBetween(Clock::time_point a, Clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static double percentile(std::vector<double> v, double p) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t rank = (size_t)std::ceil(p / 100.0 * v.size());
+    return v[std::min(v.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// Thread-safe sink for samples
+class Recorder {
+public:
+    void add(const Sample& s) {
+        std::lock_guard<std::mutex> L(mtx_);
+        samples_.push_back(s);
+        cv_.notify_all();
+    }
+    // Waits until n samples are in or the deadline passes
+    bool waitFor(size_t n, Clock::time_point deadline) {
+        std::unique_lock<std::mutex> L(mtx_);
+        return cv_.wait_until(L, deadline, [&] { return samples_.size() >= n; });
+    }
+    std::vector<Sample> take() {
+        std::lock_guard<std::mutex> L(mtx_);
+        return samples_;
+    }
+
+private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::vector<Sample> samples_;
+};
+
+static Sample fromAnswer(const RAGAnswer& r, Clock::time_point start, Clock::time_point first_token, bool streamed) {
+    Sample s;
+    s.queue_ms = r.queue_ms;
+    s.embed_ms = r.embed_ms;
+    s.search_ms = r.search_ms;
+    s.generate_ms = r.generate_ms;
+    s.ttft_ms = streamed ? msBetween(start, first_token) : -1;
+    s.total_ms = msBetween(start, Clock::now());
+    s.answer_bytes = r.answer.size();
+    s.ok = r.ok();
+    s.context = !r.hits.empty();
+    return s;
+}
+
+// Per-request streaming state; first_token is set once by the pool thread
+struct InFlight {
+    Clock::time_point start;
+    Clock::time_point first_token;
+    bool streamed = false;
+};
+
+static void runClosed(const Options& o, const std::vector<std::string>& qs, Recorder& rec) {
+    std::atomic<int> next{0};
+    auto stop_at = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.duration));
+    std::vector<std::thread> workers;
+    for (int w = 0; w < o.concurrency; ++w) {
+        workers.emplace_back([&] {
+            for (;;) {
+                int i = next++;
+                if (o.duration > 0 ? Clock::now() >= stop_at : i >= o.requests) break;
+                InFlight f;
+                f.start = Clock::now();
+                auto r = AIMaster_RAG_AskDetailed(o.sessions[i % o.sessions.size()], qs[i % qs.size()], o.k, o.threshold,
+                    [&f](const std::string&) {
+                        if (!f.streamed) {
+                            f.streamed = true;
+                            f.first_token = Clock::now();
+                        }
+                    });
+                rec.add(fromAnswer(r, f.start, f.first_token, f.streamed));
+            }
+        });
+    }
+    for (auto& t : workers) t.join();
+}
+
+// Returns the number of questions issued. rec is shared with the callbacks,
+// which may outlive a run that gave up waiting.
+static size_t runOpen(const Options& o, const std::vector<std::string>& qs, std::shared_ptr<Recorder> rec) {
+    std::mt19937 rng(o.seed);
+    std::exponential_distribution<double> gap(o.rate);
+    size_t total = o.duration > 0 ? (size_t)std::ceil(o.duration * o.rate) : (size_t)o.requests;
+    auto t0 = Clock::now();
+    double at = 0;   // seconds since t0
+    for (size_t i = 0; i < total; ++i) {
+        at += o.poisson ? gap(rng) : 1.0 / o.rate;
+        auto when = t0 + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(at));
+        std::this_thread::sleep_until(when);
+        auto f = std::make_shared<InFlight>();
+        f->start = when;
+        AIMaster_RAG_AskAsync(o.sessions[i % o.sessions.size()], qs[i % qs.size()],
+            [f, rec](const RAGAnswer& r) { rec->add(fromAnswer(r, f->start, f->first_token, f->streamed)); },
+            o.k, o.threshold,
+            [f](const std::string&) {
+                if (!f->streamed) {
+                    f->streamed = true;
+                    f->first_token = Clock::now();
+                }
+            });
+    }
+    return total;
+}
+
+static nlohmann::json stageJson(const std::vector<double>& v) {
+    return {{"p50", percentile(v, 50)}, {"p95", percentile(v, 95)}, {"p99", percentile(v, 99)},
+            {"max", v.empty() ? 0 : *std::max_element(v.begin(), v.end())}, {"samples", v.size()}};
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " (--session ID | --ingest FOLDER)... [options]\n"
+              << "  --session ID       ask against an existing session (repeatable)\n"
+              << "  --ingest FOLDER    ingest FOLDER first and ask against it (repeatable; folders ingest in parallel)\n"
+              << "  --questions FILE   one question per line, # for comments (default: a built-in set)\n"
+              << "  --ollama URL       Ollama base URL (default http://localhost:11434)\n"
+              << "  --embed-model M    embedding model; --llm-model M answer model\n"
+              << "  --concurrency N    closed loop: workers; open loop: async pool threads (default 4)\n"
+              << "  --rate R           open loop at R questions per second (default: closed loop)\n"
+              << "  --arrival A        open loop arrivals: poisson (default) or fixed\n"
+              << "  --requests N       questions to ask (default 100)\n"
+              << "  --duration S       run for S seconds instead of --requests\n"
+              << "  --warmup N         untimed questions first (default 2)\n"
+              << "  --k N, --threshold T  retrieval settings (default 5, 0.2)\n"
+              << "  --seed N           arrival process seed (default 1)\n"
+              << "  --verbose          keep the RAG module's status logs\n"
+              << "  --json FILE        also write the results as JSON" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    Options o;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+        if (a == "--session") o.sessions.push_back(next());
+        else if (a == "--ingest") o.folders.push_back(next());
+        else if (a == "--questions") o.questions_path = next();
+        else if (a == "--ollama") o.ollama_url = next();
+        else if (a == "--embed-model") o.embed_model = next();
+        else if (a == "--llm-model") o.llm_model = next();
+        else if (a == "--concurrency") o.concurrency = std::stoi(next());
+        else if (a == "--rate") o.rate = std::stod(next());
+        else if (a == "--arrival") o.poisson = next() != "fixed";
+        else if (a == "--requests") o.requests = std::stoi(next());
+        else if (a == "--duration") o.duration = std::stod(next());
+        else if (a == "--warmup") o.warmup = std::stoi(next());
+        else if (a == "--k") o.k = std::stoi(next());
+        else if (a == "--threshold") o.threshold = std::stod(next());
+        else if (a == "--seed") o.seed = (uint32_t)std::stoul(next());
+        else if (a == "--verbose") o.verbose = true;
+        else if (a == "--json") o.json_path = next();
+        else {
+            usage(argv[0]);
+            return a == "--help" || a == "-h" ? 0 : 1;
+        }
+    }
+    if ((o.sessions.empty() && o.folders.empty()) || o.concurrency < 1 || o.requests < 1 || o.rate < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    auto qs = loadQuestions(o.questions_path);
+    if (qs.empty()) {
+        std::cerr << "[Error] No questions in " << o.questions_path << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed;
+    AIMaster_RAG_Configure(o.ollama_url, o.embed_model, o.llm_model);
+    AIMaster_RAG_SetVerbose(o.verbose);
+    AIMaster_RAG_SetAsyncThreads((size_t)o.concurrency);
+    AIMaster_RAG_SetIngestThreads((size_t)o.concurrency);
+    nlohmann::json out = {{"mode", o.rate > 0 ? "open" : "closed"}, {"concurrency", o.concurrency}};
+
+    // Ingest: all folders at once on the ingest pool
+    if (!o.folders.empty()) {
+        auto t0 = Clock::now();
+        std::vector<std::future<RAGIngestResult>> jobs;
+        for (const auto& f : o.folders) jobs.push_back(AIMaster_RAG_AddFolderAsync(f));
+        size_t chunks = 0;
+        nlohmann::json ingests = nlohmann::json::array();
+        for (auto& j : jobs) {
+            auto r = j.get();
+            std::cout << "ingest " << r.folder << ": " << r.chunks << " chunks in " << std::setprecision(0)
+                      << r.total_ms << " ms (queued " << r.queue_ms << " ms)";
+            if (!r.ok()) std::cout << " [" << r.error << "]";
+            std::cout << "\n";
+            ingests.push_back({{"folder", r.folder}, {"session_id", r.session_id}, {"chunks", r.chunks},
+                               {"total_ms", r.total_ms}, {"queue_ms", r.queue_ms}, {"error", r.error}});
+            if (!r.session_id.empty()) o.sessions.push_back(r.session_id);
+            chunks += r.chunks;
+        }
+        double s = msBetween(t0, Clock::now()) / 1000;
+        std::cout << "ingest total: " << chunks << " chunks in " << std::setprecision(2) << s << " s ("
+                  << std::setprecision(1) << (s > 0 ? chunks / s : 0) << " chunks/s)\n\n";
+        out["ingest"] = {{"folders", ingests}, {"chunks", chunks}, {"seconds", s},
+                         {"chunks_per_sec", s > 0 ? chunks / s : 0}};
+        if (o.sessions.empty()) {
+            std::cerr << "[Error] Ingest produced no session" << std::endl;
+            return 1;
+        }
+    }
+
+    // Warm-up: loads each session snapshot and opens connections
+    for (int i = 0; i < o.warmup; ++i) {
+        auto r = AIMaster_RAG_AskDetailed(o.sessions[i % o.sessions.size()], qs[i % qs.size()], o.k, o.threshold);
+        if (!r.ok()) std::cerr << "[Warning] warm-up: " << r.error << std::endl;
+    }
+
+    std::cout << (o.rate > 0 ? "open loop, " : "closed loop, ") << o.concurrency << (o.rate > 0 ? " threads, " : " workers, ");
+    std::cout << std::setprecision(1);
+    if (o.rate > 0) std::cout << o.rate << " q/s " << (o.poisson ? "poisson" : "fixed") << ", ";
+    if (o.duration > 0) std::cout << o.duration << " s";
+    else std::cout << o.requests << " questions";
+    std::cout << " over " << o.sessions.size() << " session(s)\n";
+    std::cout.flush();
+
+    auto rec = std::make_shared<Recorder>();
+    auto t0 = Clock::now();
+    size_t issued = 0;
+    if (o.rate > 0) {
+        issued = runOpen(o, qs, rec);
+        auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(o.drain));
+        if (!rec->waitFor(issued, deadline)) std::cerr << "[Warning] Gave up waiting for the last answers" << std::endl;
+    } else {
+        runClosed(o, qs, *rec);
+    }
+    double elapsed = msBetween(t0, Clock::now()) / 1000;
+    auto samples = rec->take();
+    if (o.rate <= 0) issued = samples.size();
+
+    std::vector<double> queue, embed, search, generate, ttft, total;
+    size_t ok = 0, bytes = 0, no_context = 0;
+    for (const auto& s : samples) {
+        if (!s.ok) continue;
+        ++ok;
+        if (!s.context) ++no_context;
+        bytes += s.answer_bytes;
+        queue.push_back(s.queue_ms);
+        embed.push_back(s.embed_ms);
+        search.push_back(s.search_ms);
+        generate.push_back(s.generate_ms);
+        if (s.ttft_ms >= 0) ttft.push_back(s.ttft_ms);
+        total.push_back(s.total_ms);
+    }
+    double qps = elapsed > 0 ? ok / elapsed : 0;
+
+    std::cout << "\n" << ok << " answered, " << (samples.size() - ok) << " failed, "
+              << (issued - samples.size()) << " unfinished in " << std::setprecision(2) << elapsed << " s: "
+              << std::setprecision(2) << qps << " answers/s, " << std::setprecision(0)
+              << (elapsed > 0 ? bytes / elapsed : 0) << " answer B/s\n";
+    if (no_context) std::cout << no_context << " answered without context (nothing passed --threshold; no model call)\n";
+    std::cout << "\n";
+    std::cout << std::left << std::setw(10) << "stage" << std::right << std::setw(10) << "p50 ms" << std::setw(10)
+              << "p95 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << "\n";
+    nlohmann::json stages;
+    auto row = [&](const char* name, const std::vector<double>& v) {
+        std::cout << std::left << std::setw(10) << name << std::right << std::setprecision(1) << std::setw(10)
+                  << percentile(v, 50) << std::setw(10) << percentile(v, 95) << std::setw(10) << percentile(v, 99)
+                  << std::setw(10) << (v.empty() ? 0 : *std::max_element(v.begin(), v.end())) << "\n";
+        stages[name] = stageJson(v);
+    };
+    if (o.rate > 0) row("queue", queue);
+    row("embed", embed);
+    row("search", search);
+    row("ttft", ttft);
+    row("generate", generate);
+    row("total", total);
+
+    if (!o.json_path.empty()) {
+        out["rate"] = o.rate;
+        out["arrival"] = o.poisson ? "poisson" : "fixed";
+        out["sessions"] = o.sessions;
+        out["issued"] = issued;
+        out["answered"] = ok;
+        out["failed"] = samples.size() - ok;
+        out["no_context"] = no_context;
+        out["elapsed_s"] = elapsed;
+        out["answers_per_sec"] = qps;
+        out["answer_bytes_per_sec"] = elapsed > 0 ? bytes / elapsed : 0;
+        out["stages_ms"] = stages;
+        std::ofstream f(o.json_path);
+        f << out.dump(2) << "\n";
+        if (!f) {
+            std::cerr << "[Error] Could not write " << o.json_path << std::endl;
+            return 1;
+        }
+    }
+    return ok == samples.size() ? 0 : 2;
+}
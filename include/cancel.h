@@ -0,0 +1,62 @@
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include <atomic>
+#include <cstdint>
+#include <curl/curl.h>
+
+// Cooperative cancellation for generation and ingestion.
+//
+// Every long-running operation owns a Token. A token is cancelled either
+// directly (cancel()) or by a global request (CANCEL command, Ctrl-C) issued
+// after the token was created, so a stale Ctrl-C never kills the next request.
+// Background tokens ignore the console's Ctrl-C and only follow CANCEL ALL:
+// RAG ingest jobs, and requests from serial terminals and daemon clients,
+// which are cancelled through their own token instead.
+namespace cancel {
+
+class Token {
+public:
+    explicit Token(bool background = false);
+    void cancel() { flag_.store(true); }
+    bool cancelled() const;
+
+private:
+    bool background_;
+    uint64_t all_epoch_;
+    uint64_t fg_epoch_;
+    std::atomic<bool> flag_{false};
+};
+
+// Cancels every operation currently in flight, background jobs included.
+void RequestAll();
+
+// Cancels foreground operations only (what Ctrl-C does).
+void RequestForeground();
+
+// Installs a SIGINT handler that calls RequestForeground() instead of terminating.
+void InstallSigintHandler();
+
+// Binds a token to the calling thread for the lifetime of the scope so that
+// nested HTTP calls (embed, chat) can observe it without extra parameters.
+class Scope {
+public:
+    explicit Scope(Token& t);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Token* prev_;
+};
+
+Token* Current();
+bool Cancelled();   // true if the thread's bound token has been cancelled
+
+// Wires a progress callback into the transfer that aborts it (closing the
+// connection, which makes Ollama stop generating) once the token is cancelled.
+void ApplyToCurl(CURL* curl, Token* token = Current());
+
+} // namespace cancel
+
+#endif
@@ -7,9 +7,23 @@
 struct AppConfig {
     std::string serial_port;
     int baudrate = 0;
+    std::string serial_ports;                 // more ports: path[:baud[:flow[:framed]]], comma-separated
+    std::string serial_flow_control = "none"; // none | xonxoff | rtscts | dtrdsr
+    int serial_tx_buffer = 8192;              // transmit queue size in bytes
+    int serial_linger_ms = 50;                // wait this long to coalesce tokens into a line/frame
+    std::string serial_charset = "utf8";      // utf8 | ascii | latin1
+    int serial_line_width = 0;                // word-wrap column for the terminal, 0 = off
+    std::string serial_newline = "lf";        // lf | crlf
+    bool serial_echo = true;                  // echo input typed on the serial terminal
+    std::string serial_protocol = "text";     // text | framed (see serial_frame.h)
     std::string ollama_url;
     std::string ollama_model;
     int ollama_timeout_seconds = 2;
+    std::string stats_file = "stats.jsonl"; // per-request timing export (JSONL), empty disables
+    // --daemon: Unix socket path and localhost HTTP port (0 disables HTTP)
+    std::string daemon_socket = "/tmp/ollama_cli.sock";
+    int daemon_http_port = 8765;
+    int daemon_workers = 8;
     std::map<std::string, std::string> commands; // command -> description
 };
 
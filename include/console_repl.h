@@ -0,0 +1,13 @@
+#ifndef CONSOLE_REPL_H
+#define CONSOLE_REPL_H
+
+#include <string>
+#include "config_loader.h"
+
+// Interactive console on the EventLoop: readline in callback mode, chat turns
+// over curl_multi, serial input and background-job notices, all on one thread.
+// ASK and INT answers stream above the prompt while the next command is typed;
+// other commands run through processCommand as before. Returns on QUIT or EOF.
+int runConsoleRepl(AppConfig& config, const std::string& historyFile);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef CONVERSATION_H
+#define CONVERSATION_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <jsoncpp/json/json.h>
+
+enum class RetrievalMode; // rag_session.hpp
+
+// Per-conversation knobs for the RAG-first answer path.
+struct ConversationSettings {
+    int rag_k = 5;
+    double rag_threshold = 0.2;
+    RetrievalMode rag_mode{};   // Vector
+    std::string rag_filter;     // ChunkFilter spec, "" = all chunks
+};
+
+// One chat context: its own history, model, active RAG session and settings.
+// Accessors are thread-safe; turnMutex() serializes whole turns so a
+// conversation answers one message at a time while others run in parallel.
+class Conversation {
+public:
+    Conversation(int id, const std::string& name, const std::string& model);
+
+    int id() const { return id_; }
+    const std::string& name() const { return name_; }
+
+    std::string model() const;
+    void setModel(const std::string& model);
+
+    std::string ragSession() const;
+    void setRagSession(const std::string& session_id);
+
+    ConversationSettings settings() const;
+    void setSettings(const ConversationSettings& s);
+
+    std::vector<Json::Value> history() const;   // copy
+    void appendHistory(const Json::Value& msg);
+    void popHistory();
+    void clearHistory();
+    size_t historySize() const;
+
+    std::mutex& turnMutex() { return turn_mtx_; }
+
+private:
+    const int id_;
+    const std::string name_;
+    mutable std::mutex mtx_;                     // guards the fields below
+    std::string model_;
+    std::string rag_session_;
+    ConversationSettings settings_;
+    std::vector<Json::Value> history_;
+    std::mutex turn_mtx_;
+};
+
+using ConversationPtr = std::shared_ptr<Conversation>;
+
+namespace conversations {
+// The console starts with conversation #1 ("main"), created on first use
+// with this model.
+void SetDefaultModel(const std::string& model);
+std::string DefaultModel();
+
+ConversationPtr Create(const std::string& name, const std::string& model);
+// Looks up by id ("2") or by name.
+ConversationPtr Find(const std::string& id_or_name);
+std::vector<ConversationPtr> List();
+// Conversation #1 cannot be closed; closing the console's current one switches back to it.
+bool Close(const std::string& id_or_name, std::string& error);
+
+// Conversation the calling thread works on: the one bound by Scope, else the
+// console's selection.
+ConversationPtr Current();
+void SetConsoleCurrent(const ConversationPtr& conv);
+ConversationPtr ConsoleCurrent();
+
+// Binds a conversation to the current thread (workers serving other clients).
+class Scope {
+public:
+    explicit Scope(ConversationPtr conv);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+private:
+    ConversationPtr prev_;
+};
+} // namespace conversations
+
+#endif
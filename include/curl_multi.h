@@ -0,0 +1,47 @@
+#ifndef CURL_MULTI_H
+#define CURL_MULTI_H
+
+#include <functional>
+#include <map>
+#include <curl/curl.h>
+#include "event_loop.h"
+#include "cancel.h"
+
+// Runs curl transfers on an EventLoop via curl_multi's socket interface, so
+// a streamed answer never blocks the console.
+class CurlMultiDriver {
+public:
+    using Done = std::function<void(CURLcode)>;
+
+    explicit CurlMultiDriver(EventLoop& loop);
+    ~CurlMultiDriver();
+    CurlMultiDriver(const CurlMultiDriver&) = delete;
+    CurlMultiDriver& operator=(const CurlMultiDriver&) = delete;
+
+    // Starts easy; done(result) runs on the loop thread once the transfer has
+    // finished, after which the caller owns (and cleans up) easy again.
+    // A cancelled token aborts the transfer with CURLE_ABORTED_BY_CALLBACK.
+    void add(CURL* easy, Done done, cancel::Token* token = nullptr);
+    size_t active() const { return transfers_.size(); }
+
+private:
+    struct Transfer {
+        Done done;
+        cancel::Token* token;
+    };
+
+    static int socketCallback(CURL* easy, curl_socket_t s, int what, void* userp, void* socketp);
+    static int timerCallback(CURLM* multi, long timeout_ms, void* userp);
+    void action(curl_socket_t s, int flags);
+    void finishTransfers();
+    void complete(CURL* easy, CURLcode result);
+    void checkCancelled();
+
+    EventLoop& loop_;
+    CURLM* multi_;
+    std::map<CURL*, Transfer> transfers_;
+    EventLoop::TimerId curl_timer_ = 0;
+    EventLoop::TimerId cancel_timer_ = 0;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "config_loader.h"
+
+// Server mode (ollama_cli --daemon). Serves the console's operations to
+// many concurrent clients from one warm process:
+//
+//   Unix socket (config.daemon_socket): one JSON request per line, e.g.
+//     {"op":"ask","q":"...","stream":true}
+//   replies with NDJSON: {"token":"..."} lines while streaming, then a final
+//   object carrying "done":true. The connection stays open for more requests.
+//
+//   HTTP on 127.0.0.1:config.daemon_http_port: POST /v1/<op> with the same
+//   JSON body (GET works for ping, stats, conversations, rag_status).
+//   Streaming requests get a chunked application/x-ndjson response.
+//
+// Ops: ping, ask, rag_ask, rag_ingest, rag_status, command, conversations, stats.
+// Requests may name a "conversation" (created on first use) and override its
+// "session" (RAG session id) and "model"; without one each request runs in a
+// fresh throwaway conversation. RAG indexes stay cached between requests.
+//
+// Runs until SIGINT/SIGTERM; returns the process exit code.
+int runDaemon(AppConfig& config);
+
+#endif
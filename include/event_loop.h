@@ -0,0 +1,74 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Single-threaded epoll loop for the console: stdin (readline callback
+// mode), curl_multi sockets, the serial port and timers all run on it.
+// Other threads hand work to it with post().
+class EventLoop {
+public:
+    using FdCallback = std::function<void(uint32_t events)>;   // EPOLLIN / EPOLLOUT / ...
+    using TimerId = uint64_t;
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Watches fd (level-triggered); watchFd on a watched fd updates it.
+    void watchFd(int fd, uint32_t events, FdCallback cb);
+    void unwatchFd(int fd);
+
+    // One-shot timer firing after delay_ms (rounded up to the wheel tick).
+    TimerId addTimer(uint64_t delay_ms, std::function<void()> cb);
+    // Repeating timer, first firing after interval_ms.
+    TimerId addPeriodic(uint64_t interval_ms, std::function<void()> cb);
+    void cancelTimer(TimerId id);
+
+    // Thread-safe: runs fn on the loop thread at the next iteration.
+    void post(std::function<void()> fn);
+
+    // Dispatches events until stop().
+    void run();
+    void stop();
+
+    static constexpr uint64_t kTickMs = 10;
+
+private:
+    // Hashed timing wheel: kSlots buckets of kTickMs; timers further out
+    // than one revolution carry a round count.
+    static constexpr size_t kSlots = 512;
+    struct Timer {
+        TimerId id;
+        uint64_t rounds;
+        uint64_t interval_ticks;   // 0 = one-shot
+        std::function<void()> cb;
+    };
+
+    void schedule(Timer t, uint64_t delay_ticks);
+    void advanceTimers();
+    int nextTimeoutMs() const;
+    void runPosted();
+
+    int ep_ = -1;
+    int wake_fd_ = -1;
+    bool running_ = false;
+    std::map<int, FdCallback> fds_;
+
+    std::vector<std::vector<Timer>> wheel_;
+    size_t timer_count_ = 0;
+    uint64_t current_tick_ = 0;    // ticks processed so far
+    uint64_t start_ms_ = 0;
+    TimerId next_timer_ = 1;
+    std::vector<TimerId> cancelled_;
+
+    std::mutex post_mtx_;
+    std::vector<std::function<void()>> posted_;
+};
+
+#endif
@@ -1,6 +1,25 @@
 #pragma once
 #include <string>
+#include <functional>
 #include <jsoncpp/json/json.h>
 #include "config_loader.h"
+#include "conversation.h"
 
+// Runs a console command against the calling thread's current conversation.
 Json::Value processCommand(const std::string& command, AppConfig& config);
+// Same, against conv (bound to this thread for the duration of the command).
+Json::Value processCommand(const std::string& command, AppConfig& config, const ConversationPtr& conv);
+
+class CurlMultiDriver;
+// Starts a chat turn on the event loop and returns at once; tokens go to the
+// stream sink and done runs on the loop thread. Returns false if conv already
+// has a turn in flight or the request could not be created.
+bool sendMessageAsync(const std::string& query, const ConversationPtr& conv, const AppConfig& config,
+                      CurlMultiDriver& multi, std::function<void(bool ok, const std::string& reply)> done);
+
+// READ / READ_CTX: the chat message carrying context plus the file's contents.
+// False (error set) if the file is missing or empty.
+bool fileContextMessage(const std::string& context, const std::string& filename,
+                        std::string& message, std::string& error);
+// Splits "READ_CTX:<context>|FILE:<path>"; false without the |FILE: part.
+bool parseReadCtx(const std::string& command, std::string& context, std::string& filename);
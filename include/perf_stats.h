@@ -0,0 +1,88 @@
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <curl/curl.h>
+
+// Timing breakdown for a single LLM or embedding request.
+// All durations are in milliseconds; -1 means "not observed".
+struct RequestTiming {
+    std::string kind;              // "chat", "rag_chat", "embed"
+    std::string model;
+    bool ok = false;
+
+    double queue_ms = -1;          // work submitted (see QueuedSince) -> transfer started
+    double connect_ms = -1;        // DNS + TCP connect (curl)
+    double ttfb_ms = -1;           // first response byte (curl)
+    double ttft_ms = -1;           // first content token
+    double total_ms = -1;
+    std::vector<double> inter_token_ms;
+
+    // Counters reported by Ollama in the final (done) response
+    long long prompt_eval_count = -1;
+    long long prompt_eval_duration_ns = -1;
+    long long eval_count = -1;
+    long long eval_duration_ns = -1;
+
+    // Generation rate: Ollama's eval counters if present, otherwise
+    // observed tokens over the streaming window. -1 if unknown.
+    double tokensPerSecond() const;
+};
+
+// Stamps the phases of one request and records it on finish().
+class RequestTimer {
+public:
+    RequestTimer(const std::string& kind, const std::string& model);
+
+    void started();                      // call right before curl_easy_perform
+    void token();                        // call for each streamed token shown to the user
+    void finish(CURL* curl, bool ok);    // pulls curl timings, records the sample
+
+    RequestTiming& timing() { return t_; }
+
+private:
+    using clock = std::chrono::steady_clock;
+    RequestTiming t_;
+    clock::time_point created_, started_, last_token_;
+    bool has_started_ = false;
+    bool has_token_ = false;
+    bool finished_ = false;
+};
+
+namespace perf_stats {
+// Adds a sample to the rolling window and appends it to the JSONL export.
+void Record(const RequestTiming& t);
+
+// JSONL export file; empty disables export.
+void SetExportPath(const std::string& path);
+std::string ExportPath();
+
+// Human-readable rolling percentiles, one block per request kind.
+std::string Summary();
+
+void Reset();
+
+// Stamps when the work that issues the requests was submitted (a queued
+// message, a RAG question posted to its executor, a daemon request), so that
+// RequestTimers created on this thread while the scope lives count queue_ms
+// from there rather than from their own construction. For rag_chat that span
+// includes retrieval.
+class QueuedSince {
+public:
+    explicit QueuedSince(std::chrono::steady_clock::time_point since);
+    ~QueuedSince();
+    QueuedSince(const QueuedSince&) = delete;
+    QueuedSince& operator=(const QueuedSince&) = delete;
+
+    // The innermost stamp on this thread, or now() if none
+    static std::chrono::steady_clock::time_point current();
+
+private:
+    std::chrono::steady_clock::time_point prev_;
+    bool had_prev_;
+};
+} // namespace perf_stats
+
+#endif
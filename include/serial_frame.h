@@ -0,0 +1,146 @@
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Framed, compressed serial protocol for slow links ("serial_protocol=framed").
+//
+// Frame on the wire:
+//   SOF(0xA5) type seq len payload[len] crc_hi crc_lo
+// The CRC is CRC-16/CCITT (poly 0x1021, init 0xFFFF) over type..payload.
+//
+// Host -> device:
+//   'D' seq  data: LZSS-compressed text, in sequence
+//   'S' seq  sync: the decoder drops its history; seq is the next data frame
+// Device -> host (no payload):
+//   'A' seq  ack: every frame before seq arrived
+//   'N' seq  nak: resend from seq (gap or CRC error)
+//   'S' -    sync request: the device lost track, start over
+//
+// Data payloads are LZSS: a flag byte (LSB first, 1 = match) before each
+// group of up to 8 items. A literal is one byte. A match is two bytes,
+// big-endian: a 12-bit code and a 4-bit length (3..18). Codes below 1024
+// point into the static dictionary (kDictionary); code 1023 + d copies from
+// d bytes back (1..3072) in the text decoded since the last sync. History
+// runs across frames, which is why data is only applied in sequence.
+namespace serial_frame {
+
+const uint8_t kSof = 0xA5;
+enum Type : uint8_t { kData = 'D', kSync = 'S', kAck = 'A', kNak = 'N' };
+
+const size_t kMaxPlain = 224;   // text per data frame; incompressible input still fits 255
+const size_t kDictCodes = 1024;
+const size_t kWindow = 3072;
+const int kRetain = 64;         // frames kept for resending
+
+extern const std::string kDictionary;
+
+uint16_t crc16(const uint8_t* data, size_t n);
+std::string build(uint8_t type, uint8_t seq, const std::string& payload = std::string());
+
+struct Frame {
+    uint8_t type = 0;
+    uint8_t seq = 0;
+    std::string payload;
+};
+
+// Finds frames in a byte stream. Bytes that are not part of a frame are
+// handed back (typed input shares the link with the device's replies).
+class Parser {
+public:
+    explicit Parser(size_t max_len = 255) : max_len_(max_len) {}
+    void feed(const char* data, size_t n, std::vector<Frame>& frames, std::string* other = nullptr);
+    uint64_t crcErrors() const { return crc_errors_; }
+
+private:
+    size_t max_len_;
+    std::string buf_;
+    uint64_t crc_errors_ = 0;
+};
+
+class Compressor {
+public:
+    Compressor();
+    void reset();
+    std::string compress(const char* data, size_t n);
+
+private:
+    void hashUpTo(size_t limit);
+    void trim();
+
+    std::string buf_;         // dictionary, then the text since the last reset
+    std::vector<int> head_;   // 3-byte hash -> latest position
+    std::vector<int> prev_;   // position -> previous position with the same hash
+    size_t hashed_ = 0;
+};
+
+class Decompressor {
+public:
+    void reset() { hist_.clear(); }
+    // False on a malformed payload (history is then undefined: resync)
+    bool decompress(const std::string& payload, std::string& out);
+
+private:
+    std::string hist_;
+};
+
+// Sending side: numbering, compression and the frames kept for resending
+class Encoder {
+public:
+    std::string data(const char* text, size_t n);   // n <= kMaxPlain
+    std::string sync();                             // also restarts compression
+    // Drops frames before next; true if any were outstanding
+    bool ack(uint8_t next);
+    // Every kept frame from seq on; empty if seq is no longer kept
+    std::string resendFrom(uint8_t seq, size_t* frames = nullptr) const;
+    uint8_t next() const { return next_; }
+    uint8_t oldest() const { return sent_.empty() ? next_ : sent_.front().first; }
+    size_t unacked() const { return sent_.size(); }
+    size_t unackedBytes() const;
+
+private:
+    Compressor comp_;
+    uint8_t next_ = 0;
+    std::deque<std::pair<uint8_t, std::string>> sent_;
+};
+
+// Receiving side (the reference decoder): in-order delivery, ACK/NAK replies
+class Decoder {
+public:
+    struct Stats {
+        uint64_t bytes_in = 0;
+        uint64_t frames = 0;
+        uint64_t text_bytes = 0;
+        uint64_t crc_errors = 0;
+        uint64_t gaps = 0;          // frames that arrived after a missing one
+        uint64_t duplicates = 0;
+        uint64_t naks = 0;
+        uint64_t syncs = 0;
+    };
+
+    // Appends decoded text and the bytes to send back to the host
+    void feed(const char* data, size_t n, std::string& text, std::string& reply);
+    // Call when the link has been quiet for a while: a lost sync request is repeated
+    void tick() { sync_requested_ = false; }
+    std::string requestSync() const { return build(kSync, 0); }
+    const Stats& stats() const { return stats_; }
+
+private:
+    void nak(std::string& reply);
+
+    Parser parser_;
+    Decompressor dec_;
+    bool synced_ = false;
+    uint8_t expected_ = 0;
+    bool sync_requested_ = false;
+    Stats stats_;
+};
+
+} // namespace serial_frame
+
+#endif
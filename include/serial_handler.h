@@ -2,17 +2,135 @@
 #define SERIAL_HANDLER_H
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include "config_loader.h"
+#include "serial_tx.h"
+#include "serial_text.h"
 
-extern bool serial_available;
+extern bool serial_available;   // at least one port is open
 
-// Initialize serial connection with port and baudrate
-bool initSerial(const std::string& port, int baudrate);
+struct sp_port;
 
-// Send a string over serial (if available)
-void serialSend(const std::string& data);
+// Link settings beyond port and baudrate
+struct SerialOptions {
+    std::string flow_control = "none";   // none / xonxoff / rtscts / dtrdsr
+    size_t tx_buffer = 8192;             // transmit queue size in bytes
+    int linger_ms = 50;                  // coalescing window for streamed tokens
+    bool echo = true;                    // echo what the terminal types
+    bool framed = false;                 // serial_frame protocol instead of plain text
+    SerialTextOptions text;              // charset / line width / newline
+};
 
-// Close serial connection
+// Reads the serial_* keys of config.txt
+SerialOptions serialOptionsFromConfig(const AppConfig& config);
+
+// One open serial port: its transmit queue, terminal rendering and input.
+// Thread-safe; shared by the console tee, the REPL client and SERIAL.
+class SerialPort {
+public:
+    // Opens path; on failure ok() is false and error() says why
+    SerialPort(const std::string& path, int baudrate, const SerialOptions& opts);
+    ~SerialPort();   // lets queued output drain, then closes
+    SerialPort(const SerialPort&) = delete;
+    SerialPort& operator=(const SerialPort&) = delete;
+
+    bool ok() const { return port_ != nullptr; }
+    const std::string& error() const { return error_; }
+    const std::string& path() const { return path_; }
+    std::string name() const;   // path without /dev/, e.g. ttyUSB0
+    int baudrate() const { return baudrate_; }
+    const SerialOptions& options() const { return opts_; }
+
+    bool send(const std::string& data);                    // raw bytes, never blocks
+    bool sendWait(const std::string& data, int timeout_ms);
+    bool sendText(const std::string& text);                // rendered for the terminal
+    void endText();
+    SerialTxStats txStats() const;
+
+    int fd() const;                                        // for poll/epoll, or -1
+    std::string readAvailable();                           // non-blocking; framed: typed bytes only
+
+    bool echo() const { return echo_; }
+    void setEcho(bool on) { echo_ = on; }
+
+private:
+    std::string path_;
+    int baudrate_;
+    SerialOptions opts_;
+    std::string error_;
+    sp_port* port_ = nullptr;
+    std::unique_ptr<SerialTxQueue> tx_;
+    serial_frame::Parser replies_{0};   // ACK/NAK from a framed device
+    std::mutex text_mtx_;
+    SerialTextTransform text_;
+    std::atomic<bool> echo_{true};
+};
+using SerialPortPtr = std::shared_ptr<SerialPort>;
+
+// Every configured port: serial_port/baudrate first, then the serial_ports
+// list ("path[:baud[:flow[:framed]]]" entries, comma-separated). Other settings are
+// shared.
+struct SerialPortConfig {
+    std::string path;
+    int baudrate = 0;
+    SerialOptions opts;
+};
+std::vector<SerialPortConfig> serialPortsFromConfig(const AppConfig& config);
+
+namespace serial_ports {
+// Opens every configured port; returns how many are open.
+size_t OpenAll(const AppConfig& config);
+std::vector<SerialPortPtr> List();
+// The first open port; the console's output is teed to it.
+SerialPortPtr Primary();
+SerialPortPtr Find(const std::string& name_or_path);
+void CloseAll();
+
+// The port whose terminal issued the command running on this thread, if any
+SerialPortPtr Current();
+class Scope {
+public:
+    explicit Scope(SerialPortPtr port);
+    ~Scope();
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    SerialPortPtr prev_;
+};
+} // namespace serial_ports
+
+// ---- Primary port shortcuts (no-ops without a port) ----
+
+// Opens one port and adds it to serial_ports (the first one is primary)
+bool initSerial(const std::string& port, int baudrate, const SerialOptions& opts = SerialOptions{});
+
+// Queue a string for the serial writer thread (if available). Never blocks;
+// returns false if the queue was full and the text was dropped.
+bool serialSend(const std::string& data);
+
+// Like serialSend, but waits up to timeout_ms for queue space.
+bool serialSendWait(const std::string& data, int timeout_ms);
+
+// Streamed model text: rendered for the far terminal (charset, wrapping)
+// and queued without blocking.
+bool serialSendText(const std::string& text);
+// Ends a streamed answer: releases a held word and ends the line.
+void serialEndText();
+
+// Transmit queue depth, throughput and drop counters
+SerialTxStats serialTxStats();
+
+// OS handle of the open port for poll/epoll, or -1
+int serialFd();
+
+// Reads whatever input is waiting without blocking (empty if none)
+std::string serialReadAvailable();
+
+// Close every serial connection
 void closeSerial();
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef SERIAL_LINE_H
+#define SERIAL_LINE_H
+
+#include <string>
+#include <vector>
+
+// Line discipline for a terminal on the serial port (the host does the
+// "cooked mode" work): CR, LF or CR LF end a line, BS/DEL erase a
+// character, Ctrl-U erases the line, Ctrl-C is reported as an interrupt.
+// With echo on, the bytes to send back are collected in Input::echo.
+class SerialLineDiscipline {
+public:
+    explicit SerialLineDiscipline(bool echo = true, bool crlf = false, size_t maxLine = 512);
+
+    struct Input {
+        std::vector<std::string> lines;   // completed lines, in order
+        bool interrupt = false;           // Ctrl-C seen
+        std::string echo;                 // bytes to write back to the terminal
+    };
+    Input feed(const std::string& bytes);
+
+    void setEcho(bool on) { echo_ = on; }
+    bool echo() const { return echo_; }
+
+private:
+    void erase(Input& in);
+
+    bool echo_;
+    bool crlf_;
+    size_t max_line_;
+    std::string line_;
+    bool last_cr_ = false;   // swallow the LF of a CR LF pair
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SERIAL_TEXT_H
+#define SERIAL_TEXT_H
+
+#include <string>
+
+// How streamed text is rendered for the terminal on the serial link
+struct SerialTextOptions {
+    std::string charset = "utf8";   // utf8 | ascii | latin1
+    int line_width = 0;             // word-wrap column; 0 = no wrapping
+    bool crlf = false;              // end lines with CR LF instead of LF
+};
+
+// Stateful transform from model output (UTF-8, arbitrary token splits) to
+// the bytes the far end expects. Non-ASCII punctuation is transliterated
+// for ascii/latin1 ("smart" quotes, dashes, ellipsis); ANSI escape
+// sequences and control characters other than newline and tab are dropped. With a line width, the current
+// word is held until it is known whether it fits on the line.
+class SerialTextTransform {
+public:
+    explicit SerialTextTransform(const SerialTextOptions& opts = SerialTextOptions{});
+
+    // Returns the bytes ready to send for this fragment
+    std::string feed(const std::string& text);
+    // Ends the current answer: releases any held word and ends the line
+    std::string finish();
+
+private:
+    void putCodepoint(std::string& out, unsigned cp);
+    void putGlyph(std::string& out, const std::string& glyph);
+    void flushWord(std::string& out);
+    void newline(std::string& out);
+
+    SerialTextOptions opts_;
+    std::string utf8_partial_;   // incomplete sequence split across tokens
+    std::string word_;
+    int word_cols_ = 0;
+    int column_ = 0;
+    bool space_ = false;         // a space is owed before the next word
+    bool wrapped_ = false;       // the current line was started by wrapping
+    int esc_ = 0;                // inside an ANSI sequence: 1 after ESC, 2 in CSI
+};
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef SERIAL_TX_H
+#define SERIAL_TX_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <chrono>
+#include "serial_frame.h"
+
+struct sp_port;
+
+// Transmit counters for one port
+struct SerialTxStats {
+    size_t queued = 0;            // bytes waiting in the ring buffer
+    size_t capacity = 0;
+    size_t peak_queued = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t bytes_dropped = 0;   // rejected because the queue was full
+    uint64_t chunks_dropped = 0;
+    uint64_t write_stalls = 0;    // times the link made no progress for a while (flow control, slow link)
+    uint64_t write_errors = 0;
+    uint64_t writes = 0;
+    double bytes_per_sec = 0;     // over the last few seconds
+    // Framed protocol only (bytes_sent then counts wire bytes)
+    bool framed = false;
+    uint64_t text_bytes = 0;      // before compression
+    uint64_t frames = 0;
+    uint64_t frames_resent = 0;
+    uint64_t naks = 0;
+    uint64_t syncs = 0;
+};
+
+// Bounded ring buffer per port. enqueue() never blocks, so it is safe to
+// call from the HTTP receive callback. All queues are drained by one
+// writer thread that polls every port for POLLOUT and writes without
+// blocking, so flow control holding one port off never delays the others.
+// Writes are frames of ~100 ms of line time; with a linger the writer
+// waits that long on an idle link for a newline or a full frame, so
+// single tokens are coalesced instead of sent one by one.
+//
+// Framed, the queued text is cut into serial_frame data frames as it is
+// written; frames are kept until the device acknowledges them and are
+// resent on a NAK, or after a timeout once the device has shown it ACKs.
+class SerialTxQueue {
+public:
+    SerialTxQueue(sp_port* port, int baudrate, size_t capacity, int linger_ms = 0, bool framed = false);
+    ~SerialTxQueue();   // drains for up to 2 s, then leaves the writer
+    SerialTxQueue(const SerialTxQueue&) = delete;
+    SerialTxQueue& operator=(const SerialTxQueue&) = delete;
+
+    // Queues all of data or none of it; false (and counted) if it does not fit.
+    bool enqueue(const std::string& data);
+    // Waits up to timeout_ms for room instead of dropping.
+    bool enqueueWait(const std::string& data, int timeout_ms);
+    // Waits until everything queued has been written. False on timeout.
+    bool flush(int timeout_ms);
+
+    SerialTxStats stats() const;
+
+    // ACK / NAK / sync request from the device (framed only)
+    void onPeerFrame(const serial_frame::Frame& f);
+
+private:
+    friend class SerialTxWriter;
+    using clock = std::chrono::steady_clock;
+
+    bool pushLocked(const std::string& data);
+    // Writer side: whether a frame may go now (else when to look again)
+    bool ready(clock::time_point now, clock::time_point& wake);
+    void writeFrame(clock::time_point now);
+    void nextWire(clock::time_point now);
+    bool wirePending() const { return wire_off_ < wire_.size() || !control_.empty(); }
+    void queueControl(const std::string& frames);
+    void checkResend(clock::time_point now, clock::time_point& wake);
+
+    sp_port* port_;
+    int fd_ = -1;
+    int baudrate_;
+    std::vector<char> ring_;
+    size_t head_ = 0;   // next byte to write
+    size_t size_ = 0;   // bytes queued
+    size_t newlines_ = 0;   // '\n' bytes queued
+    clock::time_point first_queued_;   // when the queue last went non-empty
+    clock::time_point progress_;       // last write that moved bytes (or when data arrived)
+    bool stalled_ = false;             // current stall already counted
+    int linger_ms_;
+    size_t frame_;          // bytes per write
+
+    bool framed_;
+    serial_frame::Encoder enc_;
+    std::string wire_;      // frame(s) being written
+    size_t wire_off_ = 0;
+    std::string control_;   // syncs and resends, ahead of new data
+    bool peer_acks_ = false;             // the device has ACKed: resend on timeout
+    clock::time_point ack_progress_;     // last ACK that moved (or first frame outstanding)
+    uint8_t last_nak_ = 0;
+    clock::time_point nak_quiet_until_;  // repeats of last_nak_ are ignored until then
+
+    mutable std::mutex mtx_;
+    std::condition_variable space_cv_;   // enqueueWait / flush wait for room
+    SerialTxStats stats_;
+    std::deque<std::pair<clock::time_point, size_t>> recent_;   // rate window
+};
+
+#endif
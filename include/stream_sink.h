@@ -0,0 +1,45 @@
+#ifndef STREAM_SINK_H
+#define STREAM_SINK_H
+
+#include <string>
+#include <functional>
+
+// Writes a fragment of streamed model output to the user-facing sinks:
+// the console (green) and the serial port, or log.txt when none is attached.
+// Shared by the plain chat path and the RAG answer path.
+void streamSinkWrite(const std::string& text);
+
+// Prints a whole status line ("[Thinking..]", "[Cancelled]") next to the
+// stream; an empty line just terminates the streamed text.
+void streamSinkStatus(const std::string& line);
+
+// Queues streamed text for the serial port, or appends it to log.txt
+// when no port is attached. Never blocks on the link.
+void streamSinkLog(const std::string& text);
+// Marks the end of a streamed answer for the serial port (ends the line).
+void streamSinkLogEnd();
+
+// Redirects streamSinkWrite() (and optionally streamSinkStatus()) on the
+// calling thread, e.g. to a daemon client's socket or the event-loop
+// console; the previous sinks are restored when the scope ends.
+using StreamSinkFn = std::function<void(const std::string&)>;
+class StreamSinkScope {
+public:
+    explicit StreamSinkScope(StreamSinkFn fn, StreamSinkFn status = nullptr);
+    ~StreamSinkScope();
+    StreamSinkScope(const StreamSinkScope&) = delete;
+    StreamSinkScope& operator=(const StreamSinkScope&) = delete;
+
+private:
+    StreamSinkFn prev_, prev_status_;
+};
+
+// The calling thread's current overrides (empty = defaults), for work that
+// finishes on another thread or later on the event loop but should still
+// report to whoever started it.
+struct StreamSinks {
+    StreamSinkFn write, status;
+};
+StreamSinks streamSinkCurrent();
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size worker pool running tasks in FIFO order. Workers start on the
+// first post(), so an idle pool costs nothing. Exceptions escaping a task are
+// swallowed. Used by the daemon's request workers and the async RAG API.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 4);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Thread-safe. After stop() the task runs inline on the caller.
+    void post(std::function<void()> task);
+
+    // Worker count; takes effect before the first post().
+    void setThreads(size_t n);
+    size_t threads() const;
+
+    // Tasks queued but not yet picked up by a worker.
+    size_t pending() const;
+
+    // Runs the remaining queued tasks and joins the workers.
+    void stop();
+
+private:
+    void worker();
+
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> workers_;
+    size_t threads_;
+    bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,156 @@
+// Reference decoder for serial_protocol=framed: prints the decoded text and
+// answers with ACK/NAK, like a capable device on the other end of the link.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <cerrno>
+#include <cstring>
+#include "serial_frame.h"
+
+static speed_t to_speed(int baudrate) {
+    switch (baudrate) {
+        case 300: return B300;
+        case 1200: return B1200;
+        case 2400: return B2400;
+        case 4800: return B4800;
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        default:
+            std::cerr << "Unsupported baudrate " << baudrate << ", using 9600" << std::endl;
+            return B9600;
+    }
+}
+
+void configure_port(int fd, int baudrate) {
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0) {
+        std::cerr << "Error getting termios attributes: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+
+    cfmakeraw(&tty);   // frames are binary: no translation of any kind
+    cfsetospeed(&tty, to_speed(baudrate));
+    cfsetispeed(&tty, to_speed(baudrate));
+    tty.c_cflag &= ~(PARENB | CSTOPB | CRTSCTS);
+    tty.c_cflag |= CS8 | CREAD | CLOCAL;
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tty) != 0) {
+        std::cerr << "Error setting termios attributes: " << strerror(errno) << std::endl;
+        exit(1);
+    }
+}
+
+static void print_stats(const serial_frame::Decoder& dec) {
+    const auto& s = dec.stats();
+    std::cerr << "\n[serial_decode] " << s.bytes_in << " bytes in, " << s.frames << " data frames, "
+              << s.text_bytes << " text bytes";
+    if (s.bytes_in) std::cerr << " (" << (100 * s.text_bytes / s.bytes_in) << "% of wire)";
+    std::cerr << "\n  crc errors " << s.crc_errors << ", gaps " << s.gaps << ", duplicates " << s.duplicates
+              << ", naks " << s.naks << ", syncs " << s.syncs << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && std::string(argv[1]) == "-f") {
+        // Offline: decode a capture of the host's output (replies are dropped)
+        std::ifstream in(argv[2], std::ios::binary);
+        if (!in) {
+            std::cerr << "Error opening " << argv[2] << std::endl;
+            return 1;
+        }
+        serial_frame::Decoder dec;
+        char buf[4096];
+        std::string text, reply;
+        while (in.read(buf, sizeof(buf)) || in.gcount() > 0) {
+            dec.feed(buf, (size_t)in.gcount(), text, reply);
+            std::cout << text;
+            text.clear();
+            reply.clear();
+        }
+        print_stats(dec);
+        return 0;
+    }
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <serial_port> <baudrate> [--noise N]\n"
+                  << "       " << argv[0] << " -f <capture_file>\n"
+                  << "  --noise N  flip one bit in every Nth byte received (exercises NAK/resend)" << std::endl;
+        return 1;
+    }
+
+    std::string port = argv[1];
+    int baudrate = std::stoi(argv[2]);
+    long noise = 0;
+    if (argc >= 5 && std::string(argv[3]) == "--noise") noise = std::stol(argv[4]);
+
+    int fd = open(port.c_str(), O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        std::cerr << "Error opening " << port << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    configure_port(fd, baudrate);
+
+    std::cerr << "Framed serial decoder on " << port << " at " << baudrate << " baud.\n";
+    std::cerr << "Typed lines are sent as they are; Ctrl-D quits." << std::endl;
+
+    serial_frame::Decoder dec;
+    std::string reply = dec.requestSync();   // start from a clean history
+    (void)!write(fd, reply.data(), reply.size());
+
+    fd_set readfds;
+    char buf[512];
+    long received = 0;
+
+    while (true) {
+        FD_ZERO(&readfds);
+        FD_SET(fd, &readfds);
+        FD_SET(STDIN_FILENO, &readfds);
+
+        int maxfd = (fd > STDIN_FILENO ? fd : STDIN_FILENO) + 1;
+        struct timeval tv = {1, 0};
+        int activity = select(maxfd, &readfds, NULL, NULL, &tv);
+
+        if (activity < 0 && errno != EINTR) {
+            std::cerr << "select() error: " << strerror(errno) << std::endl;
+            break;
+        }
+        if (activity == 0) {
+            dec.tick();   // quiet link: a lost sync request may be repeated
+            continue;
+        }
+
+        if (FD_ISSET(fd, &readfds)) {
+            int n = read(fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            if (noise > 0) {
+                for (int i = 0; i < n; ++i)
+                    if (++received % noise == 0) buf[i] ^= 0x04;
+            }
+            std::string text;
+            reply.clear();
+            dec.feed(buf, (size_t)n, text, reply);
+            if (!reply.empty()) (void)!write(fd, reply.data(), reply.size());
+            std::cout << text;
+            std::cout.flush();
+        }
+
+        if (FD_ISSET(STDIN_FILENO, &readfds)) {
+            int n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n <= 0) break;
+            (void)!write(fd, buf, n);
+        }
+    }
+
+    print_stats(dec);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "cancel.h"
+#include <csignal>
+#include <cstring>
+
+namespace cancel {
+
+// Bumped by RequestAll()/RequestForeground(); lock-free so the signal
+// handler may touch them.
+static std::atomic<uint64_t> g_all_epoch{0};
+static std::atomic<uint64_t> g_fg_epoch{0};
+static thread_local Token* t_current = nullptr;
+
+Token::Token(bool background)
+    : background_(background), all_epoch_(g_all_epoch.load()), fg_epoch_(g_fg_epoch.load()) {}
+
+bool Token::cancelled() const {
+    if (flag_.load() || g_all_epoch.load() != all_epoch_) return true;
+    return !background_ && g_fg_epoch.load() != fg_epoch_;
+}
+
+void RequestAll() {
+    g_all_epoch.fetch_add(1);
+}
+
+void RequestForeground() {
+    g_fg_epoch.fetch_add(1);
+}
+
+static void on_sigint(int) {
+    g_fg_epoch.fetch_add(1);
+}
+
+void InstallSigintHandler() {
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART; // keep blocking reads (getline, readline) alive
+    sigaction(SIGINT, &sa, nullptr);
+}
+
+Scope::Scope(Token& t) : prev_(t_current) { t_current = &t; }
+Scope::~Scope() { t_current = prev_; }
+
+Token* Current() { return t_current; }
+
+bool Cancelled() { return t_current && t_current->cancelled(); }
+
+static int xferinfo(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return static_cast<Token*>(clientp)->cancelled() ? 1 : 0;
+}
+
+void ApplyToCurl(CURL* curl, Token* token) {
+    if (!curl || !token) return;
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, token);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+}
+
+} // namespace cancel
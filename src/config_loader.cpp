@@ -51,10 +51,44 @@ bool loadConfig(const std::string& filename, AppConfig& config) {
             } catch (...) {
                 std::cerr << "[Warning] Invalid baudrate value: " << value << std::endl;
             }
+        } else if (key_lower == "serial_flow_control") {
+            config.serial_flow_control = value;
+        } else if (key_lower == "serial_ports") {
+            config.serial_ports = value;
+        } else if (key_lower == "serial_charset") {
+            config.serial_charset = value;
+        } else if (key_lower == "serial_newline") {
+            config.serial_newline = value;
+        } else if (key_lower == "serial_protocol") {
+            config.serial_protocol = value;
+            std::transform(config.serial_protocol.begin(), config.serial_protocol.end(),
+                           config.serial_protocol.begin(), ::tolower);
+        } else if (key_lower == "serial_echo") {
+            config.serial_echo = !(value == "0" || value == "off" || value == "false" || value == "no");
+        } else if (key_lower == "serial_tx_buffer" || key_lower == "serial_linger_ms" ||
+                   key_lower == "serial_line_width") {
+            try {
+                int v = std::stoi(value);
+                if (key_lower == "serial_tx_buffer") config.serial_tx_buffer = v;
+                else if (key_lower == "serial_linger_ms") config.serial_linger_ms = v;
+                else config.serial_line_width = v;
+            } catch (...) {
+                std::cerr << "[Warning] Invalid " << key_lower << " value: " << value << std::endl;
+            }
         } else if (key_lower == "ollama_url") {
             config.ollama_url = value;
         } else if (key_lower == "ollama_model") {
             config.ollama_model = value;
+        } else if (key_lower == "stats_file") {
+            config.stats_file = value;
+        } else if (key_lower == "daemon_socket") {
+            config.daemon_socket = value;
+        } else if (key_lower == "daemon_http_port" || key_lower == "daemon_workers") {
+            try {
+                (key_lower == "daemon_workers" ? config.daemon_workers : config.daemon_http_port) = std::stoi(value);
+            } catch (...) {
+                std::cerr << "[Warning] Invalid " << key_lower << " value: " << value << std::endl;
+            }
         }
     }
 
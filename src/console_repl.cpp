@@ -0,0 +1,549 @@
+#include "console_repl.h"
+#include "event_loop.h"
+#include "curl_multi.h"
+#include "ollama_client.h"
+#include "conversation.h"
+#include "stream_sink.h"
+#include "serial_handler.h"
+#include "rag_adapter.hpp"
+#include "rag_executor.hpp"
+#include "rag_int_bridge.hpp"
+#include "rag_jobs.hpp"
+#include "utils.h"
+#include "cancel.h"
+#include "perf_stats.h"
+#include "serial_line.h"
+#include <readline/readline.h>
+#include <readline/history.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <streambuf>
+
+namespace {
+
+// Prints model output and status lines above the readline prompt without
+// disturbing what the user is typing. While a command runs in the line
+// handler the prompt is hidden and text goes straight to the terminal.
+class ConsoleOutput {
+public:
+    void setPromptActive(bool on) { prompt_active_ = on; }
+    // Off when the primary port is a REPL client: its own replies stream there,
+    // and copying console answers in would interleave the two on the terminal
+    void setSerialMirror(bool on) { mirror_ = on; }
+
+    // Streamed text; shown a line at a time above the prompt
+    void stream(const std::string& text) {
+        if (mirror_) streamSinkLog(text);
+        if (!prompt_active_) {
+            std::cout << "\033[32m" << text << "\033[0m" << std::flush;
+            raw_open_ = true;
+            return;
+        }
+        partial_ += text;
+        int rows = 0, cols = 0;
+        rl_get_screen_size(&rows, &cols);
+        size_t nl;
+        while ((nl = partial_.find('\n')) != std::string::npos) {
+            emit("\033[32m" + partial_.substr(0, nl) + "\033[0m\n");
+            partial_.erase(0, nl + 1);
+        }
+        if (cols > 0 && partial_.size() >= (size_t)cols) {
+            emit("\033[32m" + partial_ + "\033[0m\n");
+            partial_.clear();
+        }
+    }
+
+    // Whole line; ends a pending streamed line first. "" only does that.
+    void line(const std::string& text) {
+        if (text.empty() && mirror_) streamSinkLogEnd();
+        if (raw_open_) { std::cout << "\n"; raw_open_ = false; }
+        std::string out;
+        if (!partial_.empty()) out = "\033[32m" + partial_ + "\033[0m\n";
+        partial_.clear();
+        if (!text.empty()) out += text + "\n";
+        if (!out.empty()) emit(out);
+    }
+
+private:
+    void emit(const std::string& s) {
+        if (!prompt_active_) { std::cout << s << std::flush; return; }
+        int point = rl_point;
+        char* saved = rl_copy_text(0, rl_end);
+        rl_save_prompt();
+        rl_replace_line("", 0);
+        rl_redisplay();
+        std::cout << "\r\033[K" << s << std::flush;
+        rl_restore_prompt();
+        rl_replace_line(saved, 0);
+        rl_point = point;
+        rl_redisplay();
+        free(saved);
+    }
+
+    std::string partial_;
+    bool prompt_active_ = false;
+    bool mirror_ = true;
+    bool raw_open_ = false;
+};
+
+// std::cout redirected to the serial terminal while one of its commands runs
+// through processCommand, so the reply goes back where the command came from.
+class SerialCout : public std::streambuf {
+public:
+    explicit SerialCout(std::function<void(const std::string&)> fn)
+        : fn_(std::move(fn)), prev_(std::cout.rdbuf(this)) {}
+    ~SerialCout() override { std::cout.rdbuf(prev_); }
+
+protected:
+    int overflow(int c) override {
+        if (c != EOF) fn_(std::string(1, (char)c));
+        return c;
+    }
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        fn_(std::string(s, (size_t)n));
+        return n;
+    }
+
+private:
+    std::function<void(const std::string&)> fn_;
+    std::streambuf* prev_;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static double msSince(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+// One command from the serial terminal, timed from Enter to the end of its reply
+struct SerialRequest {
+    Clock::time_point received = Clock::now();
+    Clock::time_point started = received;   // left the conversation's queue
+    double first_output_ms = -1;
+    bool async = false;                     // answered by a chat turn, finished in turnDone
+    bool ok = true;
+    cancel::Token token{/*background=*/true};   // Ctrl-C on the terminal, not the console's
+};
+using SerialRequestPtr = std::shared_ptr<SerialRequest>;
+
+// How a chat turn is answered: RAG with plain chat as the fallback (ASK, INT),
+// plain chat only (READ_CTX) or RAG only (RAG_ASK)
+enum class Route { Auto, Chat, Rag };
+
+// Where commands come from: the local console or the serial terminal. Each
+// has its own INT mode and gets its own answers back.
+struct Client {
+    bool serial = false;
+    ConversationPtr conv;           // serial only; the console follows CONV USE
+    bool int_mode = false;
+    StreamSinkFn write, status;     // answer text / status lines for this client
+    SerialRequestPtr active;        // request currently producing output
+    int pending = 0;                // chat turns running or queued
+    SerialPortPtr port;             // serial only
+    SerialLineDiscipline line;
+};
+
+class ConsoleRepl {
+public:
+    ConsoleRepl(AppConfig& config, const std::string& historyFile)
+        : config_(config), history_(historyFile), multi_(loop_) {}
+
+    int run();
+
+private:
+    struct Queued {
+        Client* client;
+        std::string text;
+        SerialRequestPtr req;
+        Route route;
+        Clock::time_point at;   // typed
+    };
+
+    static void lineHandler(char* input);
+    void onLine(char* input);
+    ConversationPtr convOf(const Client& c) const;
+    void dispatch(Client& c, std::string command, const SerialRequestPtr& req = nullptr);
+    void reply(Client& c, const std::string& line);
+    void chat(Client& c, const std::string& text, const SerialRequestPtr& req, Route route = Route::Auto,
+              Clock::time_point submitted = Clock::now());
+    void startChat(Client& c, const ConversationPtr& conv, const std::string& text, const SerialRequestPtr& req);
+    void turnDone(Client& c, const ConversationPtr& conv, const SerialRequestPtr& req, bool ok);
+    void finishSerialRequest(Client& c, const SerialRequestPtr& req, bool ok);
+    void addSerialClient(const SerialPortPtr& port);
+    void onSerialInput(Client& c);
+    void serialPrompt(Client& c);
+    std::string prompt() const;
+
+    static ConsoleRepl* instance_;
+
+    AppConfig& config_;
+    std::string history_;
+    EventLoop loop_;
+    CurlMultiDriver multi_;
+    ConsoleOutput out_;
+    Client console_;
+    std::vector<std::unique_ptr<Client>> serials_;   // one per open port
+    bool quitting_ = false;
+    std::set<Conversation*> busy_;                        // turn in flight
+    std::map<Conversation*, std::deque<Queued>> queued_;  // typed meanwhile
+};
+
+ConsoleRepl* ConsoleRepl::instance_ = nullptr;
+
+std::string ConsoleRepl::prompt() const {
+    // \001..\002 tell readline the colour codes take no width
+    if (console_.int_mode) return "\001\033[38;2;228;217;111m\002-> \001\033[0m\002";
+    // Model of the selected conversation; its name too once there is more than one
+    auto conv = conversations::ConsoleCurrent();
+    std::string label = conv->model();
+    if (conversations::List().size() > 1) label += " [" + conv->name() + "]";
+    return "\001\033[38;2;255;239;184m\002" + label + "> \001\033[0m\002";
+}
+
+void ConsoleRepl::lineHandler(char* input) { instance_->onLine(input); }
+
+void ConsoleRepl::onLine(char* input) {
+    out_.setPromptActive(false);
+    if (!input) {
+        std::cout << "\n";
+        quitting_ = true;
+        rl_callback_handler_remove();
+        loop_.stop();
+        return;
+    }
+    if (*input) {
+        add_history(input);
+        write_history(history_.c_str());
+    }
+    std::string command(input);
+    free(input);
+
+    dispatch(console_, command);
+    if (quitting_) {
+        rl_callback_handler_remove(); // no fresh prompt after QUIT
+        return;
+    }
+
+    rl_set_prompt(prompt().c_str());
+    out_.setPromptActive(true);
+}
+
+ConversationPtr ConsoleRepl::convOf(const Client& c) const {
+    return c.serial ? c.conv : conversations::ConsoleCurrent();
+}
+
+void ConsoleRepl::reply(Client& c, const std::string& line) {
+    c.status(line);
+}
+
+void ConsoleRepl::dispatch(Client& c, std::string command, const SerialRequestPtr& req) {
+    if (c.int_mode) {
+        if (command == "/bye") {
+            c.int_mode = false;
+            reply(c, "[Returning to main prompt]");
+        } else if (!command.empty()) {
+            chat(c, command, req);
+        }
+        return;
+    }
+
+    std::string cmd_upper = command;
+    std::transform(cmd_upper.begin(), cmd_upper.end(), cmd_upper.begin(), ::toupper);
+
+    if (cmd_upper == "QUIT") {
+        if (c.serial) {
+            reply(c, "[QUIT is only available on the console]");
+            return;
+        }
+        std::cout << "[See Ya!!]\n";
+        quitting_ = true;
+        loop_.stop();
+        return;
+    }
+    if (cmd_upper == "INT") {
+        c.int_mode = true;
+        reply(c, "\033[94m[Interactive Mode]\033[0m Type your messages. Type /bye to exit.");
+        return;
+    }
+    // ASK <question> streams on the loop; bare ASK still prompts via processCommand
+    if (cmd_upper.rfind("ASK ", 0) == 0) {
+        chat(c, command.substr(4), req);
+        return;
+    }
+
+    // The picker and the question prompt read the console's stdin
+    if (c.serial && (cmd_upper == "READ" || cmd_upper == "ASK")) {
+        reply(c, cmd_upper == "ASK" ? "Usage: ASK <question>"
+                                    : "Usage: READ_CTX:<context>|FILE:<path>");
+        return;
+    }
+    // If READ entered with no args → interactive picker
+    if (cmd_upper == "READ") {
+        std::string context;
+        std::cout << "Enter context: ";
+        std::getline(std::cin, context);
+
+        std::string filename = pickFile("code");
+        if (filename.empty()) return;
+
+        command = "READ_CTX:" + context + "|FILE:" + filename;
+        cmd_upper = "READ_CTX:";   // handled as the READ_CTX command just built
+    }
+    // File context and RAG questions are chat turns, so they stream on the loop too
+    if (cmd_upper.rfind("READ_CTX:", 0) == 0) {
+        std::string context, filename, message, error;
+        if (!parseReadCtx(command, context, filename)) error = "Usage: READ_CTX:<context>|FILE:<path>";
+        else fileContextMessage(context, filename, message, error);
+        if (!error.empty()) {
+            reply(c, "[Error] " + error);
+            if (req) req->ok = false;
+            return;
+        }
+        chat(c, message, req, Route::Chat);
+        return;
+    }
+    if (cmd_upper == "RAG_ASK" || cmd_upper.rfind("RAG_ASK ", 0) == 0) {
+        std::string q = command.substr(7);
+        q.erase(0, q.find_first_not_of(" \t"));
+        if (q.empty()) {
+            reply(c, "Usage: RAG_ASK <question>");
+            if (req) req->ok = false;
+            return;
+        }
+        chat(c, q, req, Route::Rag);
+        return;
+    }
+
+    if (c.serial) {
+        // CANCEL stops this terminal's answer, not the console's or another terminal's
+        if (cmd_upper == "CANCEL") {
+            if (c.active) c.active->token.cancel();
+            reply(c, c.active ? "[Cancel requested]" : "[Nothing to cancel]");
+            return;
+        }
+        // Everything the command prints goes back over the port
+        SerialCout cout_to_serial(c.write);
+        StreamSinkScope sinks(c.write, c.status);
+        serial_ports::Scope port(c.port);
+        cancel::Scope cs(req->token);
+        auto prev = c.active;
+        c.active = req;
+        Json::Value result = processCommand(command, config_, c.conv);
+        req->ok = result["status"].asString() != "error";
+        c.active = prev;
+        c.status("");
+        return;
+    }
+
+    processCommand(command, config_, convOf(c));
+}
+
+// RAG first (if the conversation has an active session), else plain chat; route
+// narrows that to one of the two. One turn per conversation at a time; later
+// messages wait their turn.
+void ConsoleRepl::chat(Client& c, const std::string& text, const SerialRequestPtr& req, Route route,
+                       Clock::time_point submitted) {
+    auto conv = convOf(c);
+    ++c.pending;
+    if (req) req->async = true;
+    if (busy_.count(conv.get())) {
+        queued_[conv.get()].push_back(Queued{&c, text, req, route, submitted});
+        reply(c, "\033[38;5;208m[Queued until the current answer finishes]\033[0m");
+        return;
+    }
+    busy_.insert(conv.get());
+    if (req) {
+        req->started = Clock::now();
+        c.active = req;
+        submitted = req->received;
+    }
+    // Requests this turn issues count their queue time from here
+    perf_stats::QueuedSince since(submitted);
+
+    std::string sid = conv->ragSession();
+    if (route == Route::Rag && sid.empty()) {
+        reply(c, "No active RAG session. Run RAG_INGEST <folder> or RAG_SESSION SET <sid>.");
+        turnDone(c, conv, req, false);
+        return;
+    }
+    if (route == Route::Chat || (route == Route::Auto && (!rag_int::Enabled() || sid.empty()))) {
+        startChat(c, conv, text, req);
+        return;
+    }
+
+    // The RAG pipeline runs on its executor; tokens and the result come back via post()
+    ConversationSettings cs = conv->settings();
+    auto streamed = std::make_shared<std::atomic<bool>>(false);
+    Client* cp = &c;
+    AIMaster_RAG_AskAsync(sid, text,
+        [this, cp, conv, text, req, route, streamed, submitted](const RAGAnswer& a) {
+            loop_.post([this, cp, conv, text, req, route, streamed, submitted, a] {
+                // Nothing retrieved (or no such session): nothing was generated or
+                // streamed, so plain chat answers instead
+                bool cancelled = a.error == "Cancelled";
+                if (route == Route::Auto && !a.has_context && !cancelled) {
+                    perf_stats::QueuedSince since(submitted);
+                    startChat(*cp, conv, text, req);
+                    return;
+                }
+                if (!a.ok()) {
+                    cp->status(cancelled ? "[Cancelled]" : "[Error] " + a.error);
+                    turnDone(*cp, conv, req, false);
+                    return;
+                }
+                if (!*streamed) cp->write(a.answer);
+                cp->status("");
+                turnDone(*cp, conv, req, true);
+            });
+        },
+        cs.rag_k, cs.rag_threshold,
+        [this, cp, streamed](const std::string& t) {
+            *streamed = true;
+            loop_.post([cp, t] { cp->write(t); });
+        },
+        RAGRetrieval{cs.rag_mode, cs.rag_filter}, req ? &req->token : nullptr);
+}
+
+void ConsoleRepl::startChat(Client& c, const ConversationPtr& conv, const std::string& text,
+                            const SerialRequestPtr& req) {
+    // The turn keeps these sinks and the token for its whole life
+    StreamSinkScope sinks(c.write, c.status);
+    std::optional<cancel::Scope> cs;
+    if (req) cs.emplace(req->token);
+    Client* cp = &c;
+    bool started = sendMessageAsync(text, conv, config_, multi_,
+                                    [this, cp, conv, req](bool ok, const std::string&) {
+                                        turnDone(*cp, conv, req, ok);
+                                    });
+    if (!started) {
+        reply(c, "[Error] Could not start the request.");
+        turnDone(c, conv, req, false);
+    }
+}
+
+void ConsoleRepl::turnDone(Client& c, const ConversationPtr& conv, const SerialRequestPtr& req, bool ok) {
+    busy_.erase(conv.get());
+    --c.pending;
+    if (req) finishSerialRequest(c, req, ok);
+    if (c.serial && c.pending == 0) serialPrompt(c);
+
+    auto it = queued_.find(conv.get());
+    if (it == queued_.end() || it->second.empty()) return;
+    Queued next = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty()) queued_.erase(it);
+    --next.client->pending;   // chat() counts it again
+    chat(*next.client, next.text, next.req, next.route, next.at);
+}
+
+// Per-request latency of the serial front-end, reported by STATS as [serial]
+void ConsoleRepl::finishSerialRequest(Client& c, const SerialRequestPtr& req, bool ok) {
+    if (c.active == req) c.active = nullptr;
+    RequestTiming t;
+    t.kind = "serial:" + c.port->name();
+    t.model = c.conv ? c.conv->model() : "";
+    t.ok = ok && !req->token.cancelled();
+    t.queue_ms = std::chrono::duration<double, std::milli>(req->started - req->received).count();
+    t.ttft_ms = req->first_output_ms;
+    t.total_ms = msSince(req->received);
+    perf_stats::Record(t);
+}
+
+void ConsoleRepl::serialPrompt(Client& c) {
+    c.port->send(c.int_mode ? "-> " : c.conv->model() + "> ");
+}
+
+// Each serial terminal is a client with its own conversation, named after the port
+void ConsoleRepl::addSerialClient(const SerialPortPtr& port) {
+    serials_.push_back(std::make_unique<Client>());
+    Client& c = *serials_.back();
+    c.serial = true;
+    c.port = port;
+    c.line = SerialLineDiscipline(port->echo(), port->options().text.crlf);
+    c.conv = conversations::Create(port->name(), conversations::DefaultModel());
+    Client* cp = &c;
+    c.write = [cp](const std::string& t) {
+        if (cp->active && cp->active->first_output_ms < 0)
+            cp->active->first_output_ms = msSince(cp->active->received);
+        cp->port->sendText(t);
+    };
+    c.status = [cp](const std::string& l) {
+        if (!l.empty()) cp->port->sendText(l);
+        cp->port->endText();
+    };
+    loop_.watchFd(port->fd(), EPOLLIN, [this, cp](uint32_t) { onSerialInput(*cp); });
+    serialPrompt(c);
+}
+
+// Bytes from a terminal go through its line discipline; whole lines are
+// run like console input and answered over the same port
+void ConsoleRepl::onSerialInput(Client& c) {
+    c.line.setEcho(c.port->echo());
+    SerialLineDiscipline::Input in = c.line.feed(c.port->readAvailable());
+    if (!in.echo.empty()) c.port->send(in.echo);
+    if (in.interrupt && c.active) c.active->token.cancel();
+
+    for (const auto& line : in.lines) {
+        if (line.empty()) {
+            if (c.pending == 0) serialPrompt(c);
+            continue;
+        }
+        out_.line("[" + c.port->name() + "] " + line);
+        auto req = std::make_shared<SerialRequest>();
+        dispatch(c, line, req);
+        if (!req->async) finishSerialRequest(c, req, req->ok);
+        if (c.pending == 0) serialPrompt(c);
+    }
+}
+
+int ConsoleRepl::run() {
+    instance_ = this;
+    // Streamed tokens and status lines from chat turns land above the prompt
+    console_.write = [this](const std::string& t) { out_.stream(t); };
+    console_.status = [this](const std::string& l) { out_.line(l); };
+    StreamSinkScope sink(console_.write, console_.status);
+
+    rl_catch_signals = 0; // Ctrl-C stays with cancel::InstallSigintHandler
+    rl_callback_handler_install(prompt().c_str(), lineHandler);
+    out_.setPromptActive(true);
+
+    loop_.watchFd(STDIN_FILENO, EPOLLIN, [](uint32_t) { rl_callback_read_char(); });
+    // Every open serial port is serviced from this same loop
+    for (const auto& port : serial_ports::List())
+        if (port->fd() >= 0) addSerialClient(port);
+    auto primary = serial_ports::Primary();
+    out_.setSerialMirror(std::none_of(serials_.begin(), serials_.end(),
+                                      [&](const std::unique_ptr<Client>& c) { return c->port == primary; }));
+
+    // Report background ingest jobs as they finish
+    loop_.addPeriodic(500, [this] {
+        for (const auto& n : rag_jobs::TakeNotices()) out_.line(n);
+    });
+
+    loop_.run();
+
+    out_.setPromptActive(false);
+    rl_callback_handler_remove();
+    // Stop in-flight work before the loop it reports to goes away
+    cancel::RequestAll();
+    rag_executor::Shutdown();
+    instance_ = nullptr;
+    return 0;
+}
+
+} // namespace
+
+int runConsoleRepl(AppConfig& config, const std::string& historyFile) {
+    ConsoleRepl repl(config, historyFile);
+    return repl.run();
+}
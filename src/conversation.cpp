@@ -0,0 +1,150 @@
+#include "conversation.h"
+#include <algorithm>
+
+Conversation::Conversation(int id, const std::string& name, const std::string& model)
+    : id_(id), name_(name), model_(model) {}
+
+std::string Conversation::model() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return model_;
+}
+
+void Conversation::setModel(const std::string& model) {
+    std::lock_guard<std::mutex> L(mtx_);
+    model_ = model;
+}
+
+std::string Conversation::ragSession() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return rag_session_;
+}
+
+void Conversation::setRagSession(const std::string& session_id) {
+    std::lock_guard<std::mutex> L(mtx_);
+    rag_session_ = session_id;
+}
+
+ConversationSettings Conversation::settings() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return settings_;
+}
+
+void Conversation::setSettings(const ConversationSettings& s) {
+    std::lock_guard<std::mutex> L(mtx_);
+    settings_ = s;
+}
+
+std::vector<Json::Value> Conversation::history() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return history_;
+}
+
+void Conversation::appendHistory(const Json::Value& msg) {
+    std::lock_guard<std::mutex> L(mtx_);
+    history_.push_back(msg);
+}
+
+void Conversation::popHistory() {
+    std::lock_guard<std::mutex> L(mtx_);
+    if (!history_.empty()) history_.pop_back();
+}
+
+void Conversation::clearHistory() {
+    std::lock_guard<std::mutex> L(mtx_);
+    history_.clear();
+}
+
+size_t Conversation::historySize() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return history_.size();
+}
+
+namespace conversations {
+
+static std::mutex g_mtx;
+static std::vector<ConversationPtr> g_convs;   // ordered by id
+static ConversationPtr g_console;
+static std::string g_default_model;
+static int g_next_id = 1;
+static thread_local ConversationPtr t_bound;
+
+// Caller holds g_mtx
+static ConversationPtr create_locked(const std::string& name, const std::string& model) {
+    int id = g_next_id++;
+    auto conv = std::make_shared<Conversation>(id, name.empty() ? "conv" + std::to_string(id) : name, model);
+    g_convs.push_back(conv);
+    return conv;
+}
+
+static ConversationPtr console_locked() {
+    if (!g_console) {
+        if (g_convs.empty()) create_locked("main", g_default_model);
+        g_console = g_convs.front();
+    }
+    return g_console;
+}
+
+static ConversationPtr find_locked(const std::string& key) {
+    for (auto& c : g_convs) if (c->name() == key) return c;
+    int id = 0;
+    try { id = std::stoi(key); } catch (...) { return nullptr; }
+    for (auto& c : g_convs) if (c->id() == id) return c;
+    return nullptr;
+}
+
+void SetDefaultModel(const std::string& model) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    g_default_model = model;
+}
+
+std::string DefaultModel() {
+    std::lock_guard<std::mutex> L(g_mtx);
+    return g_default_model;
+}
+
+ConversationPtr Create(const std::string& name, const std::string& model) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    console_locked(); // keep #1 as the console default
+    return create_locked(name, model);
+}
+
+ConversationPtr Find(const std::string& id_or_name) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    return find_locked(id_or_name);
+}
+
+std::vector<ConversationPtr> List() {
+    std::lock_guard<std::mutex> L(g_mtx);
+    console_locked();
+    return g_convs;
+}
+
+bool Close(const std::string& id_or_name, std::string& error) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    auto conv = find_locked(id_or_name);
+    if (!conv) { error = "No such conversation: " + id_or_name; return false; }
+    if (conv->id() == 1) { error = "Conversation #1 cannot be closed"; return false; }
+    g_convs.erase(std::remove(g_convs.begin(), g_convs.end(), conv), g_convs.end());
+    if (g_console == conv) g_console = g_convs.front();
+    return true;
+}
+
+ConversationPtr Current() {
+    if (t_bound) return t_bound;
+    return ConsoleCurrent();
+}
+
+void SetConsoleCurrent(const ConversationPtr& conv) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    if (conv) g_console = conv;
+}
+
+ConversationPtr ConsoleCurrent() {
+    std::lock_guard<std::mutex> L(g_mtx);
+    return console_locked();
+}
+
+Scope::Scope(ConversationPtr conv) : prev_(t_bound) { t_bound = std::move(conv); }
+Scope::~Scope() { t_bound = std::move(prev_); }
+
+} // namespace conversations
@@ -0,0 +1,92 @@
+#include "curl_multi.h"
+#include <sys/epoll.h>
+#include <vector>
+
+CurlMultiDriver::CurlMultiDriver(EventLoop& loop) : loop_(loop), multi_(curl_multi_init()) {
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, socketCallback);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, timerCallback);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+}
+
+CurlMultiDriver::~CurlMultiDriver() {
+    for (auto& t : transfers_) curl_multi_remove_handle(multi_, t.first);
+    if (curl_timer_) loop_.cancelTimer(curl_timer_);
+    if (cancel_timer_) loop_.cancelTimer(cancel_timer_);
+    curl_multi_cleanup(multi_);
+}
+
+void CurlMultiDriver::add(CURL* easy, Done done, cancel::Token* token) {
+    transfers_[easy] = Transfer{std::move(done), token};
+    if (token) cancel::ApplyToCurl(easy, token);
+    // Progress callbacks only run while data flows; poll tokens for idle streams
+    if (!cancel_timer_) cancel_timer_ = loop_.addPeriodic(100, [this]{ checkCancelled(); });
+    curl_multi_add_handle(multi_, easy);
+}
+
+int CurlMultiDriver::socketCallback(CURL*, curl_socket_t s, int what, void* userp, void*) {
+    auto* self = static_cast<CurlMultiDriver*>(userp);
+    if (what == CURL_POLL_REMOVE) {
+        self->loop_.unwatchFd(s);
+        return 0;
+    }
+    uint32_t events = 0;
+    if (what & CURL_POLL_IN) events |= EPOLLIN;
+    if (what & CURL_POLL_OUT) events |= EPOLLOUT;
+    self->loop_.watchFd(s, events, [self, s](uint32_t ev) {
+        int flags = 0;
+        if (ev & EPOLLIN) flags |= CURL_CSELECT_IN;
+        if (ev & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+        if (ev & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+        self->action(s, flags);
+    });
+    return 0;
+}
+
+int CurlMultiDriver::timerCallback(CURLM*, long timeout_ms, void* userp) {
+    auto* self = static_cast<CurlMultiDriver*>(userp);
+    if (self->curl_timer_) self->loop_.cancelTimer(self->curl_timer_);
+    self->curl_timer_ = 0;
+    if (timeout_ms < 0) return 0;
+    self->curl_timer_ = self->loop_.addTimer((uint64_t)timeout_ms, [self] {
+        self->curl_timer_ = 0;
+        self->action(CURL_SOCKET_TIMEOUT, 0);
+    });
+    return 0;
+}
+
+void CurlMultiDriver::action(curl_socket_t s, int flags) {
+    int running = 0;
+    curl_multi_socket_action(multi_, s, flags, &running);
+    finishTransfers();
+}
+
+void CurlMultiDriver::finishTransfers() {
+    int left = 0;
+    CURLMsg* msg;
+    std::vector<std::pair<CURL*, CURLcode>> done;
+    while ((msg = curl_multi_info_read(multi_, &left))) {
+        if (msg->msg == CURLMSG_DONE) done.emplace_back(msg->easy_handle, msg->data.result);
+    }
+    for (auto& d : done) complete(d.first, d.second);
+}
+
+void CurlMultiDriver::complete(CURL* easy, CURLcode result) {
+    auto it = transfers_.find(easy);
+    if (it == transfers_.end()) return;
+    Done cb = std::move(it->second.done);
+    transfers_.erase(it);
+    curl_multi_remove_handle(multi_, easy);
+    if (transfers_.empty() && cancel_timer_) {
+        loop_.cancelTimer(cancel_timer_);
+        cancel_timer_ = 0;
+    }
+    if (cb) cb(result);
+}
+
+void CurlMultiDriver::checkCancelled() {
+    std::vector<CURL*> aborted;
+    for (auto& t : transfers_)
+        if (t.second.token && t.second.token->cancelled()) aborted.push_back(t.first);
+    for (CURL* easy : aborted) complete(easy, CURLE_ABORTED_BY_CALLBACK);
+}
@@ -0,0 +1,530 @@
+#include "daemon.h"
+#include "ollama_client.h"
+#include "conversation.h"
+#include "stream_sink.h"
+#include "rag_adapter.hpp"
+#include "rag_jobs.hpp"
+#include "perf_stats.h"
+#include "cancel.h"
+#include "thread_pool.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMaxRequestBytes = 8 * 1024 * 1024;
+
+int g_wake_fd = -1;                        // eventfd poked by the signal handler
+std::atomic<bool> g_stop{false};
+
+void onStopSignal(int) {
+    g_stop = true;
+    uint64_t one = 1;
+    if (g_wake_fd >= 0) (void)!write(g_wake_fd, &one, sizeof(one));
+}
+
+void setNonBlocking(int fd, bool on) {
+    int fl = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, on ? (fl | O_NONBLOCK) : (fl & ~O_NONBLOCK));
+}
+
+std::string toJsonLine(const Json::Value& v) {
+    Json::StreamWriterBuilder w;
+    w["indentation"] = "";
+    return Json::writeString(w, v) + "\n";
+}
+
+// One client connection. Owned by the event loop while armed in epoll and by
+// exactly one worker while a request runs (EPOLLONESHOT hands it over).
+struct Conn {
+    int fd = -1;
+    bool http = false;
+    std::string in;
+};
+
+// Writes one response: NDJSON lines on the Unix socket, or an HTTP/1.1
+// response (chunked NDJSON once something has been streamed).
+class Reply {
+public:
+    Reply(int fd, bool http) : fd_(fd), http_(http) {}
+
+    // Streamed line; false once the client has gone away.
+    bool line(const Json::Value& v) {
+        if (failed_) return false;
+        std::string body = toJsonLine(v);
+        if (!http_) return send(body);
+        if (!headers_) {
+            headers_ = true;
+            if (!send("HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\n"
+                      "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n")) return false;
+        }
+        std::ostringstream chunk;
+        chunk << std::hex << body.size() << "\r\n" << body << "\r\n";
+        return send(chunk.str());
+    }
+
+    void finish(Json::Value v, int status = 200) {
+        v["done"] = true;
+        std::string body = toJsonLine(v);
+        if (!http_) { send(body); return; }
+        if (headers_) {
+            line(v);
+            send("0\r\n\r\n");
+            return;
+        }
+        std::ostringstream o;
+        o << "HTTP/1.1 " << status << (status == 200 ? " OK" : status == 404 ? " Not Found" : " Bad Request") << "\r\n"
+          << "Content-Type: application/json\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n"
+          << body;
+        send(o.str());
+    }
+
+    bool failed() const { return failed_; }
+
+private:
+    bool send(const std::string& s) {
+        size_t off = 0;
+        while (off < s.size()) {
+            ssize_t n = ::send(fd_, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) { failed_ = true; return false; }
+            off += (size_t)n;
+        }
+        return true;
+    }
+
+    int fd_;
+    bool http_;
+    bool headers_ = false;
+    bool failed_ = false;
+};
+
+class Daemon {
+public:
+    explicit Daemon(AppConfig& config) : config_(config) {}
+    int run();
+
+private:
+    bool listenUnix();
+    bool listenHttp();
+    void accept(int lfd, bool http);
+    void onReadable(Conn* c);
+    bool takeRequest(Conn* c, Json::Value& req, int& status, std::string& error);
+    void serve(Conn* c, Json::Value req, int status, std::string error,
+               std::chrono::steady_clock::time_point queued);
+    void execute(const Json::Value& req, Reply& out);
+    void rearm(Conn* c);
+    void close(Conn* c);
+    ConversationPtr conversationFor(const Json::Value& req);
+    void runCommand(const std::string& cmd, const ConversationPtr& conv, Reply& out);
+
+    AppConfig& config_;
+    int ep_ = -1, unix_fd_ = -1, http_fd_ = -1;
+    std::mutex live_mtx_;
+    std::set<Conn*> live_;
+    std::unique_ptr<ThreadPool> workers_;   // run client requests (they block on Ollama)
+};
+
+bool Daemon::listenUnix() {
+    const std::string& path = config_.daemon_socket;
+    if (path.empty()) return true;
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "[Daemon] Socket path too long: " << path << "\n";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // Replace a stale socket, but never steal one a running daemon still serves
+    struct stat st{};
+    if (stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool alive = probe >= 0 && connect(probe, (sockaddr*)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) ::close(probe);
+        if (alive) {
+            std::cerr << "[Daemon] Another daemon is listening on " << path << "\n";
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    unix_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (unix_fd_ < 0 || bind(unix_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(unix_fd_, 128) < 0) {
+        std::cerr << "[Daemon] Cannot listen on " << path << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    chmod(path.c_str(), 0600);
+    return true;
+}
+
+bool Daemon::listenHttp() {
+    if (config_.daemon_http_port <= 0) return true;
+    http_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int yes = 1;
+    setsockopt(http_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)config_.daemon_http_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local clients only
+    if (http_fd_ < 0 || bind(http_fd_, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(http_fd_, 128) < 0) {
+        std::cerr << "[Daemon] Cannot listen on 127.0.0.1:" << config_.daemon_http_port
+                  << ": " << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+void Daemon::accept(int lfd, bool http) {
+    for (;;) {
+        int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return; // EAGAIN: drained
+        if (http) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // tokens go out as they come
+        }
+        Conn* c = new Conn;
+        c->fd = fd;
+        c->http = http;
+        { std::lock_guard<std::mutex> L(live_mtx_); live_.insert(c); }
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = c;
+        epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+void Daemon::close(Conn* c) {
+    epoll_ctl(ep_, EPOLL_CTL_DEL, c->fd, nullptr);
+    ::close(c->fd);
+    { std::lock_guard<std::mutex> L(live_mtx_); live_.erase(c); }
+    delete c;
+}
+
+void Daemon::rearm(Conn* c) {
+    setNonBlocking(c->fd, true);
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = c;
+    epoll_ctl(ep_, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Extracts one complete request from c->in. Returns false if more bytes are
+// needed; on a malformed request returns true with status/error set.
+bool Daemon::takeRequest(Conn* c, Json::Value& req, int& status, std::string& error) {
+    status = 200;
+    std::string body;
+    if (!c->http) {
+        size_t nl = c->in.find('\n');
+        if (nl == std::string::npos) return false;
+        body = c->in.substr(0, nl);
+        c->in.erase(0, nl + 1);
+    } else {
+        size_t end = c->in.find("\r\n\r\n");
+        if (end == std::string::npos) return false;
+        std::istringstream head(c->in.substr(0, end));
+        std::string method, path, line;
+        head >> method >> path;
+        size_t length = 0;
+        while (std::getline(head, line)) {
+            std::string lower = line;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            if (lower.rfind("content-length:", 0) == 0) {
+                try { length = std::stoul(line.substr(15)); } catch (...) {}
+            }
+        }
+        if (c->in.size() < end + 4 + length) return false;
+        body = c->in.substr(end + 4, length);
+        c->in.erase(0, end + 4 + length);
+
+        path = path.substr(0, path.find('?'));
+        if (path.rfind("/v1/", 0) == 0) path = path.substr(4);
+        else if (!path.empty() && path[0] == '/') path = path.substr(1);
+        req["op"] = path;
+        if (method != "GET" && method != "POST") {
+            status = 400;
+            error = "Unsupported method: " + method;
+            return true;
+        }
+    }
+
+    if (body.find_first_not_of(" \t\r\n") == std::string::npos) return true;
+    Json::CharReaderBuilder b;
+    Json::Value parsed;
+    std::string errs;
+    std::istringstream iss(body);
+    if (!Json::parseFromStream(b, iss, &parsed, &errs) || !parsed.isObject()) {
+        status = 400;
+        error = "Bad JSON: " + errs;
+        return true;
+    }
+    std::string op = req.get("op", "").asString();
+    req = parsed;
+    if (!op.empty()) req["op"] = op; // HTTP path wins over the body
+    return true;
+}
+
+void Daemon::onReadable(Conn* c) {
+    char buf[16384];
+    bool eof = false;
+    for (;;) {
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n > 0) { c->in.append(buf, (size_t)n); continue; }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        eof = true; // still answer a complete request sent before a half-close
+        break;
+    }
+    if (c->in.size() > kMaxRequestBytes) {
+        setNonBlocking(c->fd, false);
+        Reply(c->fd, c->http).finish(Json::Value(Json::objectValue), 400);
+        close(c);
+        return;
+    }
+
+    Json::Value req;
+    int status;
+    std::string error;
+    if (!takeRequest(c, req, status, error)) {
+        if (eof) close(c);
+        else rearm(c);
+        return;
+    }
+    auto queued = std::chrono::steady_clock::now();
+    workers_->post([this, c, req, status, error, queued]{ serve(c, req, status, error, queued); });
+}
+
+void Daemon::serve(Conn* c, Json::Value req, int status, std::string error,
+                   std::chrono::steady_clock::time_point queued) {
+    if (g_stop) { close(c); return; } // queued behind the shutdown
+    setNonBlocking(c->fd, false);
+    for (;;) {
+        Reply out(c->fd, c->http);
+        if (!error.empty()) {
+            Json::Value r;
+            r["status"] = "error";
+            r["error"] = error;
+            out.finish(r, status);
+        } else {
+            perf_stats::QueuedSince since(queued);   // waited for a worker
+            execute(req, out);
+        }
+        // HTTP is one request per connection; the socket protocol keeps going
+        if (c->http || out.failed()) { close(c); return; }
+        req = Json::Value();
+        error.clear();
+        if (!takeRequest(c, req, status, error)) break; // nothing else pipelined
+        queued = std::chrono::steady_clock::now();
+    }
+    rearm(c);
+}
+
+ConversationPtr Daemon::conversationFor(const Json::Value& req) {
+    std::string name = req.get("conversation", "").asString();
+    ConversationPtr conv;
+    if (name.empty()) {
+        conv = std::make_shared<Conversation>(0, "request", conversations::DefaultModel());
+    } else {
+        conv = conversations::Find(name);
+        if (!conv) conv = conversations::Create(name, conversations::DefaultModel());
+    }
+    if (req.isMember("session")) conv->setRagSession(req["session"].asString());
+    if (req.isMember("model")) conv->setModel(req["model"].asString());
+    return conv;
+}
+
+// Console commands a client may run through op "command": they only read state
+// or change the request's own conversation. Anything that touches global state
+// (CANCEL, MODEL <m>, SERIAL, DIAG, RAG_INGEST, CONV NEW/USE/CLOSE, STATS RESET)
+// or reads the console's stdin (INT, READ, bare ASK, QUIT) is refused.
+static bool clientCommand(const std::string& upper) {
+    static const std::set<std::string> allowed = {
+        "HELP", "WHO", "RESET", "RAG_ASK", "RAG_SHOW", "RAG_MODE", "RAG_FILTER",
+        "RAG_SESSION", "RAG_JOBS", "RAG_STATUS"};
+    std::istringstream words(upper);
+    std::string word, arg;
+    words >> word >> arg;
+    if (word == "ASK") return !arg.empty();
+    if (word == "MODEL" || word == "STATS") return arg.empty();
+    if (word == "CONV") return arg == "SET";
+    return allowed.count(word) > 0;
+}
+
+void Daemon::runCommand(const std::string& cmd, const ConversationPtr& conv, Reply& out) {
+    Json::Value r = processCommand(cmd, config_, conv);
+    out.finish(r);
+}
+
+void Daemon::execute(const Json::Value& req, Reply& out) {
+    const std::string op = req.get("op", "").asString();
+    const bool stream = req.get("stream", false).asBool();
+
+    // A client that hangs up mid-answer cancels its generation
+    cancel::Token token(/*background=*/true);
+    cancel::Scope cancelScope(token);
+    StreamSinkScope sink([&](const std::string& t) {
+        if (!stream) return;
+        Json::Value v;
+        v["token"] = t;
+        if (!out.line(v)) token.cancel();
+    });
+
+    Json::Value r;
+    if (op == "ping") {
+        r["status"] = "success";
+        r["pid"] = (Json::Int64)getpid();
+        out.finish(r);
+    } else if (op == "ask") {
+        std::string q = req.get("q", "").asString();
+        if (q.empty()) { r["error"] = "missing q"; out.finish(r, 400); return; }
+        runCommand("ASK " + q, conversationFor(req), out);
+    } else if (op == "rag_ask") {
+        auto conv = conversationFor(req);
+        std::string q = req.get("q", "").asString();
+        ConversationSettings cs = conv->settings();
+        RAGTokenCallback onToken = [&](const std::string& t) { streamSinkWrite(t); };
+        RAGAnswer a = AIMaster_RAG_AskDetailed(conv->ragSession(), q, req.get("k", cs.rag_k).asInt(),
+                                               req.get("threshold", cs.rag_threshold).asDouble(), onToken,
+                                               {cs.rag_mode, req.get("filter", cs.rag_filter).asString()});
+        r["status"] = a.ok() ? "success" : "error";
+        r["session"] = a.session_id;
+        r["answer"] = a.answer;
+        if (!a.ok()) r["error"] = a.error;
+        r["hits"] = Json::arrayValue;
+        for (const auto& h : a.hits) {
+            Json::Value hv;
+            hv["id"] = h.chunk_id;
+            hv["score"] = h.score;
+            r["hits"].append(hv);
+        }
+        Json::Value t;
+        t["embed_ms"] = a.embed_ms; t["search_ms"] = a.search_ms;
+        t["generate_ms"] = a.generate_ms; t["total_ms"] = a.total_ms;
+        r["timings"] = t;
+        out.finish(r, a.ok() ? 200 : 400);
+    } else if (op == "rag_ingest") {
+        runCommand("RAG_INGEST " + req.get("folder", "").asString(), conversationFor(req), out);
+    } else if (op == "rag_status") {
+        std::string job = req.isMember("job") ? " " + req["job"].asString() : "";
+        runCommand("RAG_STATUS" + job, conversationFor(req), out);
+    } else if (op == "command") {
+        std::string cmd = req.get("cmd", "").asString();
+        std::string upper = cmd;
+        std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+        if (!clientCommand(upper)) {
+            r["status"] = "error";
+            r["error"] = "Command not available in daemon mode: " + cmd;
+            out.finish(r, 400);
+            return;
+        }
+        runCommand(cmd, conversationFor(req), out);
+    } else if (op == "conversations") {
+        r["status"] = "success";
+        r["conversations"] = Json::arrayValue;
+        for (const auto& c : conversations::List()) {
+            Json::Value j;
+            j["id"] = c->id();
+            j["name"] = c->name();
+            j["model"] = c->model();
+            j["messages"] = (Json::UInt64)c->historySize();
+            j["rag_session"] = c->ragSession();
+            r["conversations"].append(j);
+        }
+        out.finish(r);
+    } else if (op == "stats") {
+        r["status"] = "success";
+        r["summary"] = perf_stats::Summary();
+        out.finish(r);
+    } else {
+        r["status"] = "error";
+        r["error"] = "Unknown op: " + op;
+        out.finish(r, 404);
+    }
+}
+
+int Daemon::run() {
+    ep_ = epoll_create1(EPOLL_CLOEXEC);
+    g_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ep_ < 0 || g_wake_fd < 0 || !listenUnix() || !listenHttp()) return 1;
+
+    struct sigaction sa{};
+    sa.sa_handler = onStopSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Listeners and the wake fd are told apart by data.fd; clients carry a Conn*
+    static int tagUnix, tagHttp, tagWake;
+    auto add = [&](int fd, void* tag) {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = tag;
+        epoll_ctl(ep_, EPOLL_CTL_ADD, fd, &ev);
+    };
+    if (unix_fd_ >= 0) add(unix_fd_, &tagUnix);
+    if (http_fd_ >= 0) add(http_fd_, &tagHttp);
+    add(g_wake_fd, &tagWake);
+
+    workers_.reset(new ThreadPool(std::max(1, config_.daemon_workers)));
+    std::cout << "[Daemon] Serving";
+    if (unix_fd_ >= 0) std::cout << " unix:" << config_.daemon_socket;
+    if (http_fd_ >= 0) std::cout << " http://127.0.0.1:" << config_.daemon_http_port;
+    std::cout << " with " << config_.daemon_workers << " workers (model " << conversations::DefaultModel() << ")"
+              << std::endl;
+
+    epoll_event events[64];
+    while (!g_stop) {
+        int n = epoll_wait(ep_, events, 64, -1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        for (int i = 0; i < n; ++i) {
+            void* p = events[i].data.ptr;
+            if (p == &tagWake) continue;
+            if (p == &tagUnix) { accept(unix_fd_, false); continue; }
+            if (p == &tagHttp) { accept(http_fd_, true); continue; }
+            onReadable(static_cast<Conn*>(p));
+        }
+    }
+
+    std::cout << "[Daemon] Shutting down" << std::endl;
+    if (unix_fd_ >= 0) { ::close(unix_fd_); unlink(config_.daemon_socket.c_str()); }
+    if (http_fd_ >= 0) ::close(http_fd_);
+    cancel::RequestAll();
+    rag_jobs::Shutdown();
+    workers_->stop();
+    {
+        std::lock_guard<std::mutex> L(live_mtx_);
+        for (Conn* c : live_) { ::close(c->fd); delete c; }
+        live_.clear();
+    }
+    ::close(ep_);
+    ::close(g_wake_fd);
+    g_wake_fd = -1;
+    return 0;
+}
+
+} // namespace
+
+int runDaemon(AppConfig& config) {
+    Daemon d(config);
+    return d.run();
+}
@@ -0,0 +1,145 @@
+#include "event_loop.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+static uint64_t nowMs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+EventLoop::EventLoop() : wheel_(kSlots) {
+    ep_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    start_ms_ = nowMs();
+    watchFd(wake_fd_, EPOLLIN, [this](uint32_t) {
+        uint64_t n;
+        while (read(wake_fd_, &n, sizeof(n)) > 0) {}
+    });
+}
+
+EventLoop::~EventLoop() {
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (ep_ >= 0) close(ep_);
+}
+
+void EventLoop::watchFd(int fd, uint32_t events, FdCallback cb) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = fd;
+    bool known = fds_.count(fd) > 0;
+    fds_[fd] = std::move(cb);
+    epoll_ctl(ep_, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+}
+
+void EventLoop::unwatchFd(int fd) {
+    if (fds_.erase(fd)) epoll_ctl(ep_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::schedule(Timer t, uint64_t delay_ticks) {
+    if (delay_ticks == 0) delay_ticks = 1;
+    t.rounds = (delay_ticks - 1) / kSlots;
+    wheel_[(current_tick_ + delay_ticks) % kSlots].push_back(std::move(t));
+    ++timer_count_;
+}
+
+EventLoop::TimerId EventLoop::addTimer(uint64_t delay_ms, std::function<void()> cb) {
+    TimerId id = next_timer_++;
+    schedule(Timer{id, 0, 0, std::move(cb)}, (delay_ms + kTickMs - 1) / kTickMs);
+    return id;
+}
+
+EventLoop::TimerId EventLoop::addPeriodic(uint64_t interval_ms, std::function<void()> cb) {
+    TimerId id = next_timer_++;
+    uint64_t ticks = std::max<uint64_t>(1, (interval_ms + kTickMs - 1) / kTickMs);
+    schedule(Timer{id, 0, ticks, std::move(cb)}, ticks);
+    return id;
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+    cancelled_.push_back(id);
+}
+
+// Fires every slot the clock has passed since the last call
+void EventLoop::advanceTimers() {
+    uint64_t target = (nowMs() - start_ms_) / kTickMs;
+    while (current_tick_ < target) {
+        ++current_tick_;
+        auto& slot = wheel_[current_tick_ % kSlots];
+        if (slot.empty()) continue;
+        std::vector<Timer> due;
+        for (size_t i = 0; i < slot.size();) {
+            if (slot[i].rounds > 0) { --slot[i].rounds; ++i; continue; }
+            due.push_back(std::move(slot[i]));
+            slot[i] = std::move(slot.back());
+            slot.pop_back();
+            --timer_count_;
+        }
+        for (auto& t : due) {
+            auto c = std::find(cancelled_.begin(), cancelled_.end(), t.id);
+            if (c != cancelled_.end()) { cancelled_.erase(c); continue; }
+            t.cb();
+            // A periodic timer may cancel itself from its own callback
+            c = std::find(cancelled_.begin(), cancelled_.end(), t.id);
+            if (c != cancelled_.end()) cancelled_.erase(c);
+            else if (t.interval_ticks) {
+                uint64_t interval = t.interval_ticks;
+                schedule(std::move(t), interval);
+            }
+        }
+    }
+}
+
+int EventLoop::nextTimeoutMs() const {
+    if (timer_count_ == 0) return -1;
+    // Sleep until the first occupied slot (it may only hold later rounds)
+    uint64_t d = 1;
+    while (d < kSlots && wheel_[(current_tick_ + d) % kSlots].empty()) ++d;
+    uint64_t elapsed = nowMs() - start_ms_;
+    uint64_t next = (current_tick_ + d) * kTickMs;
+    return next > elapsed ? (int)(next - elapsed) : 0;
+}
+
+void EventLoop::post(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> L(post_mtx_);
+        posted_.push_back(std::move(fn));
+    }
+    uint64_t one = 1;
+    (void)!write(wake_fd_, &one, sizeof(one));
+}
+
+void EventLoop::runPosted() {
+    std::vector<std::function<void()>> batch;
+    {
+        std::lock_guard<std::mutex> L(post_mtx_);
+        batch.swap(posted_);
+    }
+    for (auto& fn : batch) fn();
+}
+
+void EventLoop::run() {
+    running_ = true;
+    epoll_event events[64];
+    while (running_) {
+        int n = epoll_wait(ep_, events, 64, nextTimeoutMs());
+        if (n < 0 && errno != EINTR) break;
+        for (int i = 0; i < n && running_; ++i) {
+            auto it = fds_.find(events[i].data.fd);
+            if (it == fds_.end()) continue;
+            FdCallback cb = it->second; // the callback may unwatch its own fd
+            cb(events[i].events);
+        }
+        runPosted();
+        advanceTimers();
+    }
+}
+
+void EventLoop::stop() {
+    running_ = false;
+    uint64_t one = 1;
+    (void)!write(wake_fd_, &one, sizeof(one));
+}
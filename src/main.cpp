@@ -15,6 +15,12 @@
 #include "rag_adapter.hpp"
 #include "rag_state.hpp"
 #include "rag_int_bridge.hpp"
+#include "perf_stats.h"
+#include "cancel.h"
+#include "rag_jobs.hpp"
+#include "conversation.h"
+#include "daemon.h"
+#include "console_repl.h"
 
 namespace fs = std::filesystem;
 static const char* HISTORY_FILE = "~/.ollama_cli_history";
@@ -161,12 +167,38 @@ char** custom_completion(const char* text, int start, int end) {
     return nullptr;
 }
 
-int main() {
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--daemon [--socket PATH] [--http-port N] [--workers N]]\n";
+}
+
+int main(int argc, char** argv) {
     AppConfig config;
     if (!loadConfig("config.txt", config)) {
         std::cerr << "Error loading config.txt" << std::endl;
         return 1;
     }
+
+    // Command line overrides the daemon_* config keys
+    bool daemon = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (a == "--daemon") daemon = true;
+        else if (a == "--socket" && hasValue) config.daemon_socket = argv[++i];
+        else if (a == "--http-port" && hasValue) config.daemon_http_port = std::atoi(argv[++i]);
+        else if (a == "--workers" && hasValue) config.daemon_workers = std::atoi(argv[++i]);
+        else { usage(argv[0]); return 2; }
+    }
+
+    perf_stats::SetExportPath(config.stats_file);
+    conversations::SetDefaultModel(config.ollama_model);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    if (daemon) return runDaemon(config);
+
+    // Ctrl-C cancels the running request instead of killing the session
+    cancel::InstallSigintHandler();
+
     // Ping Ollama server with 2s timeout (non-fatal)
     {
         long http_code = 0;
@@ -178,7 +210,7 @@ int main() {
     }
 
 
-    if (!initSerial(config.serial_port, config.baudrate)) {
+    if (serial_ports::OpenAll(config) == 0) {
         std::cerr << "Warning: No serial port available. Using console mode." << std::endl;
     }
 
@@ -191,39 +223,13 @@ int main() {
 
     std::cout << "\033[38;2;255;215;0mOllama CLI\033[0m\n\033[38;2;255;239;184mType HELP for a list of commands.\033[0m\n";
 
-    while (true) {
-        std::string prompt = "\033[38;2;255;239;184m" + config.ollama_model + "> \033[0m";
-        char* input = readline(prompt.c_str());
-        if (!input) break;
-
-        if (*input) {
-            add_history(input);
-            write_history(histFile.c_str());
-        }
-
-        std::string command(input);
-        free(input);
-
-        std::string cmd_upper = command;
-        std::transform(cmd_upper.begin(), cmd_upper.end(), cmd_upper.begin(), ::toupper);
-
-        // If READ entered with no args → interactive picker
-        if (cmd_upper == "READ") {
-            std::string context;
-            std::cout << "Enter context: ";
-            std::getline(std::cin, context);
-
-            std::string filename = pickFile("code");
-            if (filename.empty()) continue;
-
-            command = "READ_CTX:" + context + "|FILE:" + filename;
-        }
-
-        Json::Value result = processCommand(command, config);
-    }
+    // Console, chat streaming, serial input and job notices share one event loop
+    runConsoleRepl(config, histFile);
 
     // Save history on exit
     write_history(histFile.c_str());
+    rag_jobs::Shutdown();
+    closeSerial();   // lets queued serial output drain
 
     return 0;
 }
@@ -9,6 +9,17 @@
 #include "serial_handler.h"
 #include "rag_console_commands.hpp"
 #include "rag_int_bridge.hpp"
+#include "perf_stats.h"
+#include "rag_trace.hpp"
+#include "ollama_stream.hpp"
+#include "stream_sink.h"
+#include "cancel.h"
+#include "rag_jobs.hpp"
+#include "conversation.h"
+#include "curl_multi.h"
+#include <atomic>
+#include <optional>
+#include <mutex>
 
 
 
@@ -42,7 +53,7 @@ static bool oc_check_ollama_connectivity(const std::string& chat_url, long timeo
     curl_easy_cleanup(curl);
     return ok;
 }
-static bool g_oc_ping_done = false;
+static std::atomic<bool> g_oc_ping_done{false};
 
 // ---- MODEL listing helpers (Ollama tags) ----
 static size_t ocurl_write_to_string(void* contents, size_t size, size_t nmemb, void* userp) {
@@ -107,10 +118,13 @@ struct StreamData {
     std::string raw_output;
     std::chrono::high_resolution_clock::time_point start_time;
     bool first_chunk_received = false;
+    RequestTimer* timer = nullptr;
+    OllamaStreamParser parser;
+    StreamSinks sinks;      // the requester's sinks; async turns stream from the event loop
 };
 
 
-static bool diagMode = false; // Diagnostic dump mode
+static std::atomic<bool> diagMode{false}; // Diagnostic dump mode
 
 // ---- Save Code Blocks ----
 namespace {
@@ -160,7 +174,7 @@ namespace {
             if (outFile.is_open()) {
                 outFile << codeBlock;
                 outFile.close();
-                std::cout << "[Saved code block to " << oss.str() << "]\n";
+                streamSinkStatus("[Saved code block to " + oss.str() + "]");
             }
 
             blockCount++;
@@ -187,34 +201,14 @@ static size_t StreamCallback(void* contents, size_t size, size_t nmemb, void* us
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::high_resolution_clock::now() - data->start_time
         ).count();    
-        std::cerr << "\033[31m[Response: " << elapsed << " ms]\033[0m" << std::endl;
+        std::string line = "\033[31m[Response: " + std::to_string(elapsed) + " ms]\033[0m";
+        if (data->sinks.status) data->sinks.status(line);
+        else streamSinkStatus(line);
         }
     data->raw_output += chunk;
 
-    Json::CharReaderBuilder reader;
-    Json::Value parsed;
-    std::string errs;
-    std::istringstream ss(chunk);
-
-    if (Json::parseFromStream(reader, ss, &parsed, &errs)) {
-        if (parsed.isObject() &&
-            parsed.isMember("message") &&
-            parsed["message"].isObject() &&
-            parsed["message"].isMember("content")) {
-
-            std::string text = parsed["message"]["content"].asString();
-            std::cout << "\033[32m" << text << "\033[0m" << std::flush;  // Green output
-
-            if (!serial_available) {
-                std::ofstream log("log.txt", std::ios::app);
-                if (log.is_open()) {
-                    log << text;
-                    log.flush();
-                }
-            }
-            data->collected += text;
-        }
-    }
+    // NDJSON lines may be split across (or packed into) curl writes
+    data->parser.feed(chunk.data(), chunk.size());
     return totalSize;
 }
 
@@ -228,56 +222,117 @@ static void setCurlStreamingOptions(CURL* curl, struct curl_slist*& headers) {
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
 }
 
-// ---- Send message to Ollama ----
-static bool sendMessageToOllama(const std::string& query,
-                                std::vector<Json::Value>& chatHistory,
-                                const AppConfig& config) {
+// ---- One chat turn, shared by the blocking and the event-loop paths ----
+struct ChatTurn {
+    explicit ChatTurn(Conversation& c) : conv(c) {}
+    ~ChatTurn() {
+        if (headers) curl_slist_free_all(headers);
+        if (curl) curl_easy_cleanup(curl);
+    }
+
+    Conversation& conv;
+    ConversationPtr keepAlive;                   // async turns outlive the caller's frame
+    std::unique_lock<std::mutex> turnLock;       // one turn at a time per conversation
+    std::optional<RequestTimer> timer;
+    StreamData streamData;
+    std::string jsonPayload;
+    CURL* curl = nullptr;
+    struct curl_slist* headers = nullptr;
+    cancel::Token ownToken;
+    cancel::Token* token = nullptr;
+};
+
+// Records the user message and prepares the transfer. Caller holds turnLock.
+static bool beginChatTurn(ChatTurn& t, const std::string& query, const AppConfig& config) {
+    t.curl = curl_easy_init();
+    if (!t.curl) return false;
+
     Json::Value msg;
     msg["role"] = "user";
     msg["content"] = query;
-    chatHistory.push_back(msg);
-
-    CURL* curl = curl_easy_init();
-    if (!curl) return false;
-
-    StreamData streamData;
+    t.conv.appendHistory(msg);
+    const std::string model = t.conv.model();
+
+    t.timer.emplace("chat", model);
+    RequestTimer& timer = *t.timer;
+    StreamData& streamData = t.streamData;
+    streamData.timer = &timer;
+    streamData.sinks = streamSinkCurrent();
+    streamData.parser.on_content = [&streamData, &timer](const std::string& text) {
+        timer.token();
+        if (streamData.sinks.write) streamData.sinks.write(text);
+        else streamSinkWrite(text);
+        streamData.collected += text;
+    };
+    // Final chunk carries Ollama's own prompt/eval counters
+    streamData.parser.on_done = [&timer](const nlohmann::json& j) {
+        RequestTiming& rt = timer.timing();
+        rt.prompt_eval_count = j.value("prompt_eval_count", -1LL);
+        rt.prompt_eval_duration_ns = j.value("prompt_eval_duration", -1LL);
+        rt.eval_count = j.value("eval_count", -1LL);
+        rt.eval_duration_ns = j.value("eval_duration", -1LL);
+    };
     Json::Value payload;
-    payload["model"] = config.ollama_model;
+    payload["model"] = model;
     payload["messages"] = Json::arrayValue;
-    for (auto& m : chatHistory) payload["messages"].append(m);
+    for (auto& m : t.conv.history()) payload["messages"].append(m);
     payload["stream"] = true;
 
     Json::StreamWriterBuilder wbuilder;
-    std::string jsonPayload = Json::writeString(wbuilder, payload);
+    t.jsonPayload = Json::writeString(wbuilder, payload);
 
     if (diagMode) {
         std::cerr << "\n[DIAG URL] " << config.ollama_url << "\n";
-        std::cerr << "[DIAG PAYLOAD] " << jsonPayload << "\n";
+        std::cerr << "[DIAG PAYLOAD] " << t.jsonPayload << "\n";
     }
 
-    std::cout << "\033[38;5;208m[Thinking..]\033[0m" << std::endl;
+    streamSinkStatus("\033[38;5;208m[Thinking..]\033[0m");
 
-    curl_easy_setopt(curl, CURLOPT_URL, config.ollama_url.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonPayload.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &streamData);
+    curl_easy_setopt(t.curl, CURLOPT_URL, config.ollama_url.c_str());
+    curl_easy_setopt(t.curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(t.curl, CURLOPT_POSTFIELDS, t.jsonPayload.c_str());
+    curl_easy_setopt(t.curl, CURLOPT_WRITEDATA, &streamData);
 
-    struct curl_slist* headers = NULL;
     streamData.start_time = std::chrono::high_resolution_clock::now();
     streamData.first_chunk_received = false;
-    setCurlStreamingOptions(curl, headers);
+    setCurlStreamingOptions(t.curl, t.headers);
+
+    // Ctrl-C / CANCEL aborts the transfer; dropping the connection frees the server slot.
+    // A caller-bound token (daemon client) takes precedence.
+    t.token = cancel::Current();
+    if (!t.token) t.token = &t.ownToken;
+    cancel::ApplyToCurl(t.curl, t.token);
+    return true;
+}
 
-    CURLcode res = curl_easy_perform(curl);
-    curl_slist_free_all(headers);
-    curl_easy_cleanup(curl);
+// Records the reply (or rolls back the user message) once the transfer ended.
+static bool endChatTurn(ChatTurn& t, CURLcode res, std::string* replyOut) {
+    StreamData& streamData = t.streamData;
+    streamData.parser.finish();
+    t.timer->finish(t.curl, res == CURLE_OK);
 
-    std::cout << std::endl;
+    streamSinkStatus(""); // end the streamed line
+    if (replyOut) *replyOut = streamData.collected;
+
+    if (res == CURLE_ABORTED_BY_CALLBACK) {
+        streamSinkStatus("\033[38;5;208m[Cancelled]\033[0m");
+        // Keep the partial reply so the history stays user/assistant paired
+        if (streamData.collected.empty()) {
+            t.conv.popHistory();
+        } else {
+            Json::Value reply;
+            reply["role"] = "assistant";
+            reply["content"] = streamData.collected;
+            t.conv.appendHistory(reply);
+        }
+        return false;
+    }
 
     if (res == CURLE_OK && !streamData.collected.empty()) {
         Json::Value reply;
         reply["role"] = "assistant";
         reply["content"] = streamData.collected;
-        chatHistory.push_back(reply);
+        t.conv.appendHistory(reply);
 
         saveCodeBlocks(streamData.collected);
         return true;
@@ -286,15 +341,93 @@ static bool sendMessageToOllama(const std::string& query,
     return false;
 }
 
+// ---- Send message to Ollama ----
+static bool sendMessageToOllama(const std::string& query,
+                                Conversation& conv,
+                                const AppConfig& config,
+                                std::string* replyOut = nullptr) {
+    ChatTurn turn(conv);
+    turn.turnLock = std::unique_lock<std::mutex>(conv.turnMutex());
+    if (!beginChatTurn(turn, query, config)) return false;
+
+    turn.timer->started();
+    CURLcode res = curl_easy_perform(turn.curl);
+    return endChatTurn(turn, res, replyOut);
+}
+
+bool sendMessageAsync(const std::string& query,
+                      const ConversationPtr& conv,
+                      const AppConfig& config,
+                      CurlMultiDriver& multi,
+                      std::function<void(bool ok, const std::string& reply)> done) {
+    auto turn = std::make_shared<ChatTurn>(*conv);
+    turn->keepAlive = conv;
+    turn->turnLock = std::unique_lock<std::mutex>(conv->turnMutex(), std::try_to_lock);
+    if (!turn->turnLock.owns_lock() || !beginChatTurn(*turn, query, config)) return false;
+
+    turn->timer->started();
+    multi.add(turn->curl, [turn, done](CURLcode res) {
+        StreamSinkScope sinks(turn->streamData.sinks.write, turn->streamData.sinks.status);
+        std::string reply;
+        bool ok = endChatTurn(*turn, res, &reply);
+        turn->turnLock.unlock(); // done may start the next turn right away
+        if (done) done(ok, reply);
+    }, turn->token);
+    return true;
+}
+
+// ---- READ / READ_CTX ----
+bool parseReadCtx(const std::string& command, std::string& context, std::string& filename) {
+    size_t ctxPos = command.find(':');
+    size_t filePos = command.find("|FILE:");
+    if (ctxPos == std::string::npos || filePos == std::string::npos || filePos < ctxPos) return false;
+    context = command.substr(ctxPos + 1, filePos - ctxPos - 1);
+    filename = command.substr(filePos + 6);
+    return true;
+}
+
+bool fileContextMessage(const std::string& context, const std::string& filename,
+                        std::string& message, std::string& error) {
+    if (!std::filesystem::exists(filename)) {
+        error = "File does not exist: " + filename;
+        return false;
+    }
+    if (std::filesystem::is_empty(filename)) {
+        error = "File is empty: " + filename;
+        return false;
+    }
+
+    std::ifstream inFile(filename);
+    std::stringstream buffer;
+    buffer << inFile.rdbuf();
+    message =
+        "Context: " + context +
+        "\n\nFile contents:\n" + buffer.str() +
+        "\n\nInstruction: Please read and store this content for later reference in our ongoing conversation. "
+        "Acknowledge once you have absorbed it.";
+    return true;
+}
+
+// ---- Conversation display helper ----
+static std::string convLabel(const Conversation& c) {
+    return "#" + std::to_string(c.id()) + " " + c.name();
+}
+
 // ---- Process Command ----
 Json::Value processCommand(const std::string& command, AppConfig& config) {
+    return processCommand(command, config, conversations::Current());
+}
+
+Json::Value processCommand(const std::string& command, AppConfig& config, const ConversationPtr& convPtr) {
+    // RAG commands and rag_state resolve against this conversation
+    conversations::Scope convScope(convPtr);
+    Conversation& conv = *convPtr;
     Json::Value ragOut;
 if (HandleRAGConsoleCommand(command, ragOut)) {
     return ragOut; // handled RAG_INGEST / RAG_ASK / RAG_SESSION
 }
 // One-time Ollama connectivity status on first command
-    if (!g_oc_ping_done) {
-        g_oc_ping_done = true;
+    if (!g_oc_ping_done.exchange(true)) {
         long http_code = 0;
         bool ok = oc_check_ollama_connectivity(config.ollama_url, config.ollama_timeout_seconds, &http_code);
         if (!ok) {
@@ -305,7 +438,6 @@ if (HandleRAGConsoleCommand(command, ragOut)) {
         }
     }
 
-    static std::vector<Json::Value> chatHistory;
     Json::Value result;
 
     std::string cmd_upper = command;
@@ -321,15 +453,25 @@ if (cmd_upper == "ASK" || cmd_upper.rfind("ASK ", 0) == 0) {
         query = command.substr(4);
     }
 
-    // Try RAG first (if active)
+    // Try RAG first (if active); the answer streams through the same sinks as chat
     std::string rag_answer;
-    if (rag_int::TryRAGAnswer(query, rag_answer, /*k=*/5, /*threshold=*/0.2)) {
-        std::cout << rag_answer << "\n";
+    bool streamed = false;
+    auto sink = [&streamed](const std::string& t) { streamed = true; streamSinkWrite(t); };
+    ConversationSettings cs = conv.settings();
+    if (rag_int::TryRAGAnswer(query, rag_answer, cs.rag_k, cs.rag_threshold, sink,
+                              {cs.rag_mode, cs.rag_filter})) {
+        if (!streamed) streamSinkWrite(rag_answer);
+        streamSinkStatus(""); // end the streamed line
         result["status"] = "success";
+        result["source"] = "rag";
+        result["answer"] = rag_answer;
     } else {
         // Fall back to normal LLM
-        sendMessageToOllama(query, chatHistory, config);
-        result["status"] = "success";
+        std::string reply;
+        bool ok = sendMessageToOllama(query, conv, config, &reply);
+        result["status"] = ok ? "success" : "error";
+        result["source"] = "chat";
+        result["answer"] = reply;
     }
 }
 
@@ -338,6 +480,7 @@ else if (cmd_upper == "INT") {
     std::cout << "\033[94m[Interactive Mode]\033[0m Type your messages. Type /bye to exit.\n";
     std::string line;
     while (true) {
+        for (const auto& n : rag_jobs::TakeNotices()) std::cout << n << "\n";
         std::cout << "\033[38;2;228;217;111m-> ";
         if (!std::getline(std::cin, line)) break;
         if (line == "/bye") {
@@ -347,13 +490,18 @@ else if (cmd_upper == "INT") {
         //std::cerr << "[RAG_INT] trying..." << std::endl;
         // Try RAG first (if active and enabled)
         std::string rag_answer;
-        if (rag_int::TryRAGAnswer(line, rag_answer, /*k=*/5, /*threshold=*/0.2)) {
-            std::cout << rag_answer << "\n";
+        bool streamed = false;
+        auto sink = [&streamed](const std::string& t) { streamed = true; streamSinkWrite(t); };
+        ConversationSettings cs = conv.settings();
+        if (rag_int::TryRAGAnswer(line, rag_answer, cs.rag_k, cs.rag_threshold, sink,
+                                  {cs.rag_mode, cs.rag_filter})) {
+            if (!streamed) streamSinkWrite(rag_answer);
+            streamSinkStatus("");
             continue; // handled via RAG
         }
 
         // Fall back to normal LLM
-        sendMessageToOllama(line, chatHistory, config);
+        sendMessageToOllama(line, conv, config);
     }
     result["status"] = "success";
 }
@@ -364,10 +512,11 @@ else if (cmd_upper == "INT") {
         std::string filename;
 
         if (cmd_upper.rfind("READ_CTX:", 0) == 0) {
-            size_t ctxPos = command.find(":") + 1;
-            size_t filePos = command.find("|FILE:");
-            context = command.substr(ctxPos, filePos - ctxPos);
-            filename = command.substr(filePos + 6);
+            if (!parseReadCtx(command, context, filename)) {
+                std::cout << "[Error] Usage: READ_CTX:<context>|FILE:<path>\n";
+                result["status"] = "error";
+                return result;
+            }
         } else {
             std::cout << "Enter context: ";
             std::getline(std::cin, context);
@@ -375,29 +524,13 @@ else if (cmd_upper == "INT") {
             std::getline(std::cin, filename);
         }
 
-        if (!std::filesystem::exists(filename)) {
-            std::cout << "[Error] File does not exist: " << filename << std::endl;
-            result["status"] = "error";
-            return result;
-        }
-        if (std::filesystem::is_empty(filename)) {
-            std::cout << "[Error] File is empty: " << filename << std::endl;
+        std::string fullMessage, error;
+        if (!fileContextMessage(context, filename, fullMessage, error)) {
+            std::cout << "[Error] " << error << std::endl;
             result["status"] = "error";
             return result;
         }
-
-        std::ifstream inFile(filename);
-        std::stringstream buffer;
-        buffer << inFile.rdbuf();
-        std::string fileContents = buffer.str();
-
-        std::string fullMessage =
-            "Context: " + context +
-            "\n\nFile contents:\n" + fileContents +
-            "\n\nInstruction: Please read and store this content for later reference in our ongoing conversation. "
-            "Acknowledge once you have absorbed it.";
-
-        sendMessageToOllama(fullMessage, chatHistory, config);
+        sendMessageToOllama(fullMessage, conv, config);
         result["status"] = "success";
     }
 
@@ -406,14 +539,18 @@ else if (cmd_upper == "INT") {
         result["status"] = "success";
         result["serial_port"] = config.serial_port;
         result["baudrate"] = config.baudrate;
+        result["serial_flow_control"] = config.serial_flow_control;
         result["ollama_url"] = config.ollama_url;
-        result["ollama_model"] = config.ollama_model;
+        result["ollama_model"] = conv.model();
         result["ollama_timeout_seconds"] = config.ollama_timeout_seconds;
+        result["conversation"] = convLabel(conv);
         std::cout << "\nCurrent configuration:\n";
         std::cout << "  Serial port: " << config.serial_port << "\n";
         std::cout << "  Baudrate: " << config.baudrate << "\n";
+        std::cout << "  Flow control: " << config.serial_flow_control << "\n";
         std::cout << "  Ollama URL: " << config.ollama_url << "\n";
-        std::cout << "  Model: " << config.ollama_model << "\n";
+        std::cout << "  Model: " << conv.model() << "\n";
+        std::cout << "  Conversation: " << convLabel(conv) << "\n";
         std::cout << "  Ollama timeout (s): " << config.ollama_timeout_seconds << "\n";
     }
 
@@ -434,9 +571,18 @@ else if (cmd_upper == "INT") {
             cmds["WHO"] = "Show current configuration.";
             cmds["HELP"] = "List available commands.";
             cmds["MODELS"] = "List available Models.";
-            cmds["RAG_INGEST"] = "Ingest a folder into the RAG system.";
+            cmds["RAG_INGEST"] = "Ingest a folder into the RAG system (runs in the background).";
             cmds["RAG_SHOW"] = "Show the contents of the RAG ingestion.";
             cmds["RAG_SESSION"] = "Display the session information.";
+            cmds["RAG_JOBS"] = "List background ingest jobs.";
+            cmds["RAG_FILTER"] = "Restrict this conversation's RAG answers by ext=, dir=, pdf|code, pages=A-B; RAG_FILTER CLEAR.";
+            cmds["RAG_MODE"] = "Show or set this conversation's RAG retrieval: VECTOR (default), HYBRID or KEYWORD (BM25).";
+            cmds["RAG_STATUS"] = "Show progress, throughput and ETA of an ingest job.";
+            cmds["CANCEL"] = "Abort your in-flight answer; CANCEL <job> stops one ingest job, CANCEL ALL everything.";
+            cmds["DIAG"] = "Toggle diagnostics; DIAG TRACE ON|OFF|SAVE [file] for RAG tracing.";
+            cmds["STATS"] = "Show request latency percentiles (STATS RESET to clear).";
+            cmds["SERIAL"] = "Show each serial port's queue depth, throughput, drops and framing; SERIAL ECHO ON|OFF [port].";
+            cmds["CONV"] = "List conversations; CONV NEW [name] | USE <id|name> | CLOSE <id|name> | SET K|THRESHOLD <v>.";
         }
         result["commands"] = cmds;
         std::cout << "\nAvailable commands:\n";
@@ -474,7 +620,7 @@ else if (cmd_upper == "INT") {
             } else {
                 std::cout << "\nAvailable models:\n";
                 for (size_t i = 0; i < models.size(); ++i) {
-                    bool isCurrent = (models[i] == config.ollama_model);
+                    bool isCurrent = (models[i] == conv.model());
                     std::cout << "  [" << (i+1) << "] " << models[i];
                     if (isCurrent) std::cout << "  (current)";
                     std::cout << "\n";
@@ -506,23 +652,236 @@ else if (cmd_upper == "INT") {
             return result;
         }
 
+        // Applies to this conversation and becomes the default for new ones
+        static std::mutex configMtx; // daemon workers may run MODEL concurrently
+        std::lock_guard<std::mutex> configLock(configMtx);
+        conv.setModel(chosen);
         config.ollama_model = chosen;
+        conversations::SetDefaultModel(chosen);
         if (saveConfig("config.txt", config)) {
-            std::cout << "[OK] Model set to: " << config.ollama_model << " (saved)\n";
+            std::cout << "[OK] Model set to: " << chosen << " (saved)\n";
         } else {
-            std::cout << "[OK] Model set to: " << config.ollama_model << " (save failed)\n";
+            std::cout << "[OK] Model set to: " << chosen << " (save failed)\n";
         }
         result["status"] = "ok";
-        result["model"] = config.ollama_model;
+        result["model"] = chosen;
         return result;
     }
+// ===== CONV =====
+    else if (cmd_upper == "CONV" || cmd_upper.rfind("CONV ", 0) == 0) {
+        std::istringstream iss(command.size() > 5 ? command.substr(5) : "");
+        std::string sub, arg;
+        iss >> sub >> arg;
+        std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+        result["status"] = "success";
+
+        if (sub.empty() || sub == "LIST") {
+            auto current = conversations::ConsoleCurrent();
+            Json::Value list(Json::arrayValue);
+            std::cout << "\nConversations:\n";
+            for (const auto& c : conversations::List()) {
+                std::string sid = c->ragSession();
+                std::cout << "  " << (c == current ? "* " : "  ") << convLabel(*c)
+                          << "  model=" << c->model()
+                          << "  messages=" << c->historySize()
+                          << "  rag=" << (sid.empty() ? "-" : sid) << "\n";
+                Json::Value j;
+                j["id"] = c->id();
+                j["name"] = c->name();
+                j["model"] = c->model();
+                j["messages"] = (Json::UInt64)c->historySize();
+                j["rag_session"] = sid;
+                list.append(j);
+            }
+            result["conversations"] = list;
+        } else if (sub == "NEW") {
+            auto c = conversations::Create(arg, conv.model());
+            conversations::SetConsoleCurrent(c);
+            std::cout << "[Conversation " << convLabel(*c) << " created and selected]\n";
+            result["id"] = c->id();
+        } else if (sub == "USE") {
+            auto c = conversations::Find(arg);
+            if (!c) {
+                std::cout << "[Error] No such conversation: " << arg << "\n";
+                result["status"] = "error";
+            } else {
+                conversations::SetConsoleCurrent(c);
+                std::cout << "[Switched to conversation " << convLabel(*c) << "]\n";
+                result["id"] = c->id();
+            }
+        } else if (sub == "CLOSE") {
+            std::string err;
+            if (conversations::Close(arg.empty() ? std::to_string(conv.id()) : arg, err)) {
+                std::cout << "[Conversation closed; current is " << convLabel(*conversations::ConsoleCurrent()) << "]\n";
+            } else {
+                std::cout << "[Error] " << err << "\n";
+                result["status"] = "error";
+            }
+        } else if (sub == "SET") {
+            std::string value;
+            iss >> value;
+            std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
+            ConversationSettings cs = conv.settings();
+            try {
+                if (arg == "K") cs.rag_k = std::max(1, std::stoi(value));
+                else if (arg == "THRESHOLD") cs.rag_threshold = std::stod(value);
+                else throw std::invalid_argument(arg);
+                conv.setSettings(cs);
+                std::cout << "[" << convLabel(conv) << ": k=" << cs.rag_k << " threshold=" << cs.rag_threshold << "]\n";
+            } catch (...) {
+                std::cout << "[Error] Usage: CONV SET K <n> | CONV SET THRESHOLD <x>\n";
+                result["status"] = "error";
+            }
+        } else {
+            std::cout << "[Error] Usage: CONV [LIST|NEW [name]|USE <id|name>|CLOSE <id|name>|SET K|THRESHOLD <v>]\n";
+            result["status"] = "error";
+        }
+    }
+// ===== CANCEL =====
+    else if (cmd_upper == "CANCEL" || cmd_upper.rfind("CANCEL ", 0) == 0) {
+        std::string arg = cmd_upper.size() > 7 ? cmd_upper.substr(7) : "";
+        int job = 0;
+        try { job = arg.empty() ? 0 : std::stoi(arg); } catch (...) { job = -1; }
+        if (arg.empty()) {
+            // Only the caller's own work: the token bound for it (a serial or daemon
+            // request), else the console's foreground work, as Ctrl-C does
+            if (cancel::Token* t = cancel::Current()) t->cancel();
+            else cancel::RequestForeground();
+            std::cout << "[Cancel requested for in-flight generation]\n";
+            result["status"] = "success";
+        } else if (arg == "ALL") {
+            cancel::RequestAll();
+            std::cout << "[Cancel requested for all in-flight generation and ingest jobs]\n";
+            result["status"] = "success";
+        } else if (job > 0 && rag_jobs::Cancel(job)) {
+            std::cout << "[Cancel requested for ingest job #" << job << "]\n";
+            result["status"] = "success";
+        } else {
+            std::cout << "[Error] No such ingest job: " << arg << "\n";
+            result["status"] = "error";
+        }
+    }
+// ===== STATS =====
+    else if (cmd_upper == "STATS" || cmd_upper.rfind("STATS ", 0) == 0) {
+        std::string arg = cmd_upper.size() > 6 ? cmd_upper.substr(6) : "";
+        if (arg == "RESET") {
+            perf_stats::Reset();
+            std::cout << "[Stats cleared]\n";
+        } else {
+            std::cout << "\n" << perf_stats::Summary();
+        }
+        result["status"] = "success";
+        result["export"] = perf_stats::ExportPath();
+    }
+// ===== SERIAL =====
+    else if (cmd_upper.rfind("SERIAL ECHO ", 0) == 0) {
+        // SERIAL ECHO ON|OFF [port]: the named port, else the terminal that sent it, else all
+        std::istringstream args(command.substr(12));
+        std::string onoff, name;
+        args >> onoff >> name;
+        std::transform(onoff.begin(), onoff.end(), onoff.begin(), ::toupper);
+        std::vector<SerialPortPtr> ports;
+        if (!name.empty()) {
+            if (auto p = serial_ports::Find(name)) ports.push_back(p);
+        } else if (auto p = serial_ports::Current()) {
+            ports.push_back(p);
+        } else {
+            ports = serial_ports::List();
+        }
+        if ((onoff != "ON" && onoff != "OFF") || ports.empty()) {
+            std::cout << "Usage: SERIAL ECHO ON|OFF [port]\n";
+            result["status"] = "error";
+        } else {
+            for (auto& p : ports) {
+                p->setEcho(onoff == "ON");
+                std::cout << "[" << p->name() << " echo " << (onoff == "ON" ? "on" : "off") << "]\n";
+            }
+            result["status"] = "success";
+        }
+    }
+    else if (cmd_upper == "SERIAL") {
+        auto ports = serial_ports::List();
+        result["status"] = "success";
+        result["available"] = serial_available;
+        result["ports"] = Json::arrayValue;
+        if (ports.empty()) std::cout << "[Serial] No serial port attached.\n";
+        for (const auto& p : ports) {
+            SerialTxStats s = p->txStats();
+            Json::Value j;
+            j["port"] = p->path();
+            j["baudrate"] = p->baudrate();
+            j["flow_control"] = p->options().flow_control;
+            j["echo"] = p->echo();
+            j["queued"] = (Json::UInt64)s.queued;
+            j["capacity"] = (Json::UInt64)s.capacity;
+            j["peak_queued"] = (Json::UInt64)s.peak_queued;
+            j["bytes_sent"] = (Json::UInt64)s.bytes_sent;
+            j["writes"] = (Json::UInt64)s.writes;
+            j["bytes_dropped"] = (Json::UInt64)s.bytes_dropped;
+            j["chunks_dropped"] = (Json::UInt64)s.chunks_dropped;
+            j["write_stalls"] = (Json::UInt64)s.write_stalls;
+            j["write_errors"] = (Json::UInt64)s.write_errors;
+            j["bytes_per_sec"] = s.bytes_per_sec;
+            j["protocol"] = s.framed ? "framed" : "text";
+            if (s.framed) {
+                j["text_bytes"] = (Json::UInt64)s.text_bytes;
+                j["frames"] = (Json::UInt64)s.frames;
+                j["frames_resent"] = (Json::UInt64)s.frames_resent;
+                j["naks"] = (Json::UInt64)s.naks;
+                j["syncs"] = (Json::UInt64)s.syncs;
+            }
+            result["ports"].append(j);
+
+            std::cout << "\nSerial " << p->path() << " @ " << p->baudrate()
+                      << " (flow control: " << p->options().flow_control << ")\n";
+            std::cout << "  Queue: " << s.queued << " / " << s.capacity << " bytes (peak " << s.peak_queued << ")\n";
+            std::cout << "  Sent: " << s.bytes_sent << " bytes in " << s.writes << " writes, "
+                      << (long long)s.bytes_per_sec << " B/s (last 5 s)\n";
+            std::cout << "  Dropped: " << s.bytes_dropped << " bytes in " << s.chunks_dropped << " writes\n";
+            std::cout << "  Stalled writes: " << s.write_stalls << ", errors: " << s.write_errors << "\n";
+            std::cout << "  Echo: " << (p->echo() ? "on" : "off") << "\n";
+            if (s.framed) {
+                long long pct = s.text_bytes ? (long long)(100 * s.bytes_sent / s.text_bytes) : 0;
+                std::cout << "  Framed: " << s.frames << " frames, " << s.text_bytes << " text bytes as "
+                          << s.bytes_sent << " on the wire (" << pct << "%), " << s.frames_resent << " resent after " << s.naks << " NAKs, "
+                          << s.syncs << " syncs\n";
+            }
+        }
+    }
 // ===== DIAG =====
     else if (cmd_upper.rfind("DIAG", 0) == 0) {
-        std::string arg;
+        std::string arg, raw;   // raw keeps the case of file names
         if (command.size() > 4) {
-            arg = command.substr(5);
+            raw = arg = command.substr(5);
             std::transform(arg.begin(), arg.end(), arg.begin(), ::toupper);
         }
+        // DIAG TRACE [ON|OFF|CLEAR|SAVE [file]] - RAG stage tracing
+        if (arg.rfind("TRACE", 0) == 0) {
+            std::string sub = arg.size() > 6 ? arg.substr(6) : "";
+            if (sub == "ON") rag_trace::SetEnabled(true);
+            else if (sub == "OFF") rag_trace::SetEnabled(false);
+            else if (sub == "CLEAR") rag_trace::Clear();
+            else if (sub.rfind("SAVE", 0) == 0 && (sub.size() == 4 || std::isspace((unsigned char)sub[4]))) {
+                std::string path = raw.substr(6 + 4);   // what follows SAVE in sub, as typed
+                path.erase(0, path.find_first_not_of(" \t"));
+                if (path.empty()) path = "trace.json";
+                std::string err;
+                if (rag_trace::WriteChromeTrace(path, &err)) {
+                    std::cout << "[Trace: " << rag_trace::EventCount() << " events written to " << path << "]\n";
+                    result["trace_file"] = path;
+                } else {
+                    std::cout << "[Error] " << err << "\n";
+                    result["status"] = "error";
+                    return result;
+                }
+            } else if (sub.empty()) rag_trace::SetEnabled(!rag_trace::Enabled());
+            std::cout << "[RAG tracing " << (rag_trace::Enabled() ? "ON" : "OFF")
+                      << ", " << rag_trace::EventCount() << " events buffered]\n";
+            result["status"] = "success";
+            result["trace"] = rag_trace::Enabled();
+            return result;
+        }
+
         if (arg == "ON") diagMode = true;
         else if (arg == "OFF") diagMode = false;
         else if (arg.empty()) diagMode = !diagMode;
@@ -533,7 +892,7 @@ else if (cmd_upper == "INT") {
 
     // ===== RESET =====
     else if (cmd_upper == "RESET") {
-        chatHistory.clear();
+        conv.clearHistory();
         result["status"] = "success";
         result["message"] = "Chat history cleared.";
     }
@@ -541,6 +900,7 @@ else if (cmd_upper == "INT") {
     // ===== RESET =====
     else if (cmd_upper == "QUIT") {
         std::cout << "[See Ya!!]\n";
+        rag_jobs::Shutdown();
         exit(0);
     }
     // ===== Default =====
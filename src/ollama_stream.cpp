@@ -0,0 +1,88 @@
+#include "ollama_stream.hpp"
+#include <cctype>
+using json = nlohmann::json;
+
+// ---- OllamaStreamParser ----
+void OllamaStreamParser::feed(const char* data,size_t n){
+  buf_.append(data,n);
+  size_t start=0, nl;
+  while((nl=buf_.find('\n',start))!=std::string::npos){
+    if(nl>start) parse_line(buf_.substr(start,nl-start));
+    start=nl+1;
+  }
+  buf_.erase(0,start);
+}
+
+void OllamaStreamParser::finish(){
+  if(!buf_.empty()){ std::string rest; rest.swap(buf_); parse_line(rest); }
+}
+
+void OllamaStreamParser::parse_line(const std::string& line){
+  auto j=json::parse(line,nullptr,false);
+  if(!j.is_object()) return;
+  if(j.contains("error") && j["error"].is_string()) error_=j["error"].get<std::string>();
+  std::string text;
+  if(j.contains("message") && j["message"].is_object() && j["message"].contains("content") && j["message"]["content"].is_string())
+    text=j["message"]["content"].get<std::string>();
+  else if(j.contains("response") && j["response"].is_string())
+    text=j["response"].get<std::string>();
+  if(!text.empty() && on_content) on_content(text);
+  if(j.value("done",false)){ done_=true; if(on_done) on_done(j); }
+}
+
+// ---- ThinkFilter ----
+static const std::string kOpen="<think>", kClose="</think>";
+
+// Length of the longest suffix of s that is a proper prefix of tag
+static size_t partial_tag_suffix(const std::string& s,const std::string& tag){
+  size_t maxlen=std::min(s.size(),tag.size()-1);
+  for(size_t len=maxlen;len>0;--len) if(s.compare(s.size()-len,len,tag,0,len)==0) return len;
+  return 0;
+}
+
+std::string ThinkFilter::emit(const std::string& text){
+  std::string t=text;
+  if(!started_){
+    size_t i=0; while(i<t.size() && std::isspace((unsigned char)t[i])) ++i;
+    t.erase(0,i);
+    if(t.empty()) return {};
+  }
+  t=ws_+t; ws_.clear();
+  size_t end=t.size(); while(end>0 && std::isspace((unsigned char)t[end-1])) --end;
+  ws_=t.substr(end); t.resize(end);
+  if(!t.empty()) started_=true;
+  return t;
+}
+
+std::string ThinkFilter::push(const std::string& piece){
+  pending_+=piece;
+  std::string out;
+  while(!pending_.empty()){
+    if(!in_think_){
+      size_t a=pending_.find(kOpen), b=pending_.find(kClose);
+      if(a!=std::string::npos && (b==std::string::npos || a<b)){
+        out+=emit(pending_.substr(0,a)); pending_.erase(0,a+kOpen.size()); in_think_=true; continue;
+      }
+      if(b!=std::string::npos){ // stray closing tag
+        out+=emit(pending_.substr(0,b)); pending_.erase(0,b+kClose.size()); continue;
+      }
+      size_t hold=std::max(partial_tag_suffix(pending_,kOpen),partial_tag_suffix(pending_,kClose));
+      out+=emit(pending_.substr(0,pending_.size()-hold)); pending_.erase(0,pending_.size()-hold);
+      break;
+    }else{
+      size_t b=pending_.find(kClose);
+      if(b!=std::string::npos){ pending_.erase(0,b+kClose.size()); in_think_=false; continue; }
+      size_t hold=partial_tag_suffix(pending_,kClose);
+      pending_.erase(0,pending_.size()-hold);
+      break;
+    }
+  }
+  return out;
+}
+
+std::string ThinkFilter::flush(){
+  std::string out;
+  if(!in_think_) out=emit(pending_);
+  pending_.clear(); ws_.clear();
+  return out;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#include <functional>
+#include "json.hpp"
+
+// Incremental parser for Ollama's NDJSON streaming responses (/api/chat and
+// /api/generate). Bytes can be fed in arbitrary pieces as curl delivers them;
+// objects split across writes are buffered until their newline arrives.
+class OllamaStreamParser{
+public:
+  std::function<void(const std::string&)> on_content;   // message.content / response fragments
+  std::function<void(const nlohmann::json&)> on_done;   // final object ("done": true)
+
+  void feed(const char* data,size_t n);
+  void finish();                                        // parse a trailing object without newline
+  bool done() const{ return done_; }
+  const std::string& error() const{ return error_; }    // "error" field reported by the server
+
+private:
+  std::string buf_;
+  bool done_=false;
+  std::string error_;
+  void parse_line(const std::string& line);
+};
+
+// Strips <think>...</think> spans from a token stream as it arrives. Text that
+// could be the start of a tag is held back until the next piece decides it.
+// Leading and trailing whitespace of the whole answer is dropped, matching
+// the trimming done on non-streamed answers.
+class ThinkFilter{
+public:
+  std::string push(const std::string& piece);
+  std::string flush();
+
+private:
+  std::string pending_;    // undecided bytes (possible partial tag)
+  std::string ws_;         // held-back whitespace run
+  bool in_think_=false;
+  bool started_=false;     // emitted any non-whitespace yet
+  std::string emit(const std::string& text);
+};
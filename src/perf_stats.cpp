@@ -0,0 +1,202 @@
+#include "perf_stats.h"
+#include "json.hpp"
+#include <mutex>
+#include <map>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cmath>
+
+using json = nlohmann::json;
+
+static constexpr size_t kWindow = 512; // samples kept per request kind
+
+static thread_local bool t_has_queued = false;   // set by perf_stats::QueuedSince
+static thread_local std::chrono::steady_clock::time_point t_queued;
+
+static double ms_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+    return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+double RequestTiming::tokensPerSecond() const {
+    if (eval_count > 0 && eval_duration_ns > 0)
+        return (double)eval_count * 1e9 / (double)eval_duration_ns;
+    if (inter_token_ms.empty()) return -1;
+    double span = 0;
+    for (double d : inter_token_ms) span += d;
+    if (span <= 0) return -1;
+    return (double)inter_token_ms.size() * 1000.0 / span;
+}
+
+// ---- RequestTimer ----
+RequestTimer::RequestTimer(const std::string& kind, const std::string& model) {
+    t_.kind = kind;
+    t_.model = model;
+    created_ = perf_stats::QueuedSince::current();
+}
+
+void RequestTimer::started() {
+    started_ = clock::now();
+    has_started_ = true;
+    t_.queue_ms = ms_between(created_, started_);
+}
+
+void RequestTimer::token() {
+    auto now = clock::now();
+    if (!has_token_) {
+        has_token_ = true;
+        t_.ttft_ms = ms_between(has_started_ ? started_ : created_, now);
+    } else {
+        t_.inter_token_ms.push_back(ms_between(last_token_, now));
+    }
+    last_token_ = now;
+}
+
+void RequestTimer::finish(CURL* curl, bool ok) {
+    if (finished_) return;
+    finished_ = true;
+    auto now = clock::now();
+    t_.ok = ok;
+    t_.total_ms = ms_between(has_started_ ? started_ : created_, now);
+    if (curl) {
+        curl_off_t us = 0;
+        if (curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &us) == CURLE_OK && us > 0)
+            t_.connect_ms = us / 1000.0;
+        if (curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &us) == CURLE_OK && us > 0)
+            t_.ttfb_ms = us / 1000.0;
+    }
+    perf_stats::Record(t_);
+}
+
+// ---- Rolling window + export ----
+namespace perf_stats {
+
+static std::mutex g_mtx;
+static std::map<std::string, std::deque<RequestTiming>> g_samples;
+static std::map<std::string, size_t> g_totals;
+static std::string g_export_path = "stats.jsonl";
+
+static json to_json(const RequestTiming& t) {
+    auto now = std::chrono::system_clock::now();
+    json j;
+    j["ts_ms"] = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+    j["kind"] = t.kind;
+    j["model"] = t.model;
+    j["ok"] = t.ok;
+    j["queue_ms"] = t.queue_ms;
+    j["connect_ms"] = t.connect_ms;
+    j["ttfb_ms"] = t.ttfb_ms;
+    j["ttft_ms"] = t.ttft_ms;
+    j["total_ms"] = t.total_ms;
+    j["tokens"] = t.inter_token_ms.empty() ? (t.ttft_ms >= 0 ? 1 : 0) : t.inter_token_ms.size() + 1;
+    j["inter_token_ms"] = t.inter_token_ms;
+    j["prompt_eval_count"] = t.prompt_eval_count;
+    j["prompt_eval_duration_ns"] = t.prompt_eval_duration_ns;
+    j["eval_count"] = t.eval_count;
+    j["eval_duration_ns"] = t.eval_duration_ns;
+    j["tokens_per_s"] = t.tokensPerSecond();
+    return j;
+}
+
+void Record(const RequestTiming& t) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    auto& q = g_samples[t.kind];
+    q.push_back(t);
+    if (q.size() > kWindow) q.pop_front();
+    g_totals[t.kind]++;
+
+    if (!g_export_path.empty()) {
+        std::ofstream out(g_export_path, std::ios::app);
+        if (out.is_open()) out << to_json(t).dump() << "\n";
+    }
+}
+
+void SetExportPath(const std::string& path) {
+    std::lock_guard<std::mutex> L(g_mtx);
+    g_export_path = path;
+}
+
+std::string ExportPath() {
+    std::lock_guard<std::mutex> L(g_mtx);
+    return g_export_path;
+}
+
+void Reset() {
+    std::lock_guard<std::mutex> L(g_mtx);
+    g_samples.clear();
+    g_totals.clear();
+}
+
+// Nearest-rank percentile over a sorted vector
+static double pct(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return -1;
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    if (rank == 0) rank = 1;
+    return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+static void print_row(std::ostringstream& o, const char* label, std::vector<double> v, const char* unit) {
+    v.erase(std::remove_if(v.begin(), v.end(), [](double d){ return d < 0; }), v.end());
+    o << "  " << std::left << std::setw(9) << label << std::right;
+    if (v.empty()) { o << "  (no samples)\n"; return; }
+    std::sort(v.begin(), v.end());
+    o << std::fixed << std::setprecision(1)
+      << "  p50 " << std::setw(8) << pct(v, 50)
+      << "  p95 " << std::setw(8) << pct(v, 95)
+      << "  p99 " << std::setw(8) << pct(v, 99)
+      << "  max " << std::setw(8) << v.back()
+      << " " << unit << "  (n=" << v.size() << ")\n";
+}
+
+std::string Summary() {
+    std::lock_guard<std::mutex> L(g_mtx);
+    std::ostringstream o;
+    if (g_samples.empty()) {
+        o << "No requests recorded yet.\n";
+        return o.str();
+    }
+    for (const auto& [kind, q] : g_samples) {
+        std::vector<double> queue, connect, ttfb, ttft, itl, total, tps;
+        size_t ok = 0;
+        for (const auto& t : q) {
+            if (t.ok) ++ok;
+            queue.push_back(t.queue_ms);
+            connect.push_back(t.connect_ms);
+            ttfb.push_back(t.ttfb_ms);
+            ttft.push_back(t.ttft_ms);
+            total.push_back(t.total_ms);
+            itl.insert(itl.end(), t.inter_token_ms.begin(), t.inter_token_ms.end());
+            tps.push_back(t.tokensPerSecond());
+        }
+        o << "[" << kind << "] window=" << q.size() << " ok=" << ok
+          << " total=" << g_totals[kind] << "\n";
+        print_row(o, "queue", queue, "ms");
+        print_row(o, "connect", connect, "ms");
+        print_row(o, "ttfb", ttfb, "ms");
+        print_row(o, "ttft", ttft, "ms");
+        print_row(o, "itl", itl, "ms");
+        print_row(o, "total", total, "ms");
+        print_row(o, "tok/s", tps, "t/s");
+    }
+    if (!g_export_path.empty()) o << "Exporting to " << g_export_path << "\n";
+    return o.str();
+}
+
+QueuedSince::QueuedSince(std::chrono::steady_clock::time_point since)
+    : prev_(t_queued), had_prev_(t_has_queued) {
+    t_queued = since;
+    t_has_queued = true;
+}
+
+QueuedSince::~QueuedSince() {
+    t_queued = prev_;
+    t_has_queued = had_prev_;
+}
+
+std::chrono::steady_clock::time_point QueuedSince::current() {
+    return t_has_queued ? t_queued : std::chrono::steady_clock::now();
+}
+
+} // namespace perf_stats
@@ -1,21 +1,76 @@
 
 #include "rag_session.hpp"
 #include "rag_adapter.hpp"
-#include <mutex>
+#include "rag_trace.hpp"
+#include "rag_executor.hpp"
+#include "rag_text.hpp"
+#include "cancel.h"
+#include "perf_stats.h"
+#include <map>
+#include <memory>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
+#include <optional>
+#include <chrono>
+#include <ctime>
 
 namespace fs = std::filesystem;
+using rag_text::read_text_file;
+using rag_text::code_chunk_spans;
 
-static std::mutex g_mtx;
-static std::string g_last_error;
+static thread_local std::string g_last_error; // legacy LastError(), per calling thread
 static RAGSessionManager g_mgr;
 
 const std::string& AIMaster_RAG_LastError(){ return g_last_error; }
-void AIMaster_RAG_SetVerbose(bool v){ std::lock_guard<std::mutex> L(g_mtx); g_mgr.setVerbose(v); }
+void AIMaster_RAG_SetVerbose(bool v){ g_mgr.setVerbose(v); }
+void AIMaster_RAG_SetPrefilter(size_t min_chunks, size_t candidates, size_t min_candidates, double max_df){
+    g_mgr.setPrefilter({min_chunks, candidates, min_candidates, max_df});
+}
+bool AIMaster_RAG_CheckFilter(const std::string& spec, std::string& canonical, std::string& error){
+    ChunkFilter f;
+    if (!ChunkFilter::parse(spec, f, error)) return false;
+    canonical = f.describe();
+    return true;
+}
+void AIMaster_RAG_Configure(const std::string& url, const std::string& embed_model, const std::string& llm_model){
+    g_mgr.configure(url, embed_model, llm_model);
+}
+
+// -------- Published session snapshots --------
+// Readers grab an immutable SessionIndex via an atomic shared_ptr load and
+// never block each other or an ingest. Writers build a new index off to the
+// side and publish it with a copy-on-write swap of the session map; old
+// snapshots stay alive until their last reader drops them.
+
+using SessionPtr = std::shared_ptr<const SessionIndex>;
+using SessionMap = std::map<std::string, SessionPtr>;
+static std::shared_ptr<const SessionMap> g_sessions = std::make_shared<const SessionMap>();
+
+static void publish_session(SessionPtr idx){
+    auto cur = std::atomic_load(&g_sessions);
+    for (;;) {
+        auto next = std::make_shared<SessionMap>(*cur);
+        (*next)[idx->session_id] = idx;
+        std::shared_ptr<const SessionMap> nextc = std::move(next);
+        if (std::atomic_compare_exchange_weak(&g_sessions, &cur, nextc)) return;
+    }
+}
+
+// Snapshot lookup; the first query of a session loads it from disk once.
+static SessionPtr session_snapshot(const std::string& sid){
+    auto map = std::atomic_load(&g_sessions);
+    auto it = map->find(sid);
+    if (it != map->end()) return it->second;
+    auto opt = g_mgr.load_index(sid);
+    if (!opt) return nullptr;
+    auto idx = std::make_shared<const SessionIndex>(std::move(*opt));
+    // Another reader may have raced us; either snapshot is equivalent
+    publish_session(idx);
+    return idx;
+}
 
 // -------- Minimal, safe code ingestion appended after PDF session creation --------
 
@@ -43,139 +98,250 @@ static bool should_skip_path(const std::string& s){
         || s.find("/.venv/")!=std::string::npos;
 }
 
-static std::string read_text_file(const fs::path& p, size_t max_bytes=512*1024){
-    std::ifstream ifs(p, std::ios::binary);
-    if (!ifs) return {};
-    // binary sniff
-    std::string head(8192, '\0');
-    ifs.read(head.data(), head.size());
-    head.resize((size_t)ifs.gcount());
-    if (head.find('\0') != std::string::npos) return {}; // looks binary
-    // read up to max
-    ifs.clear(); ifs.seekg(0);
-    std::string data; data.reserve(std::min(max_bytes, (size_t)fs::file_size(p)));
-    char buf[8192]; size_t total=0;
-    while (ifs){
-        ifs.read(buf, sizeof(buf));
-        std::streamsize n = ifs.gcount();
-        if (n<=0) break;
-        size_t add = (total + (size_t)n > max_bytes) ? (max_bytes - total) : (size_t)n;
-        data.append(buf, buf+add);
-        total += add;
-        if (total >= max_bytes) break;
-    }
-    return data;
-}
-
-static std::vector<std::string> code_chunks(const std::string& text, size_t max_chars=1200, size_t overlap=120){
-    std::vector<std::string> out;
-    size_t i = 0;
-    while (i < text.size()) {
-        size_t end = std::min(text.size(), i + max_chars);
-        size_t j = end;
-        while (j > i + 200 && j < text.size() && text[j] != '\n') --j;
-        if (j <= i + 200) j = end;
-        out.emplace_back(text.substr(i, j - i));
-        if (j >= text.size()) break;
-        i = j > overlap ? j - overlap : j;
+// Pre-scan so progress can report totals and an ETA from the first file on
+static void count_ingest_inputs(const std::string& folder, IngestProgress& progress){
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(folder, ec); it != fs::recursive_directory_iterator(); it.increment(ec)){
+        if (ec) break;
+        if (!it->is_regular_file()) continue;
+        auto p = it->path();
+        std::string ext = p.extension().string();
+        bool pdf = ext == ".pdf";
+        if (!pdf && (should_skip_path(p.string()) || !is_text_ext(ext))) continue;
+        progress.files_total++;
+        progress.bytes_total += it->file_size(ec);
     }
-    return out;
 }
 
-static void append_code_to_session(const std::string& folder, const std::string& sid){
+static SessionIndex append_code_to_session(const std::string& folder, const std::string& sid, IngestProgress* progress){
+    rag_trace::Span span("append_code", "ingest");
     auto opt = g_mgr.load_index(sid);
-    if (!opt) return;
-    auto idx = *opt;
+    if (!opt) throw std::runtime_error("Session index missing after ingest: " + sid);
+    auto idx = std::move(*opt);
 
     size_t added_chunks = 0;
     for (auto it = fs::recursive_directory_iterator(folder); it != fs::recursive_directory_iterator(); ++it){
+        if (cancel::Cancelled()) break;
         if (!it->is_regular_file()) continue;
         auto p = it->path();
         std::string pstr = p.string();
         if (should_skip_path(pstr)) continue;
         if (!is_text_ext(p.extension().string())) continue;
 
-        auto text = read_text_file(p);
+        rag_trace::Span fsp("file", "ingest");
+        fsp.arg("path", pstr);
+        std::string text;
+        {
+            rag_trace::Span sp("read", "ingest");
+            text = read_text_file(p);
+        }
         if (text.empty()) continue;
+        if (progress) progress->set_message("Embedding " + pstr);
 
-        auto chunks = code_chunks(text);
-        for (size_t i = 0; i < chunks.size(); ++i){
+        std::vector<std::pair<size_t,size_t>> spans;
+        {
+            rag_trace::Span sp("chunk", "ingest");
+            spans = code_chunk_spans(text);
+        }
+        uint32_t fid = idx.add_file(pstr);
+        int64_t now = (int64_t)std::time(nullptr);
+        if (progress) progress->chunks_found += spans.size();
+        std::optional<rag_trace::Span> batch;
+        for (size_t i = 0; i < spans.size(); ++i){
+            if (i % RAGSessionManager::kEmbedBatch == 0) {
+                batch.reset();
+                batch.emplace("embed_batch", "ingest");
+                batch->arg("first_chunk", (long long)i);
+            }
             Chunk c;
             c.id = pstr + "#" + std::to_string(i);
             // include a short header so answers can surface file context
-            c.text = "FILE: " + pstr + "\n" + chunks[i];
+            c.text = "FILE: " + pstr + "\n" + text.substr(spans[i].first, spans[i].second - spans[i].first);
             c.embedding = g_mgr.embed(c.text);
+            if (cancel::Cancelled()) break;
             if (!c.embedding.empty()){
-                idx.chunks.push_back(std::move(c));
+                idx.add_chunk(c, fid, 0, spans[i].first, spans[i].second, now);
                 ++added_chunks;
+                if (progress) ++progress->chunks_embedded;
             }
         }
+        if (progress && !cancel::Cancelled()) {
+            ++progress->files_done;
+            std::error_code ec;
+            progress->bytes_done += fs::file_size(p, ec);
+        }
     }
 
     if (added_chunks > 0) {
         g_mgr.save_index(idx);
+        // Serve from the stored files: texts stay in text.bin until a chunk is retrieved
+        if (auto stored = g_mgr.load_index(sid)) idx = std::move(*stored);
         g_mgr.setVerbose(true);
         g_mgr.setVerbose(false);
-        std::cerr << "[RAG] Appended " << added_chunks << " code chunk(s) to session.\n";
+        std::string msg = "Appended " + std::to_string(added_chunks) + " code chunk(s) to session.";
+        if (progress) progress->set_message(msg);
+        else std::cerr << "[RAG] " << msg << "\n";
     }
+    return idx;
 }
 
+// Binds a fresh cancellation token unless the caller already bound one
+struct CancelGuard {
+    cancel::Token own;
+    std::optional<cancel::Scope> scope;
+    CancelGuard(){ if (!cancel::Current()) scope.emplace(own); }
+};
+
 // Public API
 
-std::string AIMaster_RAG_AddFolder(const std::string& folder){
+static double ms_since(std::chrono::steady_clock::time_point t){
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+RAGIngestResult AIMaster_RAG_AddFolderDetailed(const std::string& folder, IngestProgress* progress){
+    RAGIngestResult r;
+    r.folder = folder;
+    auto t0 = std::chrono::steady_clock::now();
     try{
-        std::lock_guard<std::mutex> L(g_mtx);
-        g_last_error.clear();
+        CancelGuard cg;
+        rag_trace::Span root("rag.ingest");
+        root.arg("folder", folder);
+        if (progress && fs::is_directory(folder)) count_ingest_inputs(folder, *progress);
         // Step 1: create session from PDFs (existing behavior)
-        auto sid = g_mgr.createSessionFromFolder(folder);
+        auto sid = g_mgr.createSessionFromFolder(folder, progress);
         // Step 2: append code files automatically
-        append_code_to_session(folder, sid);
-        return sid;
+        auto idx = append_code_to_session(folder, sid, progress);
+        r.chunks = idx.size();
+        idx.lexical = g_mgr.lexical_for(idx);
+        publish_session(std::make_shared<const SessionIndex>(std::move(idx)));
+        r.session_id = sid;
+        // A cancelled ingest still returns its partial session
+        if (cancel::Cancelled()) r.error = "Cancelled; partial session kept";
     }catch(const std::exception& e){
-        g_last_error = e.what();
-        return {};
+        r.error = e.what();
     }
+    r.total_ms = ms_since(t0);
+    return r;
 }
 
-std::string AIMaster_RAG_Ask(const std::string& sid, const std::string& question, int k, double score_threshold){
+std::string AIMaster_RAG_AddFolder(const std::string& folder, std::string& error, IngestProgress* progress){
+    auto r = AIMaster_RAG_AddFolderDetailed(folder, progress);
+    error = r.error;
+    return r.session_id;
+}
+
+RAGAnswer AIMaster_RAG_AskDetailed(const std::string& sid, const std::string& question,
+                                   int k, double score_threshold, const RAGTokenCallback& on_token,
+                                   const RAGRetrieval& retrieval){
+    RAGAnswer r;
+    r.session_id = sid;
+    r.question = question;
+    auto t0 = std::chrono::steady_clock::now();
     try{
-        std::lock_guard<std::mutex> L(g_mtx);
-        g_last_error.clear();
-        return g_mgr.chat(sid, question, k, score_threshold);
+        CancelGuard cg;
+        rag_trace::Span root("rag.ask");
+        auto idx = session_snapshot(sid);
+        ChunkFilter filter;
+        std::string bad;
+        if (!idx) {
+            r.error = "Invalid or unknown session_id";
+        } else if (!ChunkFilter::parse(retrieval.filter, filter, bad)) {
+            r.error = "Bad filter: " + bad;
+        } else {
+            auto cr = g_mgr.answer(*idx, question, k, score_threshold, on_token, retrieval.mode, filter);
+            r.embed_ms = cr.embed_ms;
+            r.search_ms = cr.search_ms;
+            r.generate_ms = cr.generate_ms;
+            for (auto& h : cr.hits) r.hits.push_back({h.id, h.score});
+            r.has_context = cr.has_context;
+            if (!cr.has_context) r.answer = "No relevant context found in the document to answer your question.";
+            else r.answer = std::move(cr.answer);
+            if (r.answer.empty()) r.error = cancel::Cancelled() ? "Cancelled" : "No answer from model";
+        }
     }catch(const std::exception& e){
-        g_last_error = e.what();
-        return {};
+        r.error = e.what();
+        r.answer.clear();
     }
+    r.total_ms = ms_since(t0);
+    return r;
 }
 
+std::string AIMaster_RAG_Ask(const std::string& sid, const std::string& question, std::string& error,
+                             int k, double score_threshold, const RAGTokenCallback& on_token,
+                             const RAGRetrieval& retrieval){
+    auto r = AIMaster_RAG_AskDetailed(sid, question, k, score_threshold, on_token, retrieval);
+    error = r.error;
+    return r.answer;
+}
 
-#include <map>
+// -------- Asynchronous entry points (rag_executor pool) --------
 
-static std::string file_ext(const std::string& path){
-    auto dot = path.find_last_of('.');
-    if (dot==std::string::npos) return "";
-    std::string e = path.substr(dot);
-    std::transform(e.begin(), e.end(), e.begin(), ::tolower);
-    return e;
+void AIMaster_RAG_SetAsyncThreads(size_t n){ rag_executor::SetThreads(n); }
+void AIMaster_RAG_SetIngestThreads(size_t n){ rag_executor::SetIngestThreads(n); }
+
+void AIMaster_RAG_AskAsync(const std::string& sid, const std::string& question,
+                           std::function<void(const RAGAnswer&)> on_done,
+                           int k, double score_threshold, const RAGTokenCallback& on_token,
+                           const RAGRetrieval& retrieval, cancel::Token* token){
+    auto queued = std::chrono::steady_clock::now();
+    auto submitted = perf_stats::QueuedSince::current();   // the caller's own queue, if any
+    rag_executor::Post([=]{
+        double wait = ms_since(queued);
+        perf_stats::QueuedSince since(submitted);
+        std::optional<cancel::Scope> scope;
+        if (token) scope.emplace(*token);
+        RAGAnswer r = AIMaster_RAG_AskDetailed(sid, question, k, score_threshold, on_token, retrieval);
+        r.queue_ms = wait;
+        r.total_ms += wait;
+        if (on_done) on_done(r);
+    });
 }
 
-std::string AIMaster_RAG_Summary(const std::string& session_id, int max_files){
+std::future<RAGAnswer> AIMaster_RAG_AskAsync(const std::string& sid, const std::string& question,
+                                             int k, double score_threshold, const RAGTokenCallback& on_token,
+                                             const RAGRetrieval& retrieval, cancel::Token* token){
+    auto done = std::make_shared<std::promise<RAGAnswer>>();
+    auto fut = done->get_future();
+    AIMaster_RAG_AskAsync(sid, question, [done](const RAGAnswer& r){ done->set_value(r); },
+                          k, score_threshold, on_token, retrieval, token);
+    return fut;
+}
+
+void AIMaster_RAG_AddFolderAsync(const std::string& folder, std::function<void(const RAGIngestResult&)> on_done,
+                                 IngestProgress* progress){
+    auto queued = std::chrono::steady_clock::now();
+    rag_executor::PostIngest([=]{
+        double wait = ms_since(queued);
+        RAGIngestResult r = AIMaster_RAG_AddFolderDetailed(folder, progress);
+        r.queue_ms = wait;
+        r.total_ms += wait;
+        if (on_done) on_done(r);
+    });
+}
+
+std::future<RAGIngestResult> AIMaster_RAG_AddFolderAsync(const std::string& folder, IngestProgress* progress){
+    auto done = std::make_shared<std::promise<RAGIngestResult>>();
+    auto fut = done->get_future();
+    AIMaster_RAG_AddFolderAsync(folder, [done](const RAGIngestResult& r){ done->set_value(r); }, progress);
+    return fut;
+}
+
+std::string AIMaster_RAG_Summary(const std::string& session_id, std::string& error, int max_files){
+    error.clear();
     try{
-        std::lock_guard<std::mutex> L(g_mtx);
-        g_last_error.clear();
         if (session_id.empty()) return "No active RAG session.";
-        auto opt = g_mgr.load_index(session_id);
-        if (!opt) return "No index found for session: " + session_id;
-        auto idx = *opt;
+        auto snap = session_snapshot(session_id);
+        if (!snap) { error = "no-index"; return "No index found for session: " + session_id; }
+        const auto& idx = *snap;
 
-        size_t chunk_count = idx.chunks.size();
+        size_t chunk_count = idx.size();
+        // One pass over the file table, not the chunks
         std::map<std::string,int> by_ext;
         std::map<std::string,int> by_file;
-        for (const auto& c : idx.chunks){
-            auto hash = c.id.find('#');
-            std::string path = hash==std::string::npos ? c.id : c.id.substr(0, hash);
-            by_file[path]++;
-            by_ext[file_ext(path)]++;
+        for (const auto& f : idx.files){
+            if (f.chunks == 0) continue;
+            by_file[f.path] += (int)f.chunks;
+            by_ext[f.ext] += (int)f.chunks;
         }
 
         // Build a human-readable summary
@@ -202,7 +368,22 @@ std::string AIMaster_RAG_Summary(const std::string& session_id, int max_files){
         }
         return o.str();
     }catch(const std::exception& e){
-        g_last_error = e.what();
-        return "Error: " + g_last_error;
+        error = e.what();
+        return "Error: " + error;
     }
 }
+
+// -------- Legacy entry points: error through AIMaster_RAG_LastError() --------
+
+std::string AIMaster_RAG_AddFolder(const std::string& folder, IngestProgress* progress){
+    return AIMaster_RAG_AddFolder(folder, g_last_error, progress);
+}
+
+std::string AIMaster_RAG_Ask(const std::string& sid, const std::string& question, int k, double score_threshold,
+                             const RAGTokenCallback& on_token){
+    return AIMaster_RAG_Ask(sid, question, g_last_error, k, score_threshold, on_token);
+}
+
+std::string AIMaster_RAG_Summary(const std::string& session_id, int max_files){
+    return AIMaster_RAG_Summary(session_id, g_last_error, max_files);
+}
@@ -1,8 +1,95 @@
 #pragma once
 #include <string>
-std::string AIMaster_RAG_AddFolder(const std::string& folder_path);
-std::string AIMaster_RAG_Ask(const std::string& session_id, const std::string& question, int k=5, double score_threshold=0.2);
+#include <vector>
+#include <future>
+#include <functional>
+
+// Streaming sink for RAG answers; called with each visible fragment.
+using RAGTokenCallback = std::function<void(const std::string&)>;
+
+struct IngestProgress; // rag_session.hpp
+enum class RetrievalMode; // rag_session.hpp
+namespace cancel { class Token; } // cancel.h
+
+// Structured results, used by the *Detailed and *Async entry points.
+struct RAGHit { std::string chunk_id; double score = 0; };
+struct RAGAnswer {
+  std::string session_id, question;
+  std::string answer;
+  std::string error;                 // empty on success
+  std::vector<RAGHit> hits;          // chunks given to the model, best first
+  bool has_context = false;          // some chunk passed the threshold, so generation ran
+  double queue_ms = 0;               // waiting for an executor thread (async only)
+  double embed_ms = 0, search_ms = 0, generate_ms = 0, total_ms = 0;
+  bool ok() const { return error.empty(); }
+};
+// How a question picks its chunks; conversations keep theirs in ConversationSettings.
+// mode: Vector (cosine; the default), Keyword (BM25, no embedding call, no score
+// threshold) or Hybrid (both, reciprocal rank fusion of the chunks that meet the
+// threshold). Hit scores are cosine, or BM25 in Keyword.
+// filter: metadata spec, e.g. "ext=.cpp,.h dir=src/net" or "pdf pages=3-10"
+// (see ChunkFilter in rag_filter.hpp); "" = all chunks.
+struct RAGRetrieval { RetrievalMode mode{}; std::string filter; };
+struct RAGIngestResult {
+  std::string folder, session_id;
+  std::string error;                 // may be set alongside a partial session_id
+  size_t chunks = 0;
+  double queue_ms = 0, total_ms = 0;
+  bool ok() const { return error.empty(); }
+};
+
+// All entry points are safe to call concurrently. Queries run against
+// published session snapshots and do not wait for each other or for ingest.
+// The overloads taking `error` report failures per call (cleared on success).
+
+// progress (optional) receives live counters; see rag_jobs for background ingest.
+std::string AIMaster_RAG_AddFolder(const std::string& folder_path, std::string& error, IngestProgress* progress=nullptr);
+std::string AIMaster_RAG_Ask(const std::string& session_id, const std::string& question, std::string& error,
+                             int k=5, double score_threshold=0.2, const RAGTokenCallback& on_token={},
+                             const RAGRetrieval& retrieval={});
+std::string AIMaster_RAG_Summary(const std::string& session_id, std::string& error, int max_files=10);
+
+RAGAnswer AIMaster_RAG_AskDetailed(const std::string& session_id, const std::string& question,
+                                   int k=5, double score_threshold=0.2, const RAGTokenCallback& on_token={},
+                                   const RAGRetrieval& retrieval={});
+RAGIngestResult AIMaster_RAG_AddFolderDetailed(const std::string& folder_path, IngestProgress* progress=nullptr);
+
+// Asynchronous variants run on an internal worker pool, so callers can keep
+// many questions in flight without threads of their own. on_token and the
+// completion callbacks are invoked on a pool thread. progress must outlive the task,
+// as must token: bound on the pool thread, it lets the caller cancel the question
+// (without one the task gets its own foreground token).
+std::future<RAGAnswer> AIMaster_RAG_AskAsync(const std::string& session_id, const std::string& question,
+                                             int k=5, double score_threshold=0.2, const RAGTokenCallback& on_token={},
+                                             const RAGRetrieval& retrieval={}, cancel::Token* token=nullptr);
+void AIMaster_RAG_AskAsync(const std::string& session_id, const std::string& question,
+                           std::function<void(const RAGAnswer&)> on_done,
+                           int k=5, double score_threshold=0.2, const RAGTokenCallback& on_token={},
+                           const RAGRetrieval& retrieval={}, cancel::Token* token=nullptr);
+std::future<RAGIngestResult> AIMaster_RAG_AddFolderAsync(const std::string& folder_path, IngestProgress* progress=nullptr);
+void AIMaster_RAG_AddFolderAsync(const std::string& folder_path, std::function<void(const RAGIngestResult&)> on_done,
+                                 IngestProgress* progress=nullptr);
+// Pool sizes; only effective before the first async call. Questions get 4 workers
+// by default; AddFolderAsync runs on its own pool (1 worker) and queues behind it.
+void AIMaster_RAG_SetAsyncThreads(size_t n);
+void AIMaster_RAG_SetIngestThreads(size_t n);
+
+// Legacy variants: the error is kept per thread and read via AIMaster_RAG_LastError().
+std::string AIMaster_RAG_AddFolder(const std::string& folder_path, IngestProgress* progress=nullptr);
+std::string AIMaster_RAG_Ask(const std::string& session_id, const std::string& question, int k=5, double score_threshold=0.2,
+                             const RAGTokenCallback& on_token={});
 const std::string& AIMaster_RAG_LastError();
 void AIMaster_RAG_SetVerbose(bool v);
+// Lexical pre-filter for vector scoring: sessions of at least min_chunks score
+// only the BM25 top `candidates` (full scan below min_candidates matches).
+// Query terms in more than max_df of the chunks do not gather candidates.
+// candidates 0 disables it. Defaults 20000, 2000, 100, 0.5.
+void AIMaster_RAG_SetPrefilter(size_t min_chunks, size_t candidates, size_t min_candidates, double max_df=0.5);
+// Checks a RAGRetrieval filter spec: false + error if malformed, else the
+// normalized spec in `canonical` ("" for no filter).
+bool AIMaster_RAG_CheckFilter(const std::string& spec, std::string& canonical, std::string& error);
+// Ollama base URL (e.g. http://localhost:11434) and model names; empty keeps the default.
+// Call once before the first ingest or query.
+void AIMaster_RAG_Configure(const std::string& ollama_url, const std::string& embed_model="", const std::string& llm_model="");
 
 std::string AIMaster_RAG_Summary(const std::string& session_id, int max_files=10);
@@ -6,7 +6,11 @@
 #include <iomanip>
 #include <jsoncpp/json/json.h>
 #include "rag_adapter.hpp"
+#include "rag_session.hpp"
 #include "rag_state.hpp"
+#include "conversation.h"
+#include "stream_sink.h"
+#include "rag_jobs.hpp"
 
 inline void __rag_tokenize(const std::string& line, std::vector<std::string>& toks) {
     std::istringstream iss(line);
@@ -14,6 +18,24 @@ inline void __rag_tokenize(const std::string& line, std::vector<std::string>& to
     while (iss >> t) toks.push_back(t);
 }
 
+inline std::string __rag_format_eta(const rag_jobs::JobStatus& j) {
+    if (j.state != "running") return "finished";
+    if (j.eta_s < 0) return "ETA --";
+    std::ostringstream o;
+    o << "ETA " << (long)j.eta_s / 60 << "m" << std::setw(2) << std::setfill('0') << (long)j.eta_s % 60 << "s";
+    return o.str();
+}
+
+inline Json::Value __rag_job_json(const rag_jobs::JobStatus& j) {
+    Json::Value v;
+    v["id"] = j.id; v["state"] = j.state; v["folder"] = j.folder;
+    v["files_done"] = (Json::UInt64)j.files_done; v["files_total"] = (Json::UInt64)j.files_total;
+    v["chunks_embedded"] = (Json::UInt64)j.chunks_embedded; v["chunks_found"] = (Json::UInt64)j.chunks_found;
+    v["chunks_per_s"] = j.chunks_per_s; v["elapsed_s"] = j.elapsed_s; v["eta_s"] = j.eta_s;
+    v["session_id"] = j.session_id; v["error"] = j.error;
+    return v;
+}
+
 // Header-only console handler so no separate .cpp is required.
 inline bool HandleRAGConsoleCommand(const std::string& line, Json::Value& out) {
     std::vector<std::string> tokens;
@@ -29,15 +51,55 @@ inline bool HandleRAGConsoleCommand(const std::string& line, Json::Value& out) {
             return true;
         }
         const std::string folder = tokens[1];
-        std::string sid = AIMaster_RAG_AddFolder(folder);
-        if (sid.empty()) {
-            std::cout << "RAG ingest failed: " << AIMaster_RAG_LastError() << "\n";
-            out["ok"] = false; out["error"] = AIMaster_RAG_LastError();
+        int job = rag_jobs::StartIngest(folder);
+        std::cout << "RAG ingest job #" << job << " started for " << folder
+                  << " (RAG_STATUS " << job << " for progress, CANCEL " << job << " to stop)\n";
+        out["ok"] = true; out["job_id"] = job;
+        return true;
+    }
+
+    // RAG_JOBS - one line per ingest job
+    if (cmd == "RAG_JOBS") {
+        auto jobs = rag_jobs::List();
+        if (jobs.empty()) std::cout << "No ingest jobs.\n";
+        out["jobs"] = Json::arrayValue;
+        for (const auto& j : jobs) {
+            std::cout << "  #" << j.id << " " << std::left << std::setw(9) << j.state << std::right
+                      << " files " << j.files_done << "/" << j.files_total
+                      << "  chunks " << j.chunks_embedded
+                      << "  " << std::fixed << std::setprecision(1) << j.chunks_per_s << " chunks/s"
+                      << "  " << __rag_format_eta(j) << "  " << j.folder << "\n";
+            out["jobs"].append(__rag_job_json(j));
+        }
+        out["ok"] = true;
+        return true;
+    }
+
+    // RAG_STATUS [id] - detail for one job (default: most recent)
+    if (cmd == "RAG_STATUS") {
+        auto jobs = rag_jobs::List();
+        rag_jobs::JobStatus j;
+        bool found = false;
+        if (tokens.size() >= 2) {
+            try { found = rag_jobs::Get(std::stoi(tokens[1]), j); } catch (...) {}
+        } else if (!jobs.empty()) {
+            j = jobs.back(); found = true;
+        }
+        if (!found) {
+            std::cout << "No such ingest job. Use RAG_JOBS to list them.\n";
+            out["ok"] = false; out["error"] = "no-job";
             return true;
         }
-        rag_state::SetActiveSession(sid);
-        std::cout << "RAG session set: " << sid << "\n";
-        out["ok"] = true; out["session_id"] = sid;
+        std::cout << "Job #" << j.id << " [" << j.state << "] " << j.folder << "\n"
+                  << "  Files:   " << j.files_done << "/" << j.files_total << "\n"
+                  << "  Chunks:  " << j.chunks_embedded << " embedded of " << j.chunks_found << " found\n"
+                  << "  Rate:    " << std::fixed << std::setprecision(1) << j.chunks_per_s << " chunks/s\n"
+                  << "  Elapsed: " << std::setprecision(0) << j.elapsed_s << " s, " << __rag_format_eta(j) << "\n";
+        if (!j.message.empty()) std::cout << "  Status:  " << j.message << "\n";
+        if (!j.session_id.empty()) std::cout << "  Session: " << j.session_id << "\n";
+        if (!j.error.empty()) std::cout << "  Error:   " << j.error << "\n";
+        out = __rag_job_json(j);
+        out["ok"] = true;
         return true;
     }
 
@@ -51,7 +113,8 @@ inline bool HandleRAGConsoleCommand(const std::string& line, Json::Value& out) {
             out["ok"] = false; out["error"] = "no-session";
             return true;
         }
-        std::string summary = AIMaster_RAG_Summary(sid, max_files);
+        std::string error;
+        std::string summary = AIMaster_RAG_Summary(sid, error, max_files);
         std::cout << summary;
         out["ok"] = true; out["summary"] = summary;
         return true;
@@ -69,17 +132,70 @@ inline bool HandleRAGConsoleCommand(const std::string& line, Json::Value& out) {
             if (i>1) q << ' ';
             q << tokens[i];
         }
-        std::string ans = AIMaster_RAG_Ask(rag_state::GetActiveSession(), q.str(), 5, 0.2);
+        bool streamed = false;
+        std::string error;
+        ConversationSettings cs = conversations::Current()->settings();
+        std::string ans = AIMaster_RAG_Ask(rag_state::GetActiveSession(), q.str(), error, cs.rag_k, cs.rag_threshold,
+                                           [&streamed](const std::string& t) { streamed = true; streamSinkWrite(t); },
+                                           {cs.rag_mode, cs.rag_filter});
         if (ans.empty()) {
-            std::cout << "RAG ask failed: " << AIMaster_RAG_LastError() << "\n";
-            out["ok"] = false; out["error"] = AIMaster_RAG_LastError();
+            if (streamed) streamSinkStatus("");
+            std::cout << "RAG ask failed: " << error << "\n";
+            out["ok"] = false; out["error"] = error;
             return true;
         }
-        std::cout << ans << "\n";
+        if (!streamed) streamSinkWrite(ans);
+        streamSinkStatus("");
         out["ok"] = true; out["answer"] = ans;
         return true;
     }
 
+    // RAG_MODE [VECTOR|HYBRID|KEYWORD]   (current conversation)
+    if (cmd == "RAG_MODE") {
+        static const char* names[] = {"VECTOR", "HYBRID", "KEYWORD"};   // RetrievalMode order
+        auto conv = conversations::Current();
+        ConversationSettings cs = conv->settings();
+        if (tokens.size() >= 2) {
+            std::string m = tokens[1];
+            for (auto& c : m) c = (char)toupper((unsigned char)c);
+            if (m == "VECTOR") cs.rag_mode = RetrievalMode::Vector;
+            else if (m == "HYBRID") cs.rag_mode = RetrievalMode::Hybrid;
+            else if (m == "KEYWORD") cs.rag_mode = RetrievalMode::Keyword;
+            else {
+                std::cout << "Usage: RAG_MODE [VECTOR|HYBRID|KEYWORD]\n";
+                out["ok"] = false; out["error"] = "usage";
+                return true;
+            }
+            conv->setSettings(cs);
+        }
+        std::string mode = names[(int)cs.rag_mode];
+        std::cout << "RAG retrieval: " << mode << "\n";
+        out["ok"] = true; out["mode"] = mode;
+        return true;
+    }
+
+    // RAG_FILTER [ext=.cpp,.h] [dir=<path>] [pdf|code] [pages=A-B] | RAG_FILTER CLEAR   (current conversation)
+    if (cmd == "RAG_FILTER") {
+        auto conv = conversations::Current();
+        ConversationSettings cs = conv->settings();
+        if (tokens.size() >= 2) {
+            std::string spec, error;
+            if (!(tokens.size() == 2 && (tokens[1] == "CLEAR" || tokens[1] == "clear")))
+                for (size_t i = 1; i < tokens.size(); ++i) spec += (i > 1 ? " " : "") + tokens[i];
+            if (!AIMaster_RAG_CheckFilter(spec, cs.rag_filter, error)) {
+                std::cout << "RAG_FILTER: " << error << "\n"
+                          << "Usage: RAG_FILTER [ext=.cpp,.h] [dir=<path>] [pdf|code] [pages=A-B] | RAG_FILTER CLEAR\n";
+                out["ok"] = false; out["error"] = error;
+                return true;
+            }
+            conv->setSettings(cs);
+        }
+        std::string f = cs.rag_filter;
+        std::cout << "RAG filter: " << (f.empty() ? "<none>" : f) << "\n";
+        out["ok"] = true; out["filter"] = f;
+        return true;
+    }
+
     // RAG_SESSION <SET|SHOW|CLEAR> [sid]
     if (cmd == "RAG_SESSION") {
         if (tokens.size()>=2 && tokens[1]=="SET") {
@@ -0,0 +1,37 @@
+#include "rag_executor.hpp"
+#include "thread_pool.h"
+
+namespace rag_executor {
+
+static ThreadPool& pool() {
+  static ThreadPool p;
+  return p;
+}
+
+static ThreadPool& ingestPool() {
+  static ThreadPool p(1);
+  return p;
+}
+
+void Post(std::function<void()> task) { pool().post(std::move(task)); }
+
+void PostIngest(std::function<void()> task) { ingestPool().post(std::move(task)); }
+
+void SetThreads(size_t n) { pool().setThreads(n); }
+
+size_t Threads() { return pool().threads(); }
+
+void SetIngestThreads(size_t n) { ingestPool().setThreads(n); }
+
+size_t IngestThreads() { return ingestPool().threads(); }
+
+size_t Pending() { return pool().pending(); }
+
+size_t IngestPending() { return ingestPool().pending(); }
+
+void Shutdown() {
+  ingestPool().stop();
+  pool().stop();
+}
+
+} // namespace rag_executor
@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+// Worker pools behind the asynchronous RAG API: one for questions and a
+// separate, smaller one for ingests, so a long ingest never holds the workers
+// questions need. Tasks run in FIFO order per pool; a pool starts on first use
+// so blocking-only callers never pay for it.
+namespace rag_executor {
+
+// Queues task on the question pool. Exceptions escaping a task are swallowed.
+void Post(std::function<void()> task);
+
+// Queues task on the ingest pool; further ingests wait for a free ingest worker.
+void PostIngest(std::function<void()> task);
+
+// Worker counts; take effect before the pool's first Post (defaults 4 and 1).
+void SetThreads(size_t n);
+size_t Threads();
+void SetIngestThreads(size_t n);
+size_t IngestThreads();
+
+// Tasks queued but not yet picked up by a worker.
+size_t Pending();
+size_t IngestPending();
+
+// Runs the remaining queued tasks of both pools and joins the workers. Later
+// Posts run inline.
+void Shutdown();
+
+} // namespace rag_executor
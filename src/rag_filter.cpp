@@ -0,0 +1,121 @@
+#include "rag_filter.hpp"
+#include "rag_session.hpp"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+
+namespace {
+
+std::string lower(std::string s) {
+  for (auto& c : s) c = (char)std::tolower((unsigned char)c);
+  return s;
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> out;
+  std::string cur;
+  std::istringstream in(s);
+  while (std::getline(in, cur, sep)) if (!cur.empty()) out.push_back(cur);
+  return out;
+}
+
+bool parsePage(const std::string& s, uint32_t& v) {
+  if (s.empty() || s.size() > 9 || !std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; })) return false;
+  v = (uint32_t)std::stoul(s);
+  return v > 0;
+}
+
+} // namespace
+
+std::string ChunkFilter::describe() const {
+  std::string s;
+  auto add = [&](const std::string& t) { if (!s.empty()) s += ' '; s += t; };
+  if (kind == Pdf) add("pdf");
+  if (kind == Code) add("code");
+  if (!exts.empty()) {
+    std::string t = "ext=";
+    for (size_t i = 0; i < exts.size(); ++i) t += (i ? "," : "") + exts[i];
+    add(t);
+  }
+  for (auto& d : dirs) add("dir=" + d);
+  if (page_min || page_max)
+    add("pages=" + (page_min == page_max ? std::to_string(page_min) : std::to_string(page_min) + "-" + std::to_string(page_max)));
+  return s;
+}
+
+bool ChunkFilter::parse(const std::string& spec, ChunkFilter& out, std::string& error) {
+  ChunkFilter f;
+  std::istringstream in(spec);
+  std::string tok;
+  while (in >> tok) {
+    auto eq = tok.find('=');
+    std::string key = lower(tok.substr(0, eq));
+    std::string val = eq == std::string::npos ? "" : tok.substr(eq + 1);
+    if (eq == std::string::npos && (key == "pdf" || key == "code")) {
+      Kind k = key == "pdf" ? Pdf : Code;
+      if (f.kind != Any && f.kind != k) { error = "pdf and code exclude each other"; return false; }
+      f.kind = k;
+    } else if (key == "ext" && !val.empty()) {
+      for (auto& e : split(val, ',')) f.exts.push_back(lower(e[0] == '.' ? e : "." + e));
+    } else if (key == "dir" && !val.empty()) {
+      for (auto d : split(val, ',')) {
+        while (d.size() > 1 && d.back() == '/') d.pop_back();
+        f.dirs.push_back(d);
+      }
+    } else if (key == "pages" && !val.empty()) {
+      auto dash = val.find('-');
+      uint32_t a = 0, b = 0;
+      bool ok = dash == std::string::npos ? parsePage(val, a) && parsePage(val, b)
+                                          : parsePage(val.substr(0, dash), a) && parsePage(val.substr(dash + 1), b);
+      if (!ok || a > b) { error = "bad page range: " + val; return false; }
+      f.page_min = a;
+      f.page_max = b;
+    } else {
+      error = "unknown filter: " + tok;
+      return false;
+    }
+  }
+  std::sort(f.exts.begin(), f.exts.end());
+  f.exts.erase(std::unique(f.exts.begin(), f.exts.end()), f.exts.end());
+  out = std::move(f);
+  return true;
+}
+
+std::vector<uint64_t> ChunkFilter::bitmap(const SessionIndex& idx) const {
+  size_t n = idx.size();
+  std::vector<uint64_t> bits((n + 63) / 64, 0);
+  auto fileOk = [&](const std::string& path, const std::string& ext) {
+    bool pdf = ext == ".pdf";
+    if ((kind == Pdf && !pdf) || (kind == Code && pdf)) return false;
+    if ((page_min || page_max) && !pdf) return false;
+    if (!exts.empty() && !std::binary_search(exts.begin(), exts.end(), ext)) return false;
+    if (dirs.empty()) return true;
+    for (auto& d : dirs) {
+      auto at = path.find(d);
+      while (at != std::string::npos) {
+        bool start = at == 0 || path[at - 1] == '/' || d[0] == '/';
+        bool end = at + d.size() < path.size() && path[at + d.size()] == '/';
+        if (start && end) return true;
+        at = path.find(d, at + 1);
+      }
+    }
+    return false;
+  };
+  auto pageOk = [&](uint32_t pg) { return !(page_min || page_max) || (pg >= page_min && pg <= page_max); };
+
+  std::vector<char> ok(idx.files.size());
+  for (size_t f = 0; f < idx.files.size(); ++f) ok[f] = idx.files[f].chunks && fileOk(idx.files[f].path, idx.files[f].ext);
+  for (size_t i = 0; i < n; ++i)
+    if (ok[idx.file_id[i]] && pageOk(idx.page[i])) bits[i >> 6] |= 1ull << (i & 63);
+  return bits;
+}
+
+std::vector<size_t> ChunkFilter::positions(const std::vector<uint64_t>& bits, size_t chunks) {
+  std::vector<size_t> out;
+  for (size_t w = 0; w < bits.size(); ++w)
+    for (uint64_t b = bits[w]; b; b &= b - 1) {
+      size_t i = w * 64 + (size_t)__builtin_ctzll(b);
+      if (i < chunks) out.push_back(i);
+    }
+  return out;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SessionIndex;
+
+// Restricts retrieval to a subset of a session's chunks by their metadata
+// columns (SessionIndex::files, page). Conditions are ANDed; an empty filter
+// matches everything.
+//
+// Spec (whitespace-separated tokens, case-insensitive keywords):
+//   ext=.cpp,.h     file extension, leading dot optional
+//   dir=src/net     path contains this directory (repeatable, comma lists)
+//   pdf | code      PDFs only / everything but PDFs
+//   pages=3-10      PDF pages (1-based, "7" for one page); excludes code chunks
+struct ChunkFilter {
+  enum Kind : uint8_t { Any = 0, Pdf = 1, Code = 2 };
+  std::vector<std::string> exts;   // lowercased, with the dot
+  std::vector<std::string> dirs;   // no trailing '/'
+  Kind kind = Any;
+  uint32_t page_min = 0, page_max = 0;   // 0/0: no page condition
+
+  bool empty() const { return exts.empty() && dirs.empty() && kind == Any && page_min == 0 && page_max == 0; }
+  // Canonical spec, "" for the empty filter
+  std::string describe() const;
+  // false (out untouched, error set) on an unknown token or a bad value
+  static bool parse(const std::string& spec, ChunkFilter& out, std::string& error);
+
+  // One bit per chunk (bit i of word i/64) set if chunk i matches. Decided per
+  // file first, so the per-chunk pass is a table lookup plus the page test.
+  std::vector<uint64_t> bitmap(const SessionIndex& idx) const;
+  // The matching chunk positions, ascending
+  static std::vector<size_t> positions(const std::vector<uint64_t>& bits, size_t chunks);
+};
@@ -7,10 +7,12 @@ namespace rag_int {
 static std::atomic<bool> g_enabled{true};
 bool Enabled(){ return g_enabled.load(); }
 void SetEnabled(bool on){ g_enabled.store(on); }
-bool TryRAGAnswer(const std::string& user_input, std::string& out_answer, int k, double threshold) {
+bool TryRAGAnswer(const std::string& user_input, std::string& out_answer, int k, double threshold,
+                  const RAGTokenCallback& on_token, const RAGRetrieval& retrieval) {
     if (!Enabled()) return false;
     if (!rag_state::HasActiveSession()) return false;
-    out_answer = AIMaster_RAG_Ask(rag_state::GetActiveSession(), user_input, k, threshold);
+    std::string error;
+    out_answer = AIMaster_RAG_Ask(rag_state::GetActiveSession(), user_input, error, k, threshold, on_token, retrieval);
     return !out_answer.empty();
 }
 } // namespace rag_int
@@ -1,8 +1,11 @@
 #pragma once
 #include <string>
+#include "rag_adapter.hpp"
 
 namespace rag_int {
 bool Enabled();
 void SetEnabled(bool on);
-bool TryRAGAnswer(const std::string& user_input, std::string& out_answer, int k=5, double threshold=0.2);
+// on_token streams the answer as it is generated; out_answer gets the full text.
+bool TryRAGAnswer(const std::string& user_input, std::string& out_answer, int k=5, double threshold=0.2,
+                  const RAGTokenCallback& on_token={}, const RAGRetrieval& retrieval={});
 } // namespace rag_int
@@ -0,0 +1,172 @@
+#include "rag_jobs.hpp"
+#include "rag_session.hpp"
+#include "rag_adapter.hpp"
+#include "rag_state.hpp"
+#include "cancel.h"
+#include "conversation.h"
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <chrono>
+
+namespace rag_jobs {
+
+struct Job {
+  int id = 0;
+  std::string folder;
+  ConversationPtr conv;                     // conversation that started it; gets the session
+  IngestProgress progress;
+  cancel::Token token{/*background=*/true}; // Ctrl-C in the foreground leaves it running
+  std::thread th;                           // set before the job is listed; joined under g_join_mtx
+  std::chrono::steady_clock::time_point start, end;
+  std::mutex mtx;                           // guards the fields below
+  std::string state = "running";
+  std::string session_id, error;
+};
+
+static std::mutex g_mtx;
+static std::vector<std::shared_ptr<Job>> g_jobs;
+static std::vector<std::string> g_notices;
+static int g_next_id = 1;
+static std::mutex g_join_mtx;               // serialises joining Job::th
+static const size_t kKeepFinished = 32;     // finished jobs still listed by RAG_JOBS
+
+static void run(std::shared_ptr<Job> job){
+  cancel::Scope scope(job->token);
+  conversations::Scope conv(job->conv);
+  std::string err;
+  std::string sid = AIMaster_RAG_AddFolder(job->folder, err, &job->progress);
+  bool cancelled = job->token.cancelled();
+
+  std::string notice = "[RAG] Ingest job #" + std::to_string(job->id);
+  if (sid.empty()) {
+    notice += (cancelled ? " cancelled" : " failed") + (err.empty() ? "" : ": " + err);
+  } else {
+    notice += (cancelled ? " cancelled, partial session " : " done: session ") + sid;
+    if (!rag_state::HasActiveSession()) {
+      rag_state::SetActiveSession(sid);
+      notice += " (now active)";
+    } else {
+      notice += " (RAG_SESSION SET " + sid + " to use it)";
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> L(job->mtx);
+    job->end = std::chrono::steady_clock::now();
+    job->session_id = sid;
+    job->error = err;
+    job->state = cancelled ? "cancelled" : (sid.empty() ? "failed" : "done");
+  }
+  std::lock_guard<std::mutex> L(g_mtx);
+  g_notices.push_back(notice);
+}
+
+static bool finished(Job& j){
+  std::lock_guard<std::mutex> L(j.mtx);
+  return j.state != "running";
+}
+
+// Joins the threads of finished jobs (only the notice is left for them to post)
+// and forgets the oldest joined jobs beyond kKeepFinished.
+static void reap(){
+  std::lock_guard<std::mutex> J(g_join_mtx);
+  std::vector<std::shared_ptr<Job>> jobs;
+  { std::lock_guard<std::mutex> L(g_mtx); jobs = g_jobs; }
+  for (auto& j : jobs) if (j->th.joinable() && finished(*j)) j->th.join();
+
+  std::lock_guard<std::mutex> L(g_mtx);
+  size_t joined = 0;
+  for (auto& j : g_jobs) joined += !j->th.joinable();
+  for (auto it = g_jobs.begin(); it != g_jobs.end() && joined > kKeepFinished; ) {
+    if ((*it)->th.joinable()) { ++it; continue; }
+    it = g_jobs.erase(it);
+    --joined;
+  }
+}
+
+int StartIngest(const std::string& folder){
+  reap();
+  auto job = std::make_shared<Job>();
+  job->folder = folder;
+  job->conv = conversations::Current();
+  job->start = std::chrono::steady_clock::now();
+  { std::lock_guard<std::mutex> L(g_mtx); job->id = g_next_id++; }
+  job->th = std::thread(run, job);
+  std::lock_guard<std::mutex> L(g_mtx);
+  g_jobs.push_back(job);
+  return job->id;
+}
+
+static JobStatus snapshot(Job& j){
+  JobStatus s;
+  s.id = j.id;
+  s.folder = j.folder;
+  s.message = j.progress.message();
+  s.files_total = j.progress.files_total;
+  s.files_done = j.progress.files_done;
+  s.chunks_found = j.progress.chunks_found;
+  s.chunks_embedded = j.progress.chunks_embedded;
+  std::chrono::steady_clock::time_point end;
+  {
+    std::lock_guard<std::mutex> L(j.mtx);
+    s.state = j.state;
+    s.session_id = j.session_id;
+    s.error = j.error;
+    end = s.state == "running" ? std::chrono::steady_clock::now() : j.end;
+  }
+  s.elapsed_s = std::chrono::duration<double>(end - j.start).count();
+  if (s.elapsed_s > 0) s.chunks_per_s = s.chunks_embedded / s.elapsed_s;
+
+  // ETA from bytes processed; file sizes are known up front from the pre-scan
+  uint64_t total = j.progress.bytes_total, done = j.progress.bytes_done;
+  if (s.state != "running") s.eta_s = 0;
+  else if (done > 0 && total >= done) s.eta_s = s.elapsed_s * (double)(total - done) / (double)done;
+  return s;
+}
+
+std::vector<JobStatus> List(){
+  std::vector<std::shared_ptr<Job>> jobs;
+  { std::lock_guard<std::mutex> L(g_mtx); jobs = g_jobs; }
+  std::vector<JobStatus> out;
+  for (auto& j : jobs) out.push_back(snapshot(*j));
+  return out;
+}
+
+static std::shared_ptr<Job> find(int id){
+  std::lock_guard<std::mutex> L(g_mtx);
+  for (auto& j : g_jobs) if (j->id == id) return j;
+  return nullptr;
+}
+
+bool Get(int id, JobStatus& out){
+  auto j = find(id);
+  if (!j) return false;
+  out = snapshot(*j);
+  return true;
+}
+
+bool Cancel(int id){
+  auto j = find(id);
+  if (!j) return false;
+  j->token.cancel();
+  return true;
+}
+
+std::vector<std::string> TakeNotices(){
+  reap();
+  std::lock_guard<std::mutex> L(g_mtx);
+  std::vector<std::string> out;
+  out.swap(g_notices);
+  return out;
+}
+
+void Shutdown(){
+  std::vector<std::shared_ptr<Job>> jobs;
+  { std::lock_guard<std::mutex> L(g_mtx); jobs = g_jobs; }
+  for (auto& j : jobs) j->token.cancel();
+  std::lock_guard<std::mutex> J(g_join_mtx);
+  for (auto& j : jobs) if (j->th.joinable()) j->th.join();
+}
+
+} // namespace rag_jobs
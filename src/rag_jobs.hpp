@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Background RAG ingest jobs. RAG_INGEST starts a job and returns at once;
+// RAG_JOBS / RAG_STATUS report progress while the console stays usable.
+namespace rag_jobs {
+
+struct JobStatus {
+  int id = 0;
+  std::string folder;
+  std::string state;          // running, done, failed, cancelled
+  std::string session_id;     // set once the job finishes (partial if cancelled)
+  std::string error;
+  std::string message;        // last status line from the ingest
+  size_t files_total = 0, files_done = 0;
+  size_t chunks_found = 0, chunks_embedded = 0;
+  double elapsed_s = 0;
+  double chunks_per_s = 0;
+  double eta_s = -1;          // -1 while unknown
+};
+
+// Starts ingesting folder on a background thread; returns the job id. The
+// finished session becomes active in the calling conversation if it has none.
+int StartIngest(const std::string& folder);
+
+// Running jobs and the most recent finished ones (older finished jobs are dropped).
+std::vector<JobStatus> List();
+bool Get(int id, JobStatus& out);
+bool Cancel(int id);
+
+// Completion messages not yet shown to the user (printed before the next prompt).
+std::vector<std::string> TakeNotices();
+
+// Cancels running jobs and waits for them (call before exit).
+void Shutdown();
+
+} // namespace rag_jobs
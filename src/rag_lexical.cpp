@@ -0,0 +1,296 @@
+#include "rag_lexical.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rag_lexical {
+
+namespace {
+
+const char kMagic[8] = {'R','A','G','L','E','X','0','1'};
+const size_t kMaxToken = 64;
+const double kK1 = 1.2, kB = 0.75;
+
+struct Header {
+  char magic[8];
+  uint32_t docs, terms;
+  double avgdl;
+  uint64_t doclen_off, terms_off, strings_off, postings_off, size;
+};
+static_assert(sizeof(Header) == 64, "header layout");
+
+struct TermRec {
+  uint32_t str_off, str_len, df, post_len;
+  uint64_t post_off;
+};
+static_assert(sizeof(TermRec) == 24, "term record layout");
+
+enum : uint8_t { kSep = 0, kWord = 1, kUpper = 2, kJoin = 3 };
+
+struct CharTable {
+  uint8_t cls[256];
+  CharTable() {
+    for (int c = 0; c < 256; ++c) {
+      if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c >= 0x80) cls[c] = kWord;
+      else if (c >= 'A' && c <= 'Z') cls[c] = kUpper;
+      else if (c == '-' || c == '.' || c == '/' || c == ':') cls[c] = kJoin;
+      else cls[c] = kSep;
+    }
+  }
+};
+const CharTable kChars;
+
+inline uint8_t cls(char c) { return kChars.cls[(uint8_t)c]; }
+inline bool word(char c) { return cls(c) == kWord || cls(c) == kUpper; }
+
+void emit(std::string_view s, size_t from, size_t to, std::vector<std::string>& out) {
+  if (to - from > kMaxToken) return;
+  std::string t(s.substr(from, to - from));
+  for (auto& c : t) if (cls(c) == kUpper) c = (char)(c - 'A' + 'a');
+  out.push_back(std::move(t));
+}
+
+void putVarint(std::string& out, uint32_t v) {
+  while (v >= 0x80) { out += (char)(v | 0x80); v >>= 7; }
+  out += (char)v;
+}
+
+inline uint32_t getVarint(const uint8_t*& p, const uint8_t* end) {
+  uint32_t v = 0;
+  for (int shift = 0; p < end && shift < 35; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) break;
+  }
+  return v;
+}
+
+} // namespace
+
+void tokenize(std::string_view s, std::vector<std::string>& out) {
+  size_t i = 0, n = s.size();
+  while (i < n) {
+    while (i < n && !word(s[i])) ++i;
+    if (i >= n) break;
+    size_t start = i, end = i;
+    int parts = 0;
+    for (;;) {
+      size_t w = i;
+      while (i < n && word(s[i])) ++i;
+      emit(s, w, i, out);
+      ++parts;
+      end = i;
+      size_t j = i;
+      while (j < n && j - i < 2 && cls(s[j]) == kJoin) ++j;
+      if (j > i && j < n && word(s[j])) { i = j; continue; }
+      break;
+    }
+    if (parts > 1) emit(s, start, end, out);
+  }
+}
+
+std::shared_ptr<const Index> Index::build(const SessionIndex& idx) {
+  struct Posting { uint32_t doc, tf; };
+  std::unordered_map<std::string, std::vector<Posting>> inv;
+  std::vector<uint32_t> doclen(idx.size(), 0);
+  std::vector<std::string> toks;
+  std::unordered_map<std::string, uint32_t> tf;
+  double total = 0;
+  for (size_t d = 0; d < idx.size(); ++d) {
+    toks.clear();
+    // Same tokens as the full text(): the header ends in '\n', which never joins words
+    if (idx.file_header[d]) tokenize("FILE: " + idx.path(d), toks);
+    tokenize(idx.body(d), toks);
+    tf.clear();
+    for (auto& t : toks) ++tf[t];
+    for (auto& kv : tf) inv[kv.first].push_back({(uint32_t)d, kv.second});
+    doclen[d] = (uint32_t)toks.size();
+    total += toks.size();
+  }
+
+  std::vector<const std::string*> terms;
+  terms.reserve(inv.size());
+  for (auto& kv : inv) terms.push_back(&kv.first);
+  std::sort(terms.begin(), terms.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+  std::string strings, postings;
+  std::vector<TermRec> recs(terms.size());
+  for (size_t t = 0; t < terms.size(); ++t) {
+    const auto& plist = inv[*terms[t]];   // already in document order
+    TermRec& r = recs[t];
+    r.str_off = (uint32_t)strings.size();
+    r.str_len = (uint32_t)terms[t]->size();
+    strings += *terms[t];
+    r.df = (uint32_t)plist.size();
+    r.post_off = postings.size();
+    uint32_t prev = 0;
+    for (auto& p : plist) {
+      putVarint(postings, p.doc - prev);
+      putVarint(postings, p.tf);
+      prev = p.doc;
+    }
+    r.post_len = (uint32_t)(postings.size() - r.post_off);
+  }
+
+  Header h;
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.docs = (uint32_t)idx.size();
+  h.terms = (uint32_t)recs.size();
+  h.avgdl = idx.empty() ? 0 : total / idx.size();
+  h.doclen_off = sizeof(Header);
+  h.terms_off = h.doclen_off + doclen.size() * sizeof(uint32_t);
+  h.strings_off = h.terms_off + recs.size() * sizeof(TermRec);
+  h.postings_off = h.strings_off + strings.size();
+  h.size = h.postings_off + postings.size();
+
+  std::shared_ptr<Index> ix(new Index);
+  std::string& b = ix->owned_;
+  b.reserve(h.size);
+  b.append((const char*)&h, sizeof(h));
+  b.append((const char*)doclen.data(), doclen.size() * sizeof(uint32_t));
+  b.append((const char*)recs.data(), recs.size() * sizeof(TermRec));
+  b += strings;
+  b += postings;
+  ix->attach(b.data(), b.size(), nullptr);
+  return ix;
+}
+
+std::shared_ptr<const Index> Index::open(const std::string& path, std::string* error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { if (error) *error = "cannot open " + path; return nullptr; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+    ::close(fd);
+    if (error) *error = "not a lexical index: " + path;
+    return nullptr;
+  }
+  void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m == MAP_FAILED) { if (error) *error = "mmap failed: " + path; return nullptr; }
+  std::shared_ptr<Index> ix(new Index);
+  ix->map_ = m;
+  ix->size_ = (size_t)st.st_size;   // for munmap even if attach fails
+  if (!ix->attach((const char*)m, (size_t)st.st_size, error)) return nullptr;
+  return ix;
+}
+
+Index::~Index() {
+  if (map_) munmap(map_, size_);
+}
+
+bool Index::attach(const char* base, size_t size, std::string* error) {
+  Header h;
+  std::memcpy(&h, base, sizeof(h));
+  bool ok = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0 && h.size == size
+         && h.doclen_off == sizeof(Header)
+         && h.terms_off == h.doclen_off + (uint64_t)h.docs * sizeof(uint32_t)
+         && h.strings_off == h.terms_off + (uint64_t)h.terms * sizeof(TermRec)
+         && h.strings_off <= h.postings_off && h.postings_off <= h.size;
+  if (!ok) { if (error) *error = "damaged or foreign lexical index"; return false; }
+  base_ = base;
+  size_ = size;
+  docs_ = h.docs;
+  terms_ = h.terms;
+  avgdl_ = h.avgdl;
+  doclen_off_ = h.doclen_off;
+  terms_off_ = h.terms_off;
+  strings_off_ = h.strings_off;
+  postings_off_ = h.postings_off;
+  return true;
+}
+
+bool Index::save(const std::string& path) const {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    ofs.write(base_, (std::streamsize)size_);
+    if (!ofs) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool Index::findTerm(const std::string& term, uint32_t& df, uint64_t& off, uint32_t& len) const {
+  size_t lo = 0, hi = terms_;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    TermRec r;
+    std::memcpy(&r, base_ + terms_off_ + mid * sizeof(TermRec), sizeof(r));
+    if (strings_off_ + r.str_off + r.str_len > postings_off_) return false;   // damaged file
+    int c = term.compare(0, std::string::npos, base_ + strings_off_ + r.str_off, r.str_len);
+    if (c == 0) {
+      df = r.df;
+      off = postings_off_ + r.post_off;
+      len = r.post_len;
+      return off + len <= size_;
+    }
+    if (c < 0) hi = mid; else lo = mid + 1;
+  }
+  return false;
+}
+
+std::vector<std::pair<double,size_t>> Index::search(const std::string& query, size_t k,
+                                                    const std::vector<uint64_t>* allow, double max_df) const {
+  std::vector<std::pair<double,size_t>> out;
+  if (docs_ == 0 || k == 0) return out;
+  std::vector<std::string> toks;
+  tokenize(query, toks);
+  std::sort(toks.begin(), toks.end());
+  toks.erase(std::unique(toks.begin(), toks.end()), toks.end());
+
+  std::vector<float> acc;
+  std::vector<uint32_t> touched;
+  const uint32_t* doclen = (const uint32_t*)(base_ + doclen_off_);   // 4-aligned: follows the 64-byte header
+  for (const auto& t : toks) {
+    uint32_t df, len;
+    uint64_t off;
+    if (!findTerm(t, df, off, len)) continue;
+    if (df > max_df * docs_) continue;
+    if (acc.empty()) acc.assign(docs_, 0.f);
+    double idf = std::log(1.0 + (docs_ - df + 0.5) / (df + 0.5));
+    const uint8_t* p = (const uint8_t*)base_ + off;
+    const uint8_t* end = p + len;
+    uint32_t doc = 0;
+    while (p < end) {
+      doc += getVarint(p, end);
+      uint32_t tf = getVarint(p, end);
+      if (doc >= docs_) break;
+      if (allow && ((doc >> 6) >= allow->size() || !(((*allow)[doc >> 6] >> (doc & 63)) & 1))) continue;
+      double norm = kK1 * (1 - kB + kB * (avgdl_ > 0 ? doclen[doc] / avgdl_ : 1));
+      if (acc[doc] == 0.f) touched.push_back(doc);
+      acc[doc] += (float)(idf * tf * (kK1 + 1) / (tf + norm));
+    }
+  }
+  out.reserve(touched.size());
+  for (uint32_t d : touched) out.push_back({acc[d], d});
+  size_t keep = std::min(k, out.size());
+  std::partial_sort(out.begin(), out.begin() + keep, out.end(),
+                    [](const std::pair<double,size_t>& a, const std::pair<double,size_t>& b) { return a.first > b.first; });
+  out.resize(keep);
+  return out;
+}
+
+std::vector<std::pair<double,size_t>> fuse_rrf(const std::vector<std::vector<std::pair<double,size_t>>>& lists,
+                                               size_t k, double c) {
+  std::unordered_map<size_t, double> score;
+  for (const auto& l : lists)
+    for (size_t r = 0; r < l.size(); ++r) score[l[r].second] += 1.0 / (c + r + 1);
+  std::vector<std::pair<double,size_t>> out;
+  out.reserve(score.size());
+  for (auto& kv : score) out.push_back({kv.second, kv.first});
+  size_t keep = std::min(k, out.size());
+  // Ties (same ranks in different lists) go to the lower chunk index, for stable output
+  std::partial_sort(out.begin(), out.begin() + keep, out.end(),
+                    [](const std::pair<double,size_t>& a, const std::pair<double,size_t>& b) {
+                      return a.first != b.first ? a.first > b.first : a.second < b.second;
+                    });
+  out.resize(keep);
+  return out;
+}
+
+} // namespace rag_lexical
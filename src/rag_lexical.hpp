@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "rag_session.hpp"
+
+// BM25 keyword index over a session's chunks, built at ingest and stored as
+// lexical.bin next to index.json. Catches what embeddings blur: identifiers,
+// error codes, part numbers.
+//
+// File layout (native byte order, all offsets from the start):
+//   header    magic "RAGLEX01", docs, terms, avgdl, section offsets
+//   doclen    u32 per chunk: tokens in the chunk
+//   terms     fixed 24-byte records sorted by term (binary search):
+//             string offset/length, document frequency, postings offset/length
+//   strings   the term bytes
+//   postings  per term: varint(doc - previous doc), varint(tf) pairs
+// Opened files are memory-mapped; only the pages a query touches are read.
+namespace rag_lexical {
+
+// Lowercased ASCII words: runs of letters, digits, '_' and UTF-8 bytes.
+// Words joined by '-', '.', '/' or ':' (one or two of them, e.g. ERR-042,
+// v1.2.3, std::vector, src/main.cpp) are also emitted whole. Words over 64
+// bytes are dropped.
+void tokenize(std::string_view text, std::vector<std::string>& out);
+
+class Index {
+public:
+  static std::shared_ptr<const Index> build(const SessionIndex& idx);
+  // nullptr (and error set) if the file is missing, damaged or not an index
+  static std::shared_ptr<const Index> open(const std::string& path, std::string* error=nullptr);
+  ~Index();
+  Index(const Index&) = delete;
+  Index& operator=(const Index&) = delete;
+
+  // Writes atomically (temporary file + rename)
+  bool save(const std::string& path) const;
+
+  size_t docs() const { return docs_; }
+  size_t terms() const { return terms_; }
+  size_t bytes() const { return size_; }
+  bool mapped() const { return map_ != nullptr; }
+
+  // Best k chunks by BM25 (k1 1.2, b 0.75), best first; chunks matching no term are left out.
+  // allow: optional chunk bitmap (ChunkFilter::bitmap); chunks whose bit is clear are skipped.
+  // max_df: query terms found in more than this fraction of the chunks (stopwords such as
+  // "the" or "return") are ignored; 1 keeps every term.
+  std::vector<std::pair<double,size_t>> search(const std::string& query, size_t k,
+                                               const std::vector<uint64_t>* allow=nullptr,
+                                               double max_df=1.0) const;
+
+private:
+  Index() = default;
+  bool attach(const char* base, size_t size, std::string* error);
+  bool findTerm(const std::string& term, uint32_t& df, uint64_t& off, uint32_t& len) const;
+
+  std::string owned_;          // built in memory
+  void* map_ = nullptr;        // or mapped from a file
+  const char* base_ = nullptr;
+  size_t size_ = 0;
+  size_t docs_ = 0, terms_ = 0;
+  double avgdl_ = 0;
+  uint64_t doclen_off_ = 0, terms_off_ = 0, strings_off_ = 0, postings_off_ = 0;
+};
+
+// Reciprocal rank fusion: each list adds 1 / (c + rank) for the chunks it
+// ranks (rank from 1). Returns the best k, best first, with the fused score.
+std::vector<std::pair<double,size_t>> fuse_rrf(const std::vector<std::vector<std::pair<double,size_t>>>& lists,
+                                               size_t k, double c=60);
+
+} // namespace rag_lexical
@@ -0,0 +1,73 @@
+#include "rag_quant.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace rag_quant {
+
+static float quantize(const float* x, size_t dim, int8_t* out) {
+  float mx = 0;
+  for (size_t i = 0; i < dim; ++i) mx = std::max(mx, std::fabs(x[i]));
+  float scale = mx > 0 ? mx / 127.f : 1.f;
+  for (size_t i = 0; i < dim; ++i) out[i] = (int8_t)std::lrint(x[i] / scale);
+  return scale;
+}
+
+Int8Index build(const SessionIndex& idx) {
+  Int8Index q8;
+  q8.dim = idx.dim;
+  size_t n = idx.size(), dim = q8.dim;
+  q8.codes.assign(n * dim, 0);
+  q8.scale.assign(n, 0.f);
+  q8.norm.assign(n, 0.f);
+  for (size_t i = 0; i < n; ++i) {
+    const float* e = idx.row(i);
+    double nn = 0;
+    for (size_t d = 0; d < dim; ++d) nn += (double)e[d] * e[d];
+    if (nn == 0) continue;   // chunk without an embedding: norm 0 marks it unusable
+    q8.norm[i] = (float)std::sqrt(nn);
+    q8.scale[i] = quantize(e, dim, &q8.codes[i * dim]);
+  }
+  return q8;
+}
+
+// Plain loop over int8 pairs; the compiler vectorizes it at -O2 and above.
+static int32_t dot8(const int8_t* a, const int8_t* b, size_t n) {
+  int32_t s = 0;
+  for (size_t i = 0; i < n; ++i) s += (int32_t)a[i] * b[i];
+  return s;
+}
+
+std::vector<std::pair<double,size_t>> top_k(const Int8Index& q8, const SessionIndex& idx, const std::vector<float>& q,
+                                            int k, double thr, size_t candidates) {
+  std::vector<std::pair<double,size_t>> sc;
+  size_t dim = q8.dim, n = q8.size();
+  if (dim == 0 || q.size() != dim) return sc;
+  std::vector<int8_t> qc(dim);
+  float qs = quantize(q.data(), dim, qc.data());
+  double qn = 0;
+  for (float x : q) qn += (double)x * x;
+  qn = std::sqrt(qn);
+  if (qn == 0) return sc;
+
+  sc.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    double s = q8.norm[i] > 0 ? (double)dot8(&q8.codes[i * dim], qc.data(), dim) * q8.scale[i] * qs / (q8.norm[i] * qn) : -1.0;
+    sc.push_back({s, i});
+  }
+  size_t want = (size_t)std::max(k, 1);
+  auto better = [](const std::pair<double,size_t>& a, const std::pair<double,size_t>& b) { return a.first > b.first; };
+  if (candidates > want && candidates < sc.size()) {
+    std::nth_element(sc.begin(), sc.begin() + candidates, sc.end(), better);
+    sc.resize(candidates);
+  }
+  if (candidates > want) {
+    for (auto& p : sc) p.first = RAGSessionManager::cosine(q.data(), idx.row(p.second), dim);
+  }
+  size_t keep = std::min(want, sc.size());
+  std::partial_sort(sc.begin(), sc.begin() + keep, sc.end(), better);
+  sc.resize(keep);
+  while (!sc.empty() && sc.back().first < thr) sc.pop_back();
+  return sc;
+}
+
+} // namespace rag_quant
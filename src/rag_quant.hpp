@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "rag_session.hpp"
+
+// Int8-quantized copy of a session's embeddings for a cheaper first-pass scan.
+// Each vector is scaled by its own max |x| to -127..127; a query is quantized
+// the same way and scored with integer dot products. Not used by answer():
+// examples/rag_eval.cpp measures its recall against the exact scan first.
+namespace rag_quant {
+
+struct Int8Index {
+  size_t dim = 0;
+  std::vector<int8_t> codes;   // chunks x dim, row-major
+  std::vector<float> scale;    // per chunk: max|x| / 127
+  std::vector<float> norm;     // per chunk: L2 norm of the original vector
+  size_t size() const { return scale.size(); }
+  size_t bytes() const { return codes.size() + (scale.size() + norm.size()) * sizeof(float); }
+};
+
+// Chunks whose embedding is empty or of another dimension score -1.
+Int8Index build(const SessionIndex& idx);
+
+// Top k by quantized cosine. With candidates > k, that many are re-scored
+// with the exact float cosine first (needs idx); candidates 0 skips it.
+// Same contract as RAGSessionManager::top_k: best first, scores >= threshold.
+std::vector<std::pair<double,size_t>> top_k(const Int8Index& q8, const SessionIndex& idx, const std::vector<float>& q,
+                                            int k, double score_threshold, size_t candidates=0);
+
+} // namespace rag_quant
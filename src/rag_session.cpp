@@ -7,7 +7,15 @@
 #include <algorithm>
 #include <numeric>
 #include <chrono>
+#include <ctime>
+#include <unordered_map>
 #include <curl/curl.h>
+#include "perf_stats.h"
+#include "rag_trace.hpp"
+#include "rag_lexical.hpp"
+#include "rag_store.hpp"
+#include "ollama_stream.hpp"
+#include "cancel.h"
 #include <poppler-document.h>
 #include <poppler-page.h>
 #include <poppler-page-renderer.h>
@@ -15,20 +23,44 @@
 using json = nlohmann::json;
 namespace fs=std::filesystem;
 RAGSessionManager::RAGSessionManager(std::string b,std::string u,std::string e,std::string l):base_dir_(b),ollama_url_(u),embed_model_(e),llm_model_(l){ fs::create_directories(b); }
-void RAGSessionManager::log(const std::string& s) const{ if(verbose_) std::cerr<<"[RAG] "<<s<<std::endl; }
-std::string RAGSessionManager::uuid4(){ static std::mt19937_64 g{std::random_device{}()}; auto r=[](){return (uint64_t)g();}; std::ostringstream o; o<<std::hex<<r()<<r(); auto s=o.str(); if(s.size()<32)s.append(32-s.size(),'0'); return s.substr(0,32); }
+static thread_local IngestProgress* t_progress=nullptr; // set while an ingest with progress runs on this thread
+void RAGSessionManager::log(const std::string& s) const{ if(t_progress){ t_progress->set_message(s); return; } if(verbose_) std::cerr<<"[RAG] "<<s<<std::endl; }
+std::string RAGSessionManager::uuid4(){ thread_local std::mt19937_64 g{std::random_device{}()}; auto r=[](){return (uint64_t)g();}; std::ostringstream o; o<<std::hex<<r()<<r(); auto s=o.str(); if(s.size()<32)s.append(32-s.size(),'0'); return s.substr(0,32); }
 std::vector<std::string> RAGSessionManager::findPDFs(const std::string& f){ std::vector<std::string> v; for(auto&p:fs::recursive_directory_iterator(f)){ if(p.is_regular_file() && p.path().extension()==".pdf") v.push_back(p.path().string()); } return v; }
-std::string RAGSessionManager::extract_text_poppler(const std::string& p){ std::unique_ptr<poppler::document> d(poppler::document::load_from_file(p)); if(!d) return {}; std::string t; for(int i=0;i<d->pages();++i){ std::unique_ptr<poppler::page> pg(d->create_page(i)); if(!pg) continue; auto ba=pg->text().to_utf8(); t.append(ba.begin(), ba.end()); t+='\n'; } return t; }
-static void img_to_gray(const poppler::image& img, std::vector<unsigned char>& gray){ int w=img.width(), h=img.height(); gray.resize((size_t)w*h); auto*src=(const unsigned char*)img.const_data(); int stride=img.bytes_per_row(); if(img.format()==poppler::image::format_argb32){ for(int y=0;y<h;++y){ auto*row=src+y*stride; for(int x=0;x<w;++x){ auto*p=row+x*4; unsigned char b=p[0],g=p[1],r=p[2]; gray[(size_t)y*w+x]=(unsigned char)(0.299*r+0.587*g+0.114*b); } } } else if(img.format()==poppler::image::format_rgb24){ for(int y=0;y<h;++y){ auto*row=src+y*stride; for(int x=0;x<w;++x){ auto*p=row+x*3; unsigned char b=p[0],g=p[1],r=p[2]; gray[(size_t)y*w+x]=(unsigned char)(0.299*r+0.587*g+0.114*b); } } } else { for(int y=0;y<h;++y){ auto*row=src+y*stride; std::copy(row,row+w,gray.begin()+(size_t)y*w); } } }
-std::string RAGSessionManager::ocr_pdf_with_poppler_tesseract(const std::string& p,int dpi){ std::unique_ptr<poppler::document> d(poppler::document::load_from_file(p)); if(!d) return {}; tesseract::TessBaseAPI api; if(api.Init(nullptr,"eng")) return {}; api.SetPageSegMode(tesseract::PSM_AUTO); poppler::page_renderer r; r.set_render_hint(poppler::page_renderer::antialiasing,true); r.set_render_hint(poppler::page_renderer::text_antialiasing,true); std::string out; for(int i=0;i<d->pages();++i){ std::unique_ptr<poppler::page> pg(d->create_page(i)); if(!pg) continue; auto img=r.render_page(pg.get(),dpi,dpi); if(!img.is_valid()) continue; std::vector<unsigned char> g; img_to_gray(img,g); api.SetImage(g.data(), img.width(), img.height(), 1, img.width()); char* txt=api.GetUTF8Text(); if(txt){ out+=txt; delete [] txt; } out+='\n'; } api.End(); return out; }
-std::vector<std::string> RAGSessionManager::split_chunks(const std::string& s,size_t n,size_t o){ std::vector<std::string> c; if(s.empty()) return c; size_t i=0; while(i<s.size()){ size_t e=std::min(i+n,s.size()); c.emplace_back(s.substr(i,e-i)); if(e==s.size()) break; i=e-std::min(o,e); } return c; }
+std::string RAGSessionManager::extract_text_poppler(const std::string& p,std::vector<size_t>* ps){ std::unique_ptr<poppler::document> d(poppler::document::load_from_file(p)); if(!d) return {}; std::string t; for(int i=0;i<d->pages();++i){ if(ps) ps->push_back(t.size()); rag_trace::Span sp("page","ingest"); sp.arg("page",i); std::unique_ptr<poppler::page> pg(d->create_page(i)); if(!pg) continue; auto ba=pg->text().to_utf8(); t.append(ba.begin(), ba.end()); t+='\n'; } return t; }
+void RAGSessionManager::gray_from_pixels(const unsigned char* src,int w,int h,int stride,int bpp,std::vector<unsigned char>& gray){ gray.resize((size_t)w*h); if(bpp==4||bpp==3){ for(int y=0;y<h;++y){ auto*row=src+(size_t)y*stride; for(int x=0;x<w;++x){ auto*p=row+x*bpp; unsigned char b=p[0],g=p[1],r=p[2]; gray[(size_t)y*w+x]=(unsigned char)(0.299*r+0.587*g+0.114*b); } } } else { for(int y=0;y<h;++y){ auto*row=src+(size_t)y*stride; std::copy(row,row+w,gray.begin()+(size_t)y*w); } } }
+static void img_to_gray(const poppler::image& img, std::vector<unsigned char>& gray){ int bpp=img.format()==poppler::image::format_argb32?4:img.format()==poppler::image::format_rgb24?3:1; RAGSessionManager::gray_from_pixels((const unsigned char*)img.const_data(),img.width(),img.height(),img.bytes_per_row(),bpp,gray); }
+std::string RAGSessionManager::ocr_pdf_with_poppler_tesseract(const std::string& p,int dpi,std::vector<size_t>* ps){ std::unique_ptr<poppler::document> d(poppler::document::load_from_file(p)); if(!d) return {}; tesseract::TessBaseAPI api; if(api.Init(nullptr,"eng")) return {}; api.SetPageSegMode(tesseract::PSM_AUTO); poppler::page_renderer r; r.set_render_hint(poppler::page_renderer::antialiasing,true); r.set_render_hint(poppler::page_renderer::text_antialiasing,true); std::string out; for(int i=0;i<d->pages();++i){ if(ps) ps->push_back(out.size()); rag_trace::Span sp("ocr_page","ingest"); sp.arg("page",i); std::unique_ptr<poppler::page> pg(d->create_page(i)); if(!pg) continue; auto img=r.render_page(pg.get(),dpi,dpi); if(!img.is_valid()) continue; std::vector<unsigned char> g; img_to_gray(img,g); api.SetImage(g.data(), img.width(), img.height(), 1, img.width()); char* txt=api.GetUTF8Text(); if(txt){ out+=txt; delete [] txt; } out+='\n'; } api.End(); return out; }
+std::vector<std::pair<size_t,size_t>> RAGSessionManager::split_spans(size_t sz,size_t n,size_t o){ std::vector<std::pair<size_t,size_t>> c; size_t i=0; while(i<sz){ size_t e=std::min(i+n,sz); c.push_back({i,e}); if(e==sz) break; i=e-std::min(o,e); } return c; }
+std::vector<std::string> RAGSessionManager::split_chunks(const std::string& s,size_t n,size_t o){ std::vector<std::string> c; for(auto& sp:split_spans(s.size(),n,o)) c.emplace_back(s.substr(sp.first,sp.second-sp.first)); return c; }
 static size_t wr(void*ptr,size_t sz,size_t nm,void*ud){ ((std::string*)ud)->append((char*)ptr, sz*nm); return sz*nm; }
-std::vector<float> RAGSessionManager::embed(const std::string& t){ CURL* c=curl_easy_init(); if(!c) return {}; std::string url=ollama_url_+"/api/embeddings"; json payload={{"model",embed_model_},{"prompt",t}}; std::string resp; struct curl_slist* h=nullptr; h=curl_slist_append(h,"Content-Type: application/json"); curl_easy_setopt(c, CURLOPT_URL, url.c_str()); curl_easy_setopt(c, CURLOPT_HTTPHEADER, h); auto body=payload.dump(); curl_easy_setopt(c, CURLOPT_POSTFIELDS, body.c_str()); curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, wr); curl_easy_setopt(c, CURLOPT_WRITEDATA, &resp); CURLcode rc=curl_easy_perform(c); curl_slist_free_all(h); curl_easy_cleanup(c); if(rc!=CURLE_OK) return {}; auto j=json::parse(resp, nullptr, false); if(!j.is_object()||!j.contains("embedding")) return {}; return j["embedding"].get<std::vector<float>>(); }
-std::string RAGSessionManager::ollama_chat(const std::string& p){ CURL* c=curl_easy_init(); if(!c) return {}; std::string url=ollama_url_+"/api/chat"; json payload={{"model",llm_model_},{"messages",json::array({json{{"role","system"},{"content","You are a helpful assistant. Answer ONLY with the final answer. Do NOT include chain-of-thought, analysis, or <think> tags."}}, json{{"role","user"},{"content",p}}})},{"stream",false}}; std::string resp; struct curl_slist* h=nullptr; h=curl_slist_append(h,"Content-Type: application/json"); curl_easy_setopt(c, CURLOPT_URL, url.c_str()); curl_easy_setopt(c, CURLOPT_HTTPHEADER, h); auto body=payload.dump(); curl_easy_setopt(c, CURLOPT_POSTFIELDS, body.c_str()); curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, wr); curl_easy_setopt(c, CURLOPT_WRITEDATA, &resp); CURLcode rc=curl_easy_perform(c); curl_slist_free_all(h); curl_easy_cleanup(c); if(rc!=CURLE_OK) return {}; auto j=json::parse(resp, nullptr, false); if(!j.is_object()||!j.contains("message")||!j["message"].contains("content")) return {}; std::string out=j["message"]["content"].get<std::string>(); auto a=out.find("<think>"), b=out.find("</think>"); if(a!=std::string::npos && b!=std::string::npos && b>a) out.erase(a,(b+8)-a); while((a=out.find("<think>"))!=std::string::npos) out.erase(a,7); while((a=out.find("</think>"))!=std::string::npos) out.erase(a,8); while(!out.empty() && isspace((unsigned char)out.back())) out.pop_back(); size_t i=0; while(i<out.size() && isspace((unsigned char)out[i])) ++i; return out.substr(i); }
+std::vector<float> RAGSessionManager::embed(const std::string& t){ rag_trace::Span sp("http.embed","http"); RequestTimer tm("embed",embed_model_); CURL* c=curl_easy_init(); if(!c) return {}; std::string url=ollama_url_+"/api/embeddings"; json payload={{"model",embed_model_},{"prompt",t}}; std::string resp; struct curl_slist* h=nullptr; h=curl_slist_append(h,"Content-Type: application/json"); curl_easy_setopt(c, CURLOPT_URL, url.c_str()); curl_easy_setopt(c, CURLOPT_HTTPHEADER, h); auto body=payload.dump(); curl_easy_setopt(c, CURLOPT_POSTFIELDS, body.c_str()); curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, wr); curl_easy_setopt(c, CURLOPT_WRITEDATA, &resp); cancel::ApplyToCurl(c); tm.started(); CURLcode rc=curl_easy_perform(c); auto j=json::parse(resp, nullptr, false); bool ok=rc==CURLE_OK && j.is_object() && j.contains("embedding"); if(ok){ tm.token(); tm.timing().prompt_eval_count=j.value("prompt_eval_count",-1LL); } tm.finish(c,ok); curl_slist_free_all(h); curl_easy_cleanup(c); if(!ok) return {}; return j["embedding"].get<std::vector<float>>(); }
+static size_t wr_stream(void*ptr,size_t sz,size_t nm,void*ud){ ((OllamaStreamParser*)ud)->feed((char*)ptr, sz*nm); return sz*nm; }
+std::string RAGSessionManager::ollama_chat(const std::string& p,const TokenCallback& on_token){ rag_trace::Span sp("http.chat","http"); RequestTimer tm("rag_chat",llm_model_); CURL* c=curl_easy_init(); if(!c) return {}; std::string url=ollama_url_+"/api/chat"; json payload={{"model",llm_model_},{"messages",json::array({json{{"role","system"},{"content","You are a helpful assistant. Answer ONLY with the final answer. Do NOT include chain-of-thought, analysis, or <think> tags."}}, json{{"role","user"},{"content",p}}})},{"stream",true}}; std::string out; ThinkFilter think; auto emit=[&](const std::string& t){ if(t.empty()) return; out+=t; if(on_token) on_token(t); }; OllamaStreamParser ps; ps.on_content=[&](const std::string& t){ auto v=think.push(t); if(!v.empty()) tm.token(); emit(v); }; ps.on_done=[&](const json& j){ auto& r=tm.timing(); r.prompt_eval_count=j.value("prompt_eval_count",-1LL); r.prompt_eval_duration_ns=j.value("prompt_eval_duration",-1LL); r.eval_count=j.value("eval_count",-1LL); r.eval_duration_ns=j.value("eval_duration",-1LL); }; struct curl_slist* h=nullptr; h=curl_slist_append(h,"Content-Type: application/json"); curl_easy_setopt(c, CURLOPT_URL, url.c_str()); curl_easy_setopt(c, CURLOPT_HTTPHEADER, h); curl_easy_setopt(c, CURLOPT_TCP_NODELAY, 1L); auto body=payload.dump(); curl_easy_setopt(c, CURLOPT_POSTFIELDS, body.c_str()); curl_easy_setopt(c, CURLOPT_WRITEFUNCTION, wr_stream); curl_easy_setopt(c, CURLOPT_WRITEDATA, &ps); cancel::ApplyToCurl(c); tm.started(); CURLcode rc=curl_easy_perform(c); ps.finish(); bool ok=rc==CURLE_OK && ps.done() && ps.error().empty(); tm.finish(c,ok); curl_slist_free_all(h); curl_easy_cleanup(c); if(rc!=CURLE_OK || !ps.error().empty()) return {}; emit(think.flush()); return out; }
 std::string RAGSessionManager::sessionDir(const std::string& sid) const{ return (fs::path(base_dir_)/sid).string(); }
-void RAGSessionManager::save_index(const SessionIndex& idx) const{ fs::create_directories(sessionDir(idx.session_id)); std::ofstream ofs(fs::path(sessionDir(idx.session_id))/ "index.json"); json j; j["session_id"]=idx.session_id; j["chunks"]=json::array(); for(auto&c:idx.chunks){ j["chunks"].push_back({{"id",c.id},{"text",c.text},{"embedding",c.embedding}});} ofs<<j.dump(2); }
-std::optional<SessionIndex> RAGSessionManager::load_index(const std::string& sid) const{ auto p=fs::path(sessionDir(sid))/ "index.json"; if(!fs::exists(p)) return std::nullopt; std::ifstream ifs(p); json j; ifs>>j; SessionIndex idx; idx.session_id=j.value("session_id",sid); for(auto&cj:j["chunks"]){ Chunk c; c.id=cj.value("id",""); c.text=cj.value("text",""); c.embedding=cj.value("embedding", std::vector<float>{}); idx.chunks.push_back(std::move(c)); } return idx; }
-double RAGSessionManager::cosine(const std::vector<float>& a,const std::vector<float>& b){ if(a.size()!=b.size()||a.empty()) return -1.0; double dot=0,na=0,nb=0; for(size_t i=0;i<a.size();++i){ dot+=a[i]*b[i]; na+=a[i]*a[i]; nb+=b[i]*b[i]; } if(na==0||nb==0) return -1.0; return dot/(std::sqrt(na)*std::sqrt(nb)); }
+void RAGSessionManager::save_index(const SessionIndex& idx) const{ rag_trace::Span sp("save_index"); sp.arg("chunks",(long long)idx.size()); auto dir=fs::path(sessionDir(idx.session_id)); fs::create_directories(dir); { rag_trace::Span sp2("save_embeddings"); if(!rag_store::write_embeddings((dir/"embeddings.bin").string(),idx)) throw std::runtime_error("Could not write embeddings for "+idx.session_id); } { rag_trace::Span sp2("save_text"); if(!rag_store::write_text((dir/"text.bin").string(),idx)) throw std::runtime_error("Could not write chunk texts for "+idx.session_id); } json j; j["session_id"]=idx.session_id; j["version"]=2; j["files"]=json::array(); for(auto& f:idx.files) j["files"].push_back(f.path); j["columns"]={{"file",idx.file_id},{"ordinal",idx.ordinal},{"header",idx.file_header},{"page",idx.page},{"begin",idx.byte_begin},{"end",idx.byte_end},{"time",idx.ingested}}; { rag_trace::Span lx("save_lexical"); if(!rag_lexical::Index::build(idx)->save((dir/"lexical.bin").string())) log("Could not write lexical index for "+idx.session_id); } if(!rag_store::write_file((dir/"index.json").string(),j.dump())) throw std::runtime_error("Could not write index for "+idx.session_id); }
+std::optional<SessionIndex> RAGSessionManager::load_index(const std::string& sid) const{ rag_trace::Span sp("load_index"); auto p=fs::path(sessionDir(sid))/ "index.json"; if(!fs::exists(p)) return std::nullopt; std::ifstream ifs(p); json j; ifs>>j; SessionIndex idx; idx.session_id=j.value("session_id",sid); if(j.value("version",1)>=2){ if(!load_columns(j,idx)) return std::nullopt; idx.lexical=lexical_for(idx); return idx; } if(j.contains("files")) for(auto& f:j["files"]) idx.add_file(f.get<std::string>()); std::error_code ec; auto mt=fs::last_write_time(p,ec); int64_t when=ec?0:(int64_t)std::chrono::duration_cast<std::chrono::seconds>((mt-fs::file_time_type::clock::now()+std::chrono::system_clock::now()).time_since_epoch()).count(); idx.reserve(j["chunks"].size()); Chunk c; for(auto&cj:j["chunks"]){ c.id=cj.value("id",""); c.text=cj.value("text",""); c.embedding=cj.value("embedding", std::vector<float>{}); uint32_t fid=cj.value("file",0u); if(cj.contains("file") && fid<idx.files.size() && c.id.compare(0,idx.files[fid].path.size(),idx.files[fid].path)==0) idx.add_chunk(c,fid,cj.value("page",0u),cj.value("begin",(uint64_t)0),cj.value("end",(uint64_t)0),cj.value("time",(int64_t)0)); else idx.add_chunk(c,when); } idx.lexical=lexical_for(idx); return idx; }
+// index.json version 2: metadata columns; embeddings and texts in their own files (rag_store.hpp)
+bool RAGSessionManager::load_columns(const json& j,SessionIndex& idx) const{ auto dir=fs::path(sessionDir(idx.session_id)); for(auto& f:j.value("files",json::array())) idx.add_file(f.get<std::string>()); const json& c=j.at("columns"); idx.file_id=c.at("file").get<std::vector<uint32_t>>(); size_t n=idx.file_id.size(); idx.ordinal=c.at("ordinal").get<std::vector<uint32_t>>(); idx.file_header=c.at("header").get<std::vector<uint8_t>>(); idx.page=c.at("page").get<std::vector<uint32_t>>(); idx.byte_begin=c.at("begin").get<std::vector<uint64_t>>(); idx.byte_end=c.at("end").get<std::vector<uint64_t>>(); idx.ingested=c.at("time").get<std::vector<int64_t>>(); std::string err; bool ok=idx.ordinal.size()==n && idx.file_header.size()==n && idx.page.size()==n && idx.byte_begin.size()==n && idx.byte_end.size()==n && idx.ingested.size()==n && std::all_of(idx.file_id.begin(),idx.file_id.end(),[&](uint32_t f){ return f<idx.files.size(); }); if(!ok) err="inconsistent index.json"; else ok=rag_store::read_embeddings((dir/"embeddings.bin").string(),n,idx,&err); if(ok){ idx.text_blob=rag_store::TextBlob::open((dir/"text.bin").string(),&err); ok=idx.text_blob && idx.text_blob->chunks()==n; if(idx.text_blob && !ok) err="text.bin does not match index.json"; } if(!ok){ log("Cannot load session "+idx.session_id+": "+err); return false; } for(uint32_t f:idx.file_id) ++idx.files[f].chunks; return true; }
+// "path#n" -> path length and n; ids without a plain decimal suffix are all path
+static size_t split_id(const std::string& id,uint32_t& ord){ ord=SessionIndex::kNoOrdinal; auto h=id.rfind('#'); if(h==std::string::npos||h+1==id.size()||id.size()-h-1>9||(id[h+1]=='0'&&id.size()-h-1>1)) return id.size(); uint32_t n=0; for(size_t i=h+1;i<id.size();++i){ if(id[i]<'0'||id[i]>'9') return id.size(); n=n*10+(uint32_t)(id[i]-'0'); } ord=n; return h; }
+uint32_t SessionIndex::add_file(const std::string& p){ auto it=file_index_.find(p); if(it!=file_index_.end()) return it->second; FileInfo f; f.path=p; auto slash=p.find_last_of('/'), dot=p.find_last_of('.'); if(dot!=std::string::npos && (slash==std::string::npos || dot>slash)){ f.ext=p.substr(dot); for(auto& c:f.ext) c=(char)tolower((unsigned char)c); } files.push_back(std::move(f)); return file_index_[p]=(uint32_t)(files.size()-1); }
+void SessionIndex::add_chunk(const Chunk& c,uint32_t file,uint32_t pg,uint64_t begin,uint64_t end,int64_t when){ if(text_blob) load_text(); size_t n=size(); const std::string& p=files[file].path; uint32_t ord; size_t plen=split_id(c.id,ord); if(plen!=p.size()) ord=kNoOrdinal; std::string_view t(c.text); bool hdr=t.size()>=p.size()+7 && t.compare(0,6,"FILE: ")==0 && t.compare(6,p.size(),p)==0 && t[6+p.size()]=='\n'; if(hdr) t.remove_prefix(p.size()+7); text_arena.append(t.data(),t.size()); text_off.push_back(text_arena.size()); if(dim==0 && !c.embedding.empty()){ dim=c.embedding.size(); embeddings.assign(n*dim,0.f); } embeddings.resize((n+1)*dim,0.f); if(c.embedding.size()==dim) std::copy(c.embedding.begin(),c.embedding.end(),embeddings.begin()+n*dim); file_id.push_back(file); ordinal.push_back(ord); page.push_back(pg); file_header.push_back(hdr?1:0); byte_begin.push_back(begin); byte_end.push_back(end); ingested.push_back(when); ++files[file].chunks; }
+void SessionIndex::add_chunk(const Chunk& c,int64_t when){ uint32_t ord; size_t plen=split_id(c.id,ord); add_chunk(c,add_file(c.id.substr(0,plen)),0,0,0,when); }
+void SessionIndex::reserve(size_t n,size_t text_bytes){ text_arena.reserve(text_bytes); text_off.reserve(n+1); for(auto* v:{&file_id,&ordinal,&page}) v->reserve(n); file_header.reserve(n); byte_begin.reserve(n); byte_end.reserve(n); ingested.reserve(n); }
+std::string SessionIndex::body(size_t i) const{ if(text_blob) return text_blob->text(i); return text_arena.substr(text_off[i],text_off[i+1]-text_off[i]); }
+void SessionIndex::load_text(){ if(!text_blob) return; auto b=std::move(text_blob); text_blob.reset(); text_arena.clear(); text_arena.reserve(b->raw_bytes()); text_off.assign(1,0); text_off.reserve(size()+1); for(size_t i=0;i<size();++i){ text_arena+=b->text(i); text_off.push_back(text_arena.size()); } }
+std::string ChunkView::id() const{ std::string s(path); if(ordinal!=SessionIndex::kNoOrdinal){ s+='#'; s+=std::to_string(ordinal); } return s; }
+std::string ChunkView::text() const{ if(!file_header) return std::string(body); std::string s; s.reserve(path.size()+7+body.size()); s+="FILE: "; s+=path; s+='\n'; s+=body; return s; }
+Chunk ChunkView::to_chunk() const{ return {id(),text(),std::vector<float>(embedding,embedding+dim)}; }
+std::vector<std::pair<double,size_t>> RAGSessionManager::prefiltered_top_k(const SessionIndex& idx,const std::vector<std::pair<double,size_t>>& keyword,const std::vector<float>& q,int k,double thr,size_t min_candidates,bool* fell_back,const std::vector<size_t>* subset){ bool fb=keyword.size()<min_candidates; if(fell_back) *fell_back=fb; if(fb) return top_k(idx,q,k,thr,subset); std::vector<size_t> ids; ids.reserve(keyword.size()); for(auto& h:keyword) ids.push_back(h.second); return top_k(idx,q,k,thr,&ids); }
+std::shared_ptr<const rag_lexical::Index> RAGSessionManager::lexical_for(const SessionIndex& idx) const{ rag_trace::Span sp("load_lexical"); auto p=(fs::path(sessionDir(idx.session_id))/"lexical.bin").string(); auto lx=rag_lexical::Index::open(p); if(lx && lx->docs()==idx.size()) return lx; lx=rag_lexical::Index::build(idx); if(fs::exists(sessionDir(idx.session_id))) lx->save(p); return lx; }
+double RAGSessionManager::cosine(const std::vector<float>& a,const std::vector<float>& b){ if(a.size()!=b.size()) return -1.0; return cosine(a.data(),b.data(),a.size()); }
+double RAGSessionManager::cosine(const float* a,const float* b,size_t n){ if(n==0) return -1.0; double dot=0,na=0,nb=0; for(size_t i=0;i<n;++i){ dot+=a[i]*b[i]; na+=a[i]*a[i]; nb+=b[i]*b[i]; } if(na==0||nb==0) return -1.0; return dot/(std::sqrt(na)*std::sqrt(nb)); }
+std::vector<std::pair<double,size_t>> RAGSessionManager::top_k(const SessionIndex& idx,const std::vector<float>& q,int k,double thr,const std::vector<size_t>* subset){ std::vector<std::pair<double,size_t>> sc; { rag_trace::Span sp("score"); size_t n=subset?subset->size():idx.size(); sp.arg("chunks",(long long)n); sc.reserve(n); bool same=q.size()==idx.dim; for(size_t j=0;j<n;++j){ size_t i=subset?(*subset)[j]:j; sc.push_back({same?cosine(q.data(),idx.row(i),idx.dim):-1.0, i}); } } { rag_trace::Span sp("sort"); std::sort(sc.begin(), sc.end(), [](auto&a,auto&b){return a.first>b.first;}); } size_t n=0; while(n<sc.size() && n<(size_t)std::max(k,1) && sc[n].first>=thr) ++n; sc.resize(n); return sc; }
 std::string RAGSessionManager::build_prompt(const std::string& ctx,const std::string& q){ std::ostringstream o; o<<"Answer the question based only on the context.\n\nContext:\n"<<ctx<<"\n\nQuestion:\n"<<q<<"\n\nAnswer concisely and accurately in three sentences or less."; return o.str(); }
-std::string RAGSessionManager::createSessionFromFolder(const std::string& folder){ if(!fs::exists(folder)||!fs::is_directory(folder)) throw std::runtime_error("Folder does not exist: "+folder); log("Scanning PDFs in: "+folder); auto pdfs=findPDFs(folder); if(pdfs.empty()) throw std::runtime_error("No PDFs found in: "+folder); log("Found "+std::to_string(pdfs.size())+" PDF(s)."); SessionIndex idx; idx.session_id=uuid4(); size_t total_chunks=0; size_t n=0; for(auto& pdf: pdfs){ ++n; log("["+std::to_string(n)+"/"+std::to_string(pdfs.size())+"] Extracting text: "+pdf); auto t0=std::chrono::steady_clock::now(); auto text=extract_text_poppler(pdf); auto t1=std::chrono::steady_clock::now(); log("  Text extracted in "+std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count())+" ms."); if(text.size()<40){ log("  WARNING: Very little/no text extracted. Falling back to OCR via Poppler+Tesseract..."); auto o0=std::chrono::steady_clock::now(); auto ocr=ocr_pdf_with_poppler_tesseract(pdf,200); auto o1=std::chrono::steady_clock::now(); log("  OCR completed in "+std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(o1-o0).count())+" ms."); if(!ocr.empty()) text.swap(ocr); } auto chunks=split_chunks(text,1024,100); log("  Chunking: "+std::to_string(chunks.size())+" chunks."); total_chunks+=chunks.size(); size_t cnum=0; for(size_t i=0;i<chunks.size();++i){ ++cnum; if(cnum % 25 == 1 || cnum == chunks.size()) log("    Embedding chunk "+std::to_string(cnum)+"/"+std::to_string(chunks.size())); Chunk c; c.id=pdf+"#"+std::to_string(i); c.text=std::move(chunks[i]); c.embedding=embed(c.text); idx.chunks.push_back(std::move(c)); } } save_index(idx); log("Session ID: "+idx.session_id); return idx.session_id; }
-std::string RAGSessionManager::chat(const std::string& sid,const std::string& msg,int k,double thr){ auto opt=load_index(sid); if(!opt) return "Invalid or unknown session_id"; auto& idx=*opt; auto q=embed(msg); std::vector<std::pair<double,size_t>> sc; sc.reserve(idx.chunks.size()); for(size_t i=0;i<idx.chunks.size();++i) sc.push_back({cosine(q, idx.chunks[i].embedding), i}); std::sort(sc.begin(), sc.end(), [](auto&a,auto&b){return a.first>b.first;}); std::string ctx; int added=0; for(auto& p:sc){ if(p.first<thr) break; ctx+=idx.chunks[p.second].text+"\n\n"; if(++added>=k) break; } if(ctx.empty()) return "No relevant context found in the document to answer your question."; auto prompt=build_prompt(ctx,msg); return ollama_chat(prompt); }
+std::string RAGSessionManager::createSessionFromFolder(const std::string& folder,IngestProgress* progress){ struct ProgressBind{ IngestProgress* prev; explicit ProgressBind(IngestProgress* p):prev(t_progress){ t_progress=p; } ~ProgressBind(){ t_progress=prev; } } bind(progress); if(!fs::exists(folder)||!fs::is_directory(folder)) throw std::runtime_error("Folder does not exist: "+folder); log("Scanning PDFs in: "+folder); std::vector<std::string> pdfs; { rag_trace::Span sp("find_pdfs","ingest"); pdfs=findPDFs(folder); } if(pdfs.empty()) throw std::runtime_error("No PDFs found in: "+folder); log("Found "+std::to_string(pdfs.size())+" PDF(s)."); SessionIndex idx; idx.session_id=uuid4(); size_t total_chunks=0; size_t n=0; bool stop=false; for(auto& pdf: pdfs){ if(stop || cancel::Cancelled()){ stop=true; break; } ++n; rag_trace::Span fsp("file","ingest"); fsp.arg("path",pdf); log("["+std::to_string(n)+"/"+std::to_string(pdfs.size())+"] Extracting text: "+pdf); auto t0=std::chrono::steady_clock::now(); uint32_t fid=idx.add_file(pdf); std::vector<size_t> pages; std::string text; { rag_trace::Span sp("extract_text","ingest"); text=extract_text_poppler(pdf,&pages); } auto t1=std::chrono::steady_clock::now(); log("  Text extracted in "+std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(t1-t0).count())+" ms."); if(text.size()<40){ log("  WARNING: Very little/no text extracted. Falling back to OCR via Poppler+Tesseract..."); auto o0=std::chrono::steady_clock::now(); std::vector<size_t> ocr_pages; std::string ocr; { rag_trace::Span sp("ocr","ingest"); ocr=ocr_pdf_with_poppler_tesseract(pdf,200,&ocr_pages); } auto o1=std::chrono::steady_clock::now(); log("  OCR completed in "+std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(o1-o0).count())+" ms."); if(!ocr.empty()){ text.swap(ocr); pages.swap(ocr_pages); } } std::vector<std::string> chunks; std::vector<std::pair<size_t,size_t>> spans; { rag_trace::Span sp("chunk","ingest"); spans=split_spans(text.size(),1024,100); for(auto& s:spans) chunks.emplace_back(text.substr(s.first,s.second-s.first)); } log("  Chunking: "+std::to_string(chunks.size())+" chunks."); if(progress) progress->chunks_found+=chunks.size(); total_chunks+=chunks.size(); size_t cnum=0; std::optional<rag_trace::Span> batch; for(size_t i=0;i<chunks.size();++i){ if(i%kEmbedBatch==0){ batch.reset(); batch.emplace("embed_batch","ingest"); batch->arg("first_chunk",(long long)i); } ++cnum; if(cnum % kEmbedBatch == 1 || cnum == chunks.size()) log("    Embedding chunk "+std::to_string(cnum)+"/"+std::to_string(chunks.size())); Chunk c; c.id=pdf+"#"+std::to_string(i); c.text=std::move(chunks[i]); c.embedding=embed(c.text); if(cancel::Cancelled()){ stop=true; break; } uint32_t pg=(uint32_t)(std::upper_bound(pages.begin(),pages.end(),spans[i].first)-pages.begin()); idx.add_chunk(std::move(c),fid,pg,spans[i].first,spans[i].second,(int64_t)std::time(nullptr)); if(progress) ++progress->chunks_embedded; } if(progress && !stop){ ++progress->files_done; std::error_code ec; auto sz=fs::file_size(pdf,ec); if(!ec) progress->bytes_done+=sz; } } if(stop){ log("Cancelled: keeping "+std::to_string(idx.size())+" embedded chunk(s)."); if(idx.empty()) throw std::runtime_error("Cancelled"); } save_index(idx); log("Session ID: "+idx.session_id); return idx.session_id; }
+std::string RAGSessionManager::chat(const std::string& sid,const std::string& msg,int k,double thr,const TokenCallback& on_token){ auto opt=load_index(sid); if(!opt) return "Invalid or unknown session_id"; return chat(*opt,msg,k,thr,on_token); }
+std::string RAGSessionManager::chat(const SessionIndex& idx,const std::string& msg,int k,double thr,const TokenCallback& on_token){ auto r=answer(idx,msg,k,thr,on_token); if(!r.has_context) return "No relevant context found in the document to answer your question."; return r.answer; }
+static double ms_since(std::chrono::steady_clock::time_point t){ return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-t).count(); }
+ChatResult RAGSessionManager::answer(const SessionIndex& idx,const std::string& msg,int k,double thr,const TokenCallback& on_token,RetrievalMode m,const ChunkFilter& flt){ rag_trace::Span root("rag.chat"); ChatResult r; auto t=std::chrono::steady_clock::now(); PrefilterOptions pf=prefilter(); std::vector<uint64_t> allow; std::vector<size_t> allowed; const std::vector<uint64_t>* al=nullptr; const std::vector<size_t>* sub=nullptr; if(!flt.empty()){ rag_trace::Span sp("filter"); allow=flt.bitmap(idx); allowed=ChunkFilter::positions(allow,idx.size()); al=&allow; sub=&allowed; sp.arg("chunks",(long long)allowed.size()); if(allowed.empty()){ r.search_ms=ms_since(t); return r; } } size_t pool_n=sub?allowed.size():idx.size(); std::shared_ptr<const rag_lexical::Index> lx=idx.lexical; if(m!=RetrievalMode::Vector && !lx) lx=rag_lexical::Index::build(idx); bool use_pf=m!=RetrievalMode::Keyword && lx && pf.candidates>0 && pool_n>=pf.min_chunks; std::vector<float> q; if(m!=RetrievalMode::Keyword){ rag_trace::Span sp("embed_query"); q=embed(msg); } r.embed_ms=ms_since(t); if(cancel::Cancelled()) throw std::runtime_error("Cancelled"); t=std::chrono::steady_clock::now(); size_t kk=(size_t)std::max(k,1), pool=kk*4; std::vector<std::pair<double,size_t>> kw; if(m!=RetrievalMode::Vector || use_pf){ rag_trace::Span sp("bm25"); kw=use_pf?lx->search(msg,std::max(pf.candidates,pool),al,pf.max_df):lx->search(msg,pool,al); } auto vsearch=[&](size_t n){ if(!use_pf) return top_k(idx,q,(int)n,thr,sub); rag_trace::Span sp("prefilter"); bool fb=false; auto v=prefiltered_top_k(idx,kw,q,(int)n,thr,pf.min_candidates,&fb,sub); sp.arg("fallback",fb?1LL:0LL); return v; }; std::vector<std::pair<double,size_t>> sc; if(m==RetrievalMode::Vector) sc=vsearch(kk); else if(m==RetrievalMode::Keyword){ sc=kw; if(sc.size()>kk) sc.resize(kk); } else { auto vec=vsearch(pool); if(kw.size()>pool) kw.resize(pool); bool same=q.size()==idx.dim; auto cos=[&](size_t i){ return same?cosine(q.data(),idx.row(i),idx.dim):-1.0; }; rag_trace::Span sp("fuse"); std::vector<std::pair<double,size_t>> kwt; for(auto& h:kw) if(cos(h.second)>=thr) kwt.push_back(h); sc=rag_lexical::fuse_rrf({vec,kwt},kk); for(auto& p:sc) p.first=cos(p.second); } std::string ctx; { rag_trace::Span sp("build_context"); for(auto& p:sc){ auto c=idx.chunk(p.second); ctx+=c.text()+"\n\n"; r.hits.push_back({c.id(),p.first}); } sp.arg("hits",(long long)sc.size()); } r.search_ms=ms_since(t); if(ctx.empty()) return r; r.has_context=true; std::string prompt; { rag_trace::Span sp("build_prompt"); prompt=build_prompt(ctx,msg); } t=std::chrono::steady_clock::now(); { rag_trace::Span gen("generate"); r.answer=ollama_chat(prompt,on_token); } r.generate_ms=ms_since(t); return r; }
@@ -1,36 +1,184 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <cctype>
+#include <new>
+#include <string_view>
+#include <unordered_map>
 #include <optional>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <mutex>
 #include "json.hpp"
+#include "rag_filter.hpp"
 
 struct Chunk{ std::string id; std::string text; std::vector<float> embedding; };
-struct SessionIndex{ std::string session_id; std::vector<Chunk> chunks; };
+// Receives answer text as it streams in (after <think> filtering)
+using TokenCallback=std::function<void(const std::string&)>;
+
+// Live counters for a running ingest; written by the ingest thread, read by RAG_STATUS.
+struct IngestProgress{
+  std::atomic<size_t> files_total{0}, files_done{0};
+  std::atomic<size_t> chunks_found{0}, chunks_embedded{0};
+  std::atomic<uint64_t> bytes_total{0}, bytes_done{0};
+  void set_message(const std::string& m){ std::lock_guard<std::mutex> L(mtx_); message_=m; }
+  std::string message() const{ std::lock_guard<std::mutex> L(mtx_); return message_; }
+private:
+  mutable std::mutex mtx_;
+  std::string message_;
+};
+
+namespace rag_lexical{ class Index; }
+namespace rag_store{ class TextBlob; }
+// One source file of a session; chunks refer to it by position in SessionIndex::files.
+struct FileInfo{ std::string path; std::string ext; uint32_t chunks=0; };   // ext lowercased with the dot, "" if none
+
+// 64-byte aligned allocation, so every embedding row of a 16-float multiple starts on a cache line.
+template<class T> struct AlignedAlloc{
+  using value_type=T;
+  AlignedAlloc()=default;
+  template<class U> AlignedAlloc(const AlignedAlloc<U>&){}
+  T* allocate(size_t n){ return static_cast<T*>(::operator new(n*sizeof(T),std::align_val_t(64))); }
+  void deallocate(T* p,size_t){ ::operator delete(p,std::align_val_t(64)); }
+  template<class U> bool operator==(const AlignedAlloc<U>&) const{ return true; }
+  template<class U> bool operator!=(const AlignedAlloc<U>&) const{ return false; }
+};
+
+// Chunk i of a SessionIndex as the old Chunk struct saw it: path and embedding point into the
+// index and are valid while it is alive and not appended to; body is read on creation.
+struct ChunkView{
+  std::string_view path;
+  std::string body;
+  uint32_t ordinal;           // n of "path#n"; SessionIndex::kNoOrdinal if the id is just the path
+  bool file_header;           // text() prefixes "FILE: <path>\n"
+  const float* embedding; size_t dim;
+  std::string id() const;
+  std::string text() const;
+  Chunk to_chunk() const;
+};
+
+// A session's chunks as columns (structure of arrays), index-aligned:
+//   embeddings  one row-major matrix of size() x dim floats, 64-byte aligned; a chunk stored
+//               without an embedding (or with another width) has a zero row (cosine -1)
+//   text_arena  chunk bodies back to back, chunk i at [text_off[i], text_off[i+1]); the
+//               "FILE: <path>\n" header of code chunks is not stored, only flagged in file_header
+//   file_id -> files (paths interned once);  ordinal  n of the "path#n" id;
+//   page  1-based PDF page (0 = not a PDF/unknown);  byte_begin/end  span in the extracted text
+//   (PDF) or the file (code);  ingested  unix seconds.
+// Append only through add_chunk(), which keeps the columns aligned.
+// text_blob: set for sessions loaded from disk; texts are then read from text.bin on demand
+// (rag_store.hpp) and text_arena is empty until load_text().
+// lexical: BM25 index over the chunk texts (rag_lexical.hpp); attached by load_index
+struct SessionIndex{
+  static constexpr uint32_t kNoOrdinal=UINT32_MAX;
+  std::string session_id;
+  std::vector<FileInfo> files;
+  size_t dim=0;
+  std::vector<float,AlignedAlloc<float>> embeddings;
+  std::string text_arena;
+  std::vector<uint64_t> text_off{0};
+  std::vector<uint32_t> file_id, ordinal, page;
+  std::vector<uint8_t> file_header;
+  std::vector<uint64_t> byte_begin, byte_end;
+  std::vector<int64_t> ingested;
+  std::shared_ptr<const rag_lexical::Index> lexical;
+  std::shared_ptr<const rag_store::TextBlob> text_blob;
+
+  size_t size() const{ return file_id.size(); }
+  bool empty() const{ return file_id.empty(); }
+  const float* row(size_t i) const{ return embeddings.data()+i*dim; }
+  std::string body(size_t i) const;
+  const std::string& path(size_t i) const{ return files[file_id[i]].path; }
+  ChunkView chunk(size_t i) const{ return {path(i),body(i),ordinal[i],file_header[i]!=0,row(i),dim}; }
+  std::string id(size_t i) const{ return chunk(i).id(); }
+  std::string text(size_t i) const{ return chunk(i).text(); }
+
+  // Index of path in files, added if new
+  uint32_t add_file(const std::string& path);
+  // c.id must be files[file].path, optionally followed by "#n"; a leading "FILE: <path>\n" in c.text is
+  // stored as the flag only.
+  void add_chunk(const Chunk& c,uint32_t file,uint32_t pg,uint64_t begin,uint64_t end,int64_t when);
+  // Same, with the file interned from the id's path and no page/span
+  void add_chunk(const Chunk& c,int64_t when=0);
+  void reserve(size_t chunks,size_t text_bytes=0);
+  // Reads every text into text_arena and drops text_blob (add_chunk does this first)
+  void load_text();
+private:
+  std::unordered_map<std::string,uint32_t> file_index_;
+};
+
+// How answer() picks chunks: embedding cosine (the default), BM25 keywords, or both fused by
+// reciprocal rank. Hybrid only fuses keyword hits whose cosine meets score_threshold; Keyword
+// has no cosine and ignores the threshold.
+enum class RetrievalMode{ Vector, Hybrid, Keyword };
+// Vector scoring in large sessions: cosine only over the BM25 top `candidates`
+// chunks; fewer than min_candidates keyword matches fall back to the full scan.
+// candidates 0 turns the pre-filter off.
+struct PrefilterOptions{ size_t min_chunks=20000, candidates=2000, min_candidates=100; double max_df=0.5; };   // max_df: see rag_lexical::Index::search
+
+// Structured result of one retrieval + generation round.
+struct RetrievedChunk{ std::string id; double score=0; };   // cosine (Vector, Hybrid) or BM25 (Keyword)
+struct ChatResult{
+  std::string answer;
+  std::vector<RetrievedChunk> hits;            // chunks placed in the prompt, best first
+  double embed_ms=0, search_ms=0, generate_ms=0;
+  bool has_context=false;                      // false when nothing passed the threshold
+};
 
 class RAGSessionManager{
 public:
   explicit RAGSessionManager(std::string base_dir="chroma_cpp", std::string ollama_url="http://localhost:11434",
                              std::string embed_model="mxbai-embed-large", std::string llm_model="deepseek-r1:latest");
   void setVerbose(bool v){ verbose_=v; }
-  std::string createSessionFromFolder(const std::string& folder_path);
-  std::string chat(const std::string& session_id,const std::string& message,int k=5,double score_threshold=0.2);
+  void setPrefilter(const PrefilterOptions& p){ std::lock_guard<std::mutex> L(pf_mtx_); pf_=p; }
+  PrefilterOptions prefilter() const{ std::lock_guard<std::mutex> L(pf_mtx_); return pf_; }
+  // Empty arguments keep the current value. Not synchronised: call before the first ingest or query.
+  void configure(const std::string& ollama_url,const std::string& embed_model="",const std::string& llm_model=""){ if(!ollama_url.empty()) ollama_url_=ollama_url; if(!embed_model.empty()) embed_model_=embed_model; if(!llm_model.empty()) llm_model_=llm_model; }
+  // With progress set, status lines go to progress->set_message() instead of stderr.
+  std::string createSessionFromFolder(const std::string& folder_path, IngestProgress* progress=nullptr);
+  std::string chat(const std::string& session_id,const std::string& message,int k=5,double score_threshold=0.2,const TokenCallback& on_token={});
+  // Same, against an already loaded (e.g. cached, shared) index; does not modify it.
+  std::string chat(const SessionIndex& idx,const std::string& message,int k=5,double score_threshold=0.2,const TokenCallback& on_token={});
+  // mode and filter (ext, directory, PDF/code, pages; empty = all chunks) are per call, like k and the threshold
+  ChatResult answer(const SessionIndex& idx,const std::string& message,int k=5,double score_threshold=0.2,const TokenCallback& on_token={},
+                    RetrievalMode mode=RetrievalMode::Vector,const ChunkFilter& filter={});
 
   // Public methods needed by adapter for code ingestion
+  static constexpr size_t kEmbedBatch=25;   // chunks per "embed_batch" trace span, documents and code alike
   std::vector<float> embed(const std::string& text);
   std::string sessionDir(const std::string& sid) const;
   void save_index(const SessionIndex& idx) const;
   std::optional<SessionIndex> load_index(const std::string& sid) const;
+  // The session's lexical.bin, memory-mapped; rebuilt (and rewritten) if missing or stale
+  std::shared_ptr<const rag_lexical::Index> lexical_for(const SessionIndex& idx) const;
+
+  // Retrieval and ingest building blocks (also driven directly by bench/rag_bench)
+  static std::vector<std::string> split_chunks(const std::string& text, size_t chunk=1024,size_t overlap=100);
+  // [begin,end) of each split_chunks piece
+  static std::vector<std::pair<size_t,size_t>> split_spans(size_t text_size, size_t chunk=1024,size_t overlap=100);
+  static double cosine(const std::vector<float>& a,const std::vector<float>& b);
+  static double cosine(const float* a,const float* b,size_t n);   // -1 if n is 0 or either vector is zero
+  // Best chunks for q: at most k (at least 1), scores >= threshold, best first; subset limits the scan to those chunks
+  static std::vector<std::pair<double,size_t>> top_k(const SessionIndex& idx,const std::vector<float>& q,int k,double score_threshold,const std::vector<size_t>* subset=nullptr);
+  // top_k over the chunks in keyword (BM25 hits); full scan (of subset, if given) if there are fewer than min_candidates
+  static std::vector<std::pair<double,size_t>> prefiltered_top_k(const SessionIndex& idx,const std::vector<std::pair<double,size_t>>& keyword,const std::vector<float>& q,int k,double score_threshold,size_t min_candidates,bool* fell_back=nullptr,const std::vector<size_t>* subset=nullptr);
+  // Rendered page to 8-bit gray for OCR; bytes_per_pixel 4 = ARGB32 (BGRA in memory), 3 = RGB24, 1 = gray
+  static void gray_from_pixels(const unsigned char* src,int w,int h,int stride,int bytes_per_pixel,std::vector<unsigned char>& gray);
 
 private:
   std::string base_dir_, ollama_url_, embed_model_, llm_model_;
-  bool verbose_=true;
+  std::atomic<bool> verbose_{true};
+  mutable std::mutex pf_mtx_;
+  PrefilterOptions pf_;
   void log(const std::string& msg) const;
+  bool load_columns(const nlohmann::json& j,SessionIndex& idx) const;
   static std::string uuid4();
   static std::vector<std::string> findPDFs(const std::string& folder);
-  static std::string extract_text_poppler(const std::string& pdf_path);
-  static std::string ocr_pdf_with_poppler_tesseract(const std::string& pdf_path, int dpi=200);
-  static std::vector<std::string> split_chunks(const std::string& text, size_t chunk=1024,size_t overlap=100);
-  std::string ollama_chat(const std::string& prompt);
-  static double cosine(const std::vector<float>& a,const std::vector<float>& b);
+  // page_starts (optional) receives the text offset where each page begins
+  static std::string extract_text_poppler(const std::string& pdf_path, std::vector<size_t>* page_starts=nullptr);
+  static std::string ocr_pdf_with_poppler_tesseract(const std::string& pdf_path, int dpi=200, std::vector<size_t>* page_starts=nullptr);
+  std::string ollama_chat(const std::string& prompt,const TokenCallback& on_token={});
   static std::string build_prompt(const std::string& ctx,const std::string& q);
 };
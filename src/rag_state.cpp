@@ -1,8 +1,8 @@
 #include "rag_state.hpp"
+#include "conversation.h"
+// The active session belongs to the calling thread's conversation.
 namespace rag_state {
-static std::mutex g_mtx;
-static std::string g_active_sid;
-void SetActiveSession(const std::string& s){ std::lock_guard<std::mutex> L(g_mtx); g_active_sid=s; }
-std::string GetActiveSession(){ std::lock_guard<std::mutex> L(g_mtx); return g_active_sid; }
-bool HasActiveSession(){ std::lock_guard<std::mutex> L(g_mtx); return !g_active_sid.empty(); }
+void SetActiveSession(const std::string& s){ conversations::Current()->setRagSession(s); }
+std::string GetActiveSession(){ return conversations::Current()->ragSession(); }
+bool HasActiveSession(){ return !GetActiveSession().empty(); }
 } // namespace rag_state
@@ -0,0 +1,199 @@
+#include "rag_store.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zstd.h>
+
+namespace rag_store {
+
+namespace {
+
+const char kEmbMagic[8] = {'R','A','G','E','M','B','0','1'};
+const char kTextMagic[8] = {'R','A','G','T','X','T','0','1'};
+const int kLevel = 3;
+
+struct EmbHeader {
+  char magic[8];
+  uint64_t chunks, dim;
+  char pad[40];
+};
+static_assert(sizeof(EmbHeader) == 64, "header layout");
+
+struct TextHeader {
+  char magic[8];
+  uint64_t chunks, blocks;
+  uint64_t offsets_off, blocks_off, data_off, size;
+  char pad[8];
+};
+static_assert(sizeof(TextHeader) == 64, "header layout");
+
+struct BlockRec {
+  uint64_t off;
+  uint32_t len, first;
+};
+static_assert(sizeof(BlockRec) == 16, "block record layout");
+
+bool writeAtomic(const std::string& path, const std::string& a, const char* b, size_t blen) {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    ofs.write(a.data(), (std::streamsize)a.size());
+    if (blen) ofs.write(b, (std::streamsize)blen);
+    if (!ofs) return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+} // namespace
+
+bool write_file(const std::string& path, const std::string& data) {
+  return writeAtomic(path, data, nullptr, 0);
+}
+
+bool write_embeddings(const std::string& path, const SessionIndex& idx) {
+  EmbHeader h{};
+  std::memcpy(h.magic, kEmbMagic, sizeof(kEmbMagic));
+  h.chunks = idx.size();
+  h.dim = idx.dim;
+  std::string head((const char*)&h, sizeof(h));
+  return writeAtomic(path, head, (const char*)idx.embeddings.data(), idx.size() * idx.dim * sizeof(float));
+}
+
+bool read_embeddings(const std::string& path, size_t chunks, SessionIndex& idx, std::string* error) {
+  std::ifstream ifs(path, std::ios::binary);
+  EmbHeader h;
+  if (!ifs.read((char*)&h, sizeof(h)) || std::memcmp(h.magic, kEmbMagic, sizeof(kEmbMagic)) != 0 || h.chunks != chunks
+      || h.dim > (1u << 20)) {
+    if (error) *error = "missing or damaged embeddings: " + path;
+    return false;
+  }
+  idx.dim = (size_t)h.dim;
+  idx.embeddings.assign(chunks * idx.dim, 0.f);
+  if (!ifs.read((char*)idx.embeddings.data(), (std::streamsize)(idx.embeddings.size() * sizeof(float)))) {
+    if (error) *error = "truncated embeddings: " + path;
+    return false;
+  }
+  return true;
+}
+
+bool write_text(const std::string& path, const SessionIndex& idx, size_t block_bytes) {
+  size_t n = idx.size();
+  std::vector<uint64_t> offsets{0};
+  offsets.reserve(n + 1);
+  std::vector<BlockRec> blocks;
+  std::string data, raw, frame;
+  ZSTD_CCtx* cctx = ZSTD_createCCtx();
+  if (!cctx) return false;
+  auto flush = [&](uint32_t first) {
+    frame.resize(ZSTD_compressBound(raw.size()));
+    size_t z = ZSTD_compressCCtx(cctx, &frame[0], frame.size(), raw.data(), raw.size(), kLevel);
+    if (ZSTD_isError(z)) return false;
+    blocks.push_back({data.size(), (uint32_t)z, first});
+    data.append(frame.data(), z);
+    raw.clear();
+    return true;
+  };
+  bool ok = true;
+  uint32_t first = 0;
+  for (size_t i = 0; i < n && ok; ++i) {
+    std::string b = idx.body(i);
+    raw += b;
+    offsets.push_back(offsets.back() + b.size());
+    if (raw.size() >= block_bytes) {
+      ok = flush(first);
+      first = (uint32_t)(i + 1);
+    }
+  }
+  if (ok && !raw.empty()) ok = flush(first);
+  ZSTD_freeCCtx(cctx);
+  if (!ok) return false;
+
+  TextHeader h{};
+  std::memcpy(h.magic, kTextMagic, sizeof(kTextMagic));
+  h.chunks = n;
+  h.blocks = blocks.size();
+  h.offsets_off = sizeof(TextHeader);
+  h.blocks_off = h.offsets_off + offsets.size() * sizeof(uint64_t);
+  h.data_off = h.blocks_off + blocks.size() * sizeof(BlockRec);
+  h.size = h.data_off + data.size();
+  std::string head;
+  head.reserve(h.data_off);
+  head.append((const char*)&h, sizeof(h));
+  head.append((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+  head.append((const char*)blocks.data(), blocks.size() * sizeof(BlockRec));
+  return writeAtomic(path, head, data.data(), data.size());
+}
+
+std::shared_ptr<const TextBlob> TextBlob::open(const std::string& path, std::string* error) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) { if (error) *error = "cannot open " + path; return nullptr; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TextHeader)) {
+    ::close(fd);
+    if (error) *error = "not a text blob: " + path;
+    return nullptr;
+  }
+  void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (m == MAP_FAILED) { if (error) *error = "mmap failed: " + path; return nullptr; }
+  std::shared_ptr<TextBlob> b(new TextBlob);
+  b->base_ = (const char*)m;
+  b->size_ = (size_t)st.st_size;   // for munmap even if the checks fail
+  TextHeader h;
+  std::memcpy(&h, m, sizeof(h));
+  bool ok = std::memcmp(h.magic, kTextMagic, sizeof(kTextMagic)) == 0 && h.size == b->size_
+         && h.offsets_off == sizeof(TextHeader)
+         && h.blocks_off == h.offsets_off + (h.chunks + 1) * sizeof(uint64_t)
+         && h.data_off == h.blocks_off + h.blocks * sizeof(BlockRec) && h.data_off <= h.size;
+  if (!ok) { if (error) *error = "damaged or foreign text blob: " + path; return nullptr; }
+  b->chunks_ = h.chunks;
+  b->blocks_ = h.blocks;
+  b->offsets_off_ = h.offsets_off;
+  b->blocks_off_ = h.blocks_off;
+  b->data_off_ = h.data_off;
+  return b;
+}
+
+TextBlob::~TextBlob() {
+  if (base_) munmap((void*)base_, size_);
+}
+
+uint64_t TextBlob::raw_bytes() const {
+  uint64_t v;
+  std::memcpy(&v, base_ + offsets_off_ + chunks_ * sizeof(uint64_t), sizeof(v));
+  return v;
+}
+
+std::string TextBlob::text(size_t i) const {
+  if (i >= chunks_ || blocks_ == 0) return {};
+  auto rec = [&](size_t b) { BlockRec r; std::memcpy(&r, base_ + blocks_off_ + b * sizeof(BlockRec), sizeof(r)); return r; };
+  auto offset = [&](size_t c) { uint64_t v; std::memcpy(&v, base_ + offsets_off_ + c * sizeof(uint64_t), sizeof(v)); return v; };
+  // Last block whose first chunk is <= i
+  size_t lo = 0, hi = blocks_;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (rec(mid).first <= i) lo = mid; else hi = mid;
+  }
+  BlockRec r = rec(lo);
+  uint64_t start = offset(r.first), end = lo + 1 < blocks_ ? offset(rec(lo + 1).first) : offset(chunks_);
+  uint64_t from = offset(i) - start, len = offset(i + 1) - offset(i);
+  std::lock_guard<std::mutex> L(mtx_);
+  if (cached_ != lo) {
+    cached_ = SIZE_MAX;
+    if (data_off_ + r.off + r.len > size_ || end < start
+        || ZSTD_getFrameContentSize(base_ + data_off_ + r.off, r.len) != end - start) return {};   // damaged file
+    cache_.resize(end - start);
+    size_t z = ZSTD_decompress(&cache_[0], cache_.size(), base_ + data_off_ + r.off, r.len);
+    if (ZSTD_isError(z) || z != cache_.size()) return {};
+    cached_ = lo;
+  }
+  if (from + len > cache_.size()) return {};
+  return cache_.substr(from, len);
+}
+
+} // namespace rag_store
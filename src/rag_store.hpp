@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "rag_session.hpp"
+
+// On-disk session storage next to index.json (which keeps only files and the
+// per-chunk metadata columns):
+//
+// embeddings.bin  64-byte header (magic "RAGEMB01", chunks, dim), then the
+//                 chunks x dim float matrix, row-major, native byte order
+// text.bin        chunk texts as zstd frames of about 64 KiB, whole chunks per
+//                 block, so answering reads and decompresses only the blocks
+//                 holding the chunks placed in the prompt:
+//   header   magic "RAGTXT01", chunks, blocks, section offsets
+//   offsets  u64 per chunk + 1: start of each text in the uncompressed stream
+//   blocks   16-byte records: compressed offset (from data) and length, first chunk
+//   data     the zstd frames
+// Each file is replaced atomically (temporary file + rename), not the set:
+// save_index writes both blobs first and index.json last, and load rejects
+// blobs whose chunk count disagrees with index.json.
+namespace rag_store {
+
+// Writes `data` to path.tmp, then renames it over path; false on any failure
+bool write_file(const std::string& path, const std::string& data);
+
+bool write_embeddings(const std::string& path, const SessionIndex& idx);
+// Replaces idx.dim/embeddings; false (error set) if missing, damaged or not `chunks` rows
+bool read_embeddings(const std::string& path, size_t chunks, SessionIndex& idx, std::string* error=nullptr);
+
+bool write_text(const std::string& path, const SessionIndex& idx, size_t block_bytes=64*1024);
+
+class TextBlob {
+public:
+  // Memory-mapped; nullptr (and error set) if missing or damaged
+  static std::shared_ptr<const TextBlob> open(const std::string& path, std::string* error=nullptr);
+  ~TextBlob();
+  TextBlob(const TextBlob&) = delete;
+  TextBlob& operator=(const TextBlob&) = delete;
+
+  size_t chunks() const { return chunks_; }
+  size_t blocks() const { return blocks_; }
+  size_t bytes() const { return size_; }   // compressed file
+  uint64_t raw_bytes() const;              // all texts, uncompressed
+
+  // Text of chunk i (< chunks()); "" if its block does not decompress. The last
+  // block read is cached, so reading chunks in order decompresses each block once.
+  std::string text(size_t i) const;
+
+private:
+  TextBlob() = default;
+  const char* base_ = nullptr;
+  size_t size_ = 0, chunks_ = 0, blocks_ = 0;
+  uint64_t offsets_off_ = 0, blocks_off_ = 0, data_off_ = 0;
+  mutable std::mutex mtx_;
+  mutable size_t cached_ = SIZE_MAX;
+  mutable std::string cache_;
+};
+
+} // namespace rag_store
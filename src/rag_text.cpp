@@ -0,0 +1,54 @@
+#include "rag_text.hpp"
+#include <algorithm>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace rag_text {
+
+std::string read_text_file(const fs::path& p, size_t max_bytes){
+    std::ifstream ifs(p, std::ios::binary);
+    if (!ifs) return {};
+    // binary sniff
+    std::string head(8192, '\0');
+    ifs.read(head.data(), head.size());
+    head.resize((size_t)ifs.gcount());
+    if (head.find('\0') != std::string::npos) return {}; // looks binary
+    // read up to max
+    ifs.clear(); ifs.seekg(0);
+    std::string data; data.reserve(std::min(max_bytes, (size_t)fs::file_size(p)));
+    char buf[8192]; size_t total=0;
+    while (ifs){
+        ifs.read(buf, sizeof(buf));
+        std::streamsize n = ifs.gcount();
+        if (n<=0) break;
+        size_t add = (total + (size_t)n > max_bytes) ? (max_bytes - total) : (size_t)n;
+        data.append(buf, buf+add);
+        total += add;
+        if (total >= max_bytes) break;
+    }
+    return data;
+}
+
+std::vector<std::pair<size_t,size_t>> code_chunk_spans(const std::string& text, size_t max_chars, size_t overlap){
+    std::vector<std::pair<size_t,size_t>> out;
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t end = std::min(text.size(), i + max_chars);
+        size_t j = end;
+        while (j > i + 200 && j < text.size() && text[j] != '\n') --j;
+        if (j <= i + 200) j = end;
+        out.emplace_back(i, j);
+        if (j >= text.size()) break;
+        i = j > overlap ? j - overlap : j;
+    }
+    return out;
+}
+
+std::vector<std::string> code_chunks(const std::string& text, size_t max_chars, size_t overlap){
+    std::vector<std::string> out;
+    for (auto& s : code_chunk_spans(text, max_chars, overlap)) out.emplace_back(text.substr(s.first, s.second - s.first));
+    return out;
+}
+
+} // namespace rag_text
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Source-file ingest helpers used by the code adapter.
+namespace rag_text {
+
+// File contents up to max_bytes; empty if unreadable or binary (NUL in the first 8 KiB).
+std::string read_text_file(const std::filesystem::path& p, size_t max_bytes=512*1024);
+
+// Chunks of at most max_chars that prefer to end at a newline; consecutive
+// chunks share overlap characters.
+std::vector<std::string> code_chunks(const std::string& text, size_t max_chars=1200, size_t overlap=120);
+// The same chunks as [begin, end) byte offsets into text.
+std::vector<std::pair<size_t,size_t>> code_chunk_spans(const std::string& text, size_t max_chars=1200, size_t overlap=120);
+
+} // namespace rag_text
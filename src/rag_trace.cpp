@@ -0,0 +1,69 @@
+#include "rag_trace.hpp"
+#include "json.hpp"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <fstream>
+using json = nlohmann::json;
+
+namespace rag_trace {
+static constexpr size_t kMaxEvents = 1000000; // ~100 MB of JSON, enough for a large ingest
+
+static std::atomic<bool> g_enabled{false};
+static std::mutex g_mtx;
+static std::vector<json> g_events;
+static size_t g_dropped = 0;
+static std::map<std::thread::id,int> g_tids;
+static const auto g_epoch = std::chrono::steady_clock::now();
+
+bool Enabled(){ return g_enabled.load(std::memory_order_relaxed); }
+void SetEnabled(bool on){ g_enabled.store(on); }
+void Clear(){ std::lock_guard<std::mutex> L(g_mtx); g_events.clear(); g_dropped=0; }
+size_t EventCount(){ std::lock_guard<std::mutex> L(g_mtx); return g_events.size(); }
+
+static int tid_locked(){ auto id=std::this_thread::get_id(); auto it=g_tids.find(id); if(it!=g_tids.end()) return it->second; int n=(int)g_tids.size()+1; g_tids[id]=n; return n; }
+
+Span::Span(const char* name, const char* cat):name_(name),cat_(cat){
+  if(!Enabled()) return;
+  active_=true;
+  start_=std::chrono::steady_clock::now();
+}
+
+void Span::arg(const std::string& k, const std::string& v){ if(active_) sargs_.emplace_back(k,v); }
+void Span::arg(const std::string& k, long long v){ if(active_) iargs_.emplace_back(k,v); }
+
+Span::~Span(){
+  if(!active_) return;
+  auto end=std::chrono::steady_clock::now();
+  json e;
+  e["name"]=name_;
+  e["cat"]=cat_;
+  e["ph"]="X";
+  e["ts"]=std::chrono::duration_cast<std::chrono::microseconds>(start_-g_epoch).count();
+  e["dur"]=std::chrono::duration_cast<std::chrono::microseconds>(end-start_).count();
+  e["pid"]=1;
+  if(!sargs_.empty() || !iargs_.empty()){
+    json a=json::object();
+    for(auto& kv:sargs_) a[kv.first]=kv.second;
+    for(auto& kv:iargs_) a[kv.first]=kv.second;
+    e["args"]=std::move(a);
+  }
+  std::lock_guard<std::mutex> L(g_mtx);
+  e["tid"]=tid_locked();
+  if(g_events.size()>=kMaxEvents){ ++g_dropped; return; }
+  g_events.push_back(std::move(e));
+}
+
+bool WriteChromeTrace(const std::string& path, std::string* error){
+  std::lock_guard<std::mutex> L(g_mtx);
+  std::ofstream ofs(path);
+  if(!ofs){ if(error) *error="cannot open "+path; return false; }
+  json j;
+  j["traceEvents"]=g_events;
+  j["displayTimeUnit"]="ms";
+  j["otherData"]={{"dropped_events",g_dropped}};
+  ofs<<j.dump();
+  return (bool)ofs;
+}
+} // namespace rag_trace
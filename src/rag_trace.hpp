@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <utility>
+#include <chrono>
+
+// Span-based tracing for the RAG query and ingest paths.
+// Spans are recorded as Chrome trace-event "complete" events and can be
+// opened in chrome://tracing or https://ui.perfetto.dev.
+namespace rag_trace {
+bool Enabled();
+void SetEnabled(bool on);
+void Clear();
+size_t EventCount();
+bool WriteChromeTrace(const std::string& path, std::string* error=nullptr);
+
+// RAII span; nesting is inferred by the viewer from timestamps per thread.
+// Costs one atomic load when tracing is off.
+class Span {
+public:
+  explicit Span(const char* name, const char* cat="rag");
+  ~Span();
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+
+  void arg(const std::string& key, const std::string& value);
+  void arg(const std::string& key, long long value);
+  bool active() const { return active_; }
+
+private:
+  bool active_ = false;
+  const char* name_;
+  const char* cat_;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<std::pair<std::string,std::string>> sargs_;
+  std::vector<std::pair<std::string,long long>> iargs_;
+};
+} // namespace rag_trace
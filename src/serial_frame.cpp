@@ -0,0 +1,346 @@
+#include "serial_frame.h"
+#include <algorithm>
+
+namespace serial_frame {
+
+// Shared by both ends and never sent: common English words and fragments,
+// plus what the console itself prints. Frequent entries sit at the end.
+static const char kDict[] =
+    "[Response: ms]\r\n[Thinking..]\r\n[Error] [Info] [Warning] "
+    "```\r\n**: - 1. 2. 3. http://www. .com e.g. i.e. "
+    "function return value string number example following however therefore "
+    "because between through during without within another different important "
+    "information question answer problem system process provide "
+    "include including using used use make made many more most "
+    "some such than then them these they their there where which while "
+    "would could should about after also been before being both each "
+    "first from have here into just like only other over same very well "
+    "what when will with your you can may not one two all any are but "
+    "for had has her his how its new now our out see she was way who "
+    "ation tion sion ment ness able ible ally ing ed ly er es "
+    "It is This is There are In the of the to the and the in a on the for the "
+    "that the with the is a as a to be it is can be "
+    ", and . The , the . I . It . This . In "
+    " the and that this with have from they "
+    " is in it of to a ";
+static_assert(sizeof(kDict) - 1 <= kDictCodes, "static dictionary too large");
+
+const std::string kDictionary(kDict, sizeof(kDict) - 1);
+
+static const size_t kMinMatch = 3;
+static const size_t kMaxMatch = 18;
+static const int kHashBits = 12;
+static const int kChainLimit = 32;
+
+uint16_t crc16(const uint8_t* data, size_t n) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < n; ++i) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+std::string build(uint8_t type, uint8_t seq, const std::string& payload) {
+    std::string f;
+    f.reserve(payload.size() + 6);
+    f += (char)kSof;
+    f += (char)type;
+    f += (char)seq;
+    f += (char)(uint8_t)payload.size();
+    f += payload;
+    uint16_t crc = crc16((const uint8_t*)f.data() + 1, f.size() - 1);
+    f += (char)(crc >> 8);
+    f += (char)(crc & 0xFF);
+    return f;
+}
+
+// ---- Parser ----
+
+static bool knownType(uint8_t t) {
+    return t == kData || t == kSync || t == kAck || t == kNak;
+}
+
+void Parser::feed(const char* data, size_t n, std::vector<Frame>& frames, std::string* other) {
+    buf_.append(data, n);
+    size_t i = 0;
+    while (i < buf_.size()) {
+        if ((uint8_t)buf_[i] != kSof) {
+            if (other) *other += buf_[i];
+            ++i;
+            continue;
+        }
+        size_t avail = buf_.size() - i;
+        if (avail < 2) break;
+        // Not a header after all: pass the byte through
+        if (!knownType((uint8_t)buf_[i + 1]) || (avail >= 4 && (uint8_t)buf_[i + 3] > max_len_)) {
+            if (other) *other += buf_[i];
+            ++i;
+            continue;
+        }
+        if (avail < 4) break;
+        size_t len = (uint8_t)buf_[i + 3];
+        if (avail < len + 6) break;
+        const uint8_t* p = (const uint8_t*)buf_.data() + i;
+        uint16_t crc = (uint16_t)(p[4 + len] << 8) | p[5 + len];
+        if (crc16(p + 1, len + 3) != crc) {
+            ++crc_errors_;
+            ++i;   // resynchronise on the next SOF
+            continue;
+        }
+        Frame f;
+        f.type = p[1];
+        f.seq = p[2];
+        f.payload.assign((const char*)p + 4, len);
+        frames.push_back(std::move(f));
+        i += len + 6;
+    }
+    buf_.erase(0, i);
+}
+
+// ---- Compressor ----
+
+static inline int hash3(const std::string& s, size_t pos) {
+    uint32_t v = ((uint8_t)s[pos] << 16) | ((uint8_t)s[pos + 1] << 8) | (uint8_t)s[pos + 2];
+    return (int)((v * 2654435761u) >> (32 - kHashBits));
+}
+
+Compressor::Compressor() { reset(); }
+
+void Compressor::reset() {
+    buf_ = kDictionary;
+    head_.assign(1 << kHashBits, -1);
+    prev_.assign(buf_.size(), -1);
+    hashed_ = 0;
+    hashUpTo(kDictionary.size());
+}
+
+void Compressor::hashUpTo(size_t limit) {
+    prev_.resize(buf_.size(), -1);
+    for (; hashed_ < limit && hashed_ + kMinMatch <= buf_.size(); ++hashed_) {
+        // 3-grams straddling the dictionary's end match nothing real
+        if (hashed_ < kDictionary.size() && hashed_ + kMinMatch > kDictionary.size()) continue;
+        int h = hash3(buf_, hashed_);
+        prev_[hashed_] = head_[h];
+        head_[h] = (int)hashed_;
+    }
+}
+
+// Keeps the dictionary and the last window of text; positions are rebuilt
+void Compressor::trim() {
+    size_t dict = kDictionary.size();
+    if (buf_.size() < dict + 4 * kWindow) return;
+    std::string keep = buf_.substr(buf_.size() - kWindow);
+    buf_.resize(dict);
+    buf_ += keep;
+    head_.assign(1 << kHashBits, -1);
+    prev_.assign(buf_.size(), -1);
+    hashed_ = 0;
+    hashUpTo(buf_.size());
+}
+
+std::string Compressor::compress(const char* data, size_t n) {
+    trim();
+    const size_t dict = kDictionary.size();
+    size_t p = buf_.size();
+    buf_.append(data, n);
+    const size_t end = buf_.size();
+
+    std::string out;
+    size_t flag_pos = 0;
+    int item = 8;
+    while (p < end) {
+        hashUpTo(p);
+        size_t best_len = 0, best_code = 0;
+        if (p + kMinMatch <= end) {
+            int chain = 0;
+            for (int c = head_[hash3(buf_, p)]; c >= 0 && chain < kChainLimit; c = prev_[c], ++chain) {
+                size_t cand = (size_t)c;
+                size_t limit = std::min(kMaxMatch, end - p);
+                size_t code;
+                if (cand < dict) {
+                    limit = std::min(limit, dict - cand);
+                    code = cand;
+                } else {
+                    if (p - cand > kWindow) continue;
+                    code = kDictCodes - 1 + (p - cand);
+                }
+                size_t len = 0;
+                while (len < limit && buf_[cand + len] == buf_[p + len]) ++len;
+                if (len > best_len) {
+                    best_len = len;
+                    best_code = code;
+                    if (len == kMaxMatch) break;
+                }
+            }
+        }
+
+        if (item == 8) {
+            flag_pos = out.size();
+            out += '\0';
+            item = 0;
+        }
+        if (best_len >= kMinMatch) {
+            out[flag_pos] = (char)((uint8_t)out[flag_pos] | (1 << item));
+            uint16_t v = (uint16_t)((best_code << 4) | (best_len - kMinMatch));
+            out += (char)(v >> 8);
+            out += (char)(v & 0xFF);
+            p += best_len;
+        } else {
+            out += buf_[p];
+            ++p;
+        }
+        ++item;
+    }
+    hashUpTo(end);
+    return out;
+}
+
+// ---- Decompressor ----
+
+bool Decompressor::decompress(const std::string& payload, std::string& out) {
+    size_t i = 0;
+    while (i < payload.size()) {
+        uint8_t flags = (uint8_t)payload[i++];
+        for (int item = 0; item < 8 && i < payload.size(); ++item) {
+            if (!(flags & (1 << item))) {
+                out += payload[i];
+                hist_ += payload[i];
+                ++i;
+                continue;
+            }
+            if (i + 2 > payload.size()) return false;
+            uint16_t v = (uint16_t)(((uint8_t)payload[i] << 8) | (uint8_t)payload[i + 1]);
+            i += 2;
+            size_t code = v >> 4, len = (v & 0xF) + kMinMatch;
+            if (code < kDictCodes) {
+                if (code + len > kDictionary.size()) return false;
+                out.append(kDictionary, code, len);
+                hist_.append(kDictionary, code, len);
+            } else {
+                size_t dist = code - (kDictCodes - 1);
+                if (dist > hist_.size()) return false;
+                size_t from = hist_.size() - dist;
+                for (size_t k = 0; k < len; ++k) {   // may overlap what it writes
+                    char ch = hist_[from + k];
+                    hist_ += ch;
+                    out += ch;
+                }
+            }
+        }
+    }
+    if (hist_.size() > 4 * kWindow) hist_.erase(0, hist_.size() - kWindow);
+    return true;
+}
+
+// ---- Encoder ----
+
+std::string Encoder::data(const char* text, size_t n) {
+    std::string f = build(kData, next_, comp_.compress(text, std::min(n, kMaxPlain)));
+    sent_.emplace_back(next_, f);
+    if ((int)sent_.size() > kRetain) sent_.pop_front();
+    ++next_;
+    return f;
+}
+
+std::string Encoder::sync() {
+    comp_.reset();
+    sent_.clear();
+    return build(kSync, next_);
+}
+
+bool Encoder::ack(uint8_t next) {
+    bool any = false;
+    while (!sent_.empty()) {
+        uint8_t behind = (uint8_t)(next - sent_.front().first);   // modulo 256
+        if (behind == 0 || behind > 128) break;
+        sent_.pop_front();
+        any = true;
+    }
+    return any;
+}
+
+std::string Encoder::resendFrom(uint8_t seq, size_t* frames) const {
+    std::string out;
+    size_t count = 0;
+    bool found = false;
+    for (const auto& s : sent_) {
+        if (s.first == seq) found = true;
+        if (found) {
+            out += s.second;
+            ++count;
+        }
+    }
+    if (frames) *frames = count;
+    return out;
+}
+
+size_t Encoder::unackedBytes() const {
+    size_t n = 0;
+    for (const auto& s : sent_) n += s.second.size();
+    return n;
+}
+
+// ---- Decoder ----
+
+// Every gap or damaged frame is NAKed (the host ignores repeats while its
+// resend is on the way); a sync is requested once until it arrives
+void Decoder::nak(std::string& reply) {
+    if (!synced_) {
+        if (sync_requested_) return;
+        sync_requested_ = true;
+    }
+    ++stats_.naks;
+    reply += synced_ ? build(kNak, expected_) : requestSync();
+}
+
+void Decoder::feed(const char* data, size_t n, std::string& text, std::string& reply) {
+    stats_.bytes_in += n;
+    std::vector<Frame> frames;
+    uint64_t crc_before = parser_.crcErrors();
+    parser_.feed(data, n, frames);
+    if (parser_.crcErrors() != crc_before) {
+        stats_.crc_errors = parser_.crcErrors();
+        nak(reply);
+    }
+
+    for (const auto& f : frames) {
+        if (f.type == kSync) {
+            dec_.reset();
+            synced_ = true;
+            expected_ = f.seq;
+            sync_requested_ = false;
+            ++stats_.syncs;
+            reply += build(kAck, expected_);
+            continue;
+        }
+        if (f.type != kData) continue;
+        ++stats_.frames;
+        if (!synced_) {
+            nak(reply);
+            continue;
+        }
+        if (f.seq != expected_) {
+            if ((uint8_t)(f.seq - expected_) < 128) {
+                ++stats_.gaps;
+                nak(reply);
+            } else {
+                ++stats_.duplicates;
+            }
+            continue;
+        }
+        std::string out;
+        if (!dec_.decompress(f.payload, out)) {
+            synced_ = false;
+            sync_requested_ = false;
+            nak(reply);
+            continue;
+        }
+        text += out;
+        stats_.text_bytes += out.size();
+        ++expected_;
+        reply += build(kAck, expected_);
+    }
+}
+
+} // namespace serial_frame
@@ -1,51 +1,277 @@
 #include "serial_handler.h"
 #include <libserialport.h>
 #include <iostream>
+#include <sstream>
 #include <cerrno>
 #include <cstring>
+#include <algorithm>
 
 bool serial_available = false;
-static sp_port* serial_port = nullptr;
 
-bool initSerial(const std::string& port, int baudrate) {
-    if (port.empty() || baudrate <= 0) {
-        serial_available = false;
-        return false;
+static std::mutex g_ports_mtx;
+static std::vector<SerialPortPtr> g_ports;
+
+static sp_flowcontrol parseFlowControl(std::string name) {
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    if (name == "xonxoff") return SP_FLOWCONTROL_XONXOFF;
+    if (name == "rtscts") return SP_FLOWCONTROL_RTSCTS;
+    if (name == "dtrdsr") return SP_FLOWCONTROL_DTRDSR;
+    if (!name.empty() && name != "none")
+        std::cerr << "[Warning] Unknown serial_flow_control: " << name << " (using none)" << std::endl;
+    return SP_FLOWCONTROL_NONE;
+}
+
+SerialOptions serialOptionsFromConfig(const AppConfig& config) {
+    SerialOptions o;
+    o.flow_control = config.serial_flow_control;
+    o.tx_buffer = (size_t)std::max(64, config.serial_tx_buffer);
+    o.linger_ms = std::max(0, config.serial_linger_ms);
+    o.echo = config.serial_echo;
+    o.framed = config.serial_protocol == "framed";
+    if (!o.framed && config.serial_protocol != "text")
+        std::cerr << "[Warning] Unknown serial_protocol: " << config.serial_protocol << " (using text)" << std::endl;
+    o.text.charset = config.serial_charset;
+    std::transform(o.text.charset.begin(), o.text.charset.end(), o.text.charset.begin(), ::tolower);
+    if (o.text.charset != "utf8" && o.text.charset != "ascii" && o.text.charset != "latin1") {
+        std::cerr << "[Warning] Unknown serial_charset: " << config.serial_charset << " (using utf8)" << std::endl;
+        o.text.charset = "utf8";
     }
+    o.text.line_width = std::max(0, config.serial_line_width);
+    o.text.crlf = config.serial_newline == "crlf" || config.serial_newline == "CRLF";
+    return o;
+}
 
-    if (sp_get_port_by_name(port.c_str(), &serial_port) != SP_OK) {
-        std::cerr << "[Warning] Could not open serial port: " << port << std::endl;
-        serial_available = false;
-        return false;
+std::vector<SerialPortConfig> serialPortsFromConfig(const AppConfig& config) {
+    std::vector<SerialPortConfig> out;
+    SerialOptions shared = serialOptionsFromConfig(config);
+    if (!config.serial_port.empty() && config.baudrate > 0)
+        out.push_back({config.serial_port, config.baudrate, shared});
+
+    std::stringstream list(config.serial_ports);
+    std::string entry;
+    while (std::getline(list, entry, ',')) {
+        entry.erase(0, entry.find_first_not_of(" \t"));
+        entry.erase(entry.find_last_not_of(" \t") + 1);
+        if (entry.empty()) continue;
+        // path[:baud[:flow[:protocol]]]
+        SerialPortConfig pc{entry, config.baudrate, shared};
+        size_t c1 = entry.find(':');
+        if (c1 != std::string::npos) {
+            pc.path = entry.substr(0, c1);
+            size_t c2 = entry.find(':', c1 + 1);
+            std::string baud = entry.substr(c1 + 1, c2 == std::string::npos ? std::string::npos : c2 - c1 - 1);
+            try {
+                pc.baudrate = std::stoi(baud);
+            } catch (...) {
+                std::cerr << "[Warning] Invalid baudrate in serial_ports: " << entry << std::endl;
+                continue;
+            }
+            if (c2 != std::string::npos) {
+                size_t c3 = entry.find(':', c2 + 1);
+                pc.opts.flow_control = entry.substr(c2 + 1, c3 == std::string::npos ? std::string::npos : c3 - c2 - 1);
+                if (c3 != std::string::npos) pc.opts.framed = entry.substr(c3 + 1) == "framed";
+            }
+        }
+        if (pc.baudrate <= 0) {
+            std::cerr << "[Warning] No baudrate for serial port: " << pc.path << std::endl;
+            continue;
+        }
+        out.push_back(pc);
     }
+    return out;
+}
 
-    if (sp_open(serial_port, SP_MODE_READ_WRITE) != SP_OK) {
-        std::cerr << "[Warning] Failed to open serial port: " << port << std::endl;
-        sp_free_port(serial_port);
-        serial_available = false;
-        return false;
+// ---- SerialPort ----
+
+SerialPort::SerialPort(const std::string& path, int baudrate, const SerialOptions& opts)
+    : path_(path), baudrate_(baudrate), opts_(opts), text_(opts.text), echo_(opts.echo) {
+    sp_port* p = nullptr;
+    if (sp_get_port_by_name(path.c_str(), &p) != SP_OK) {
+        error_ = "Could not open serial port: " + path;
+        return;
+    }
+    if (sp_open(p, SP_MODE_READ_WRITE) != SP_OK) {
+        error_ = "Failed to open serial port: " + path;
+        sp_free_port(p);
+        return;
+    }
+
+    sp_set_baudrate(p, baudrate);
+    sp_set_bits(p, 8);
+    sp_set_parity(p, SP_PARITY_NONE);
+    sp_set_stopbits(p, 1);
+    sp_set_flowcontrol(p, parseFlowControl(opts.flow_control));
+
+    port_ = p;
+    tx_ = std::make_unique<SerialTxQueue>(port_, baudrate, opts.tx_buffer, opts.linger_ms, opts.framed);
+}
+
+SerialPort::~SerialPort() {
+    tx_.reset();   // drains what it can first
+    if (port_) {
+        sp_close(port_);
+        sp_free_port(port_);
     }
+}
+
+std::string SerialPort::name() const {
+    if (path_.rfind("/dev/", 0) == 0) return path_.substr(5);   // ttyUSB0, pts/3
+    size_t slash = path_.find_last_of('/');
+    return slash == std::string::npos ? path_ : path_.substr(slash + 1);
+}
+
+bool SerialPort::send(const std::string& data) {
+    return tx_ && tx_->enqueue(data);
+}
+
+bool SerialPort::sendWait(const std::string& data, int timeout_ms) {
+    return tx_ && tx_->enqueueWait(data, timeout_ms);
+}
+
+bool SerialPort::sendText(const std::string& text) {
+    if (!tx_) return false;
+    std::lock_guard<std::mutex> L(text_mtx_);
+    return tx_->enqueue(text_.feed(text));
+}
+
+void SerialPort::endText() {
+    if (!tx_) return;
+    std::lock_guard<std::mutex> L(text_mtx_);
+    tx_->enqueue(text_.finish());
+}
+
+SerialTxStats SerialPort::txStats() const {
+    return tx_ ? tx_->stats() : SerialTxStats{};
+}
+
+int SerialPort::fd() const {
+    if (!port_) return -1;
+    int fd = -1;
+    if (sp_get_port_handle(port_, &fd) != SP_OK) return -1;
+    return fd;
+}
+
+std::string SerialPort::readAvailable() {
+    std::string out;
+    if (!port_) return out;
+    char buf[512];
+    for (;;) {
+        int n = sp_nonblocking_read(port_, buf, sizeof(buf));
+        if (n <= 0) break;
+        out.append(buf, (size_t)n);
+        if (n < (int)sizeof(buf)) break;
+    }
+    if (!opts_.framed || out.empty()) return out;
+
+    // The device's ACK/NAK frames go to the writer; the rest was typed
+    std::vector<serial_frame::Frame> frames;
+    std::string typed;
+    replies_.feed(out.data(), out.size(), frames, &typed);
+    for (const auto& f : frames) tx_->onPeerFrame(f);
+    return typed;
+}
+
+// ---- serial_ports ----
 
-    sp_set_baudrate(serial_port, baudrate);
-    sp_set_bits(serial_port, 8);
-    sp_set_parity(serial_port, SP_PARITY_NONE);
-    sp_set_stopbits(serial_port, 1);
-    sp_set_flowcontrol(serial_port, SP_FLOWCONTROL_NONE);
+namespace serial_ports {
 
+static bool add(const SerialPortConfig& pc) {
+    auto port = std::make_shared<SerialPort>(pc.path, pc.baudrate, pc.opts);
+    if (!port->ok()) {
+        std::cerr << "[Warning] " << port->error() << std::endl;
+        return false;
+    }
+    std::lock_guard<std::mutex> L(g_ports_mtx);
+    g_ports.push_back(port);
     serial_available = true;
     return true;
 }
 
-void serialSend(const std::string& data) {
-    if (!serial_available || !serial_port) return;
-    sp_nonblocking_write(serial_port, data.c_str(), data.size());
+size_t OpenAll(const AppConfig& config) {
+    for (const auto& pc : serialPortsFromConfig(config)) {
+        if (Find(pc.path)) continue;
+        add(pc);
+    }
+    return List().size();
+}
+
+std::vector<SerialPortPtr> List() {
+    std::lock_guard<std::mutex> L(g_ports_mtx);
+    return g_ports;
 }
 
-void closeSerial() {
-    if (serial_port) {
-        sp_close(serial_port);
-        sp_free_port(serial_port);
-        serial_port = nullptr;
+SerialPortPtr Primary() {
+    std::lock_guard<std::mutex> L(g_ports_mtx);
+    return g_ports.empty() ? nullptr : g_ports.front();
+}
+
+SerialPortPtr Find(const std::string& name_or_path) {
+    std::lock_guard<std::mutex> L(g_ports_mtx);
+    for (const auto& p : g_ports)
+        if (p->path() == name_or_path || p->name() == name_or_path) return p;
+    return nullptr;
+}
+
+void CloseAll() {
+    std::vector<SerialPortPtr> ports;
+    {
+        std::lock_guard<std::mutex> L(g_ports_mtx);
+        ports.swap(g_ports);
+        serial_available = false;
     }
-    serial_available = false;
+    ports.clear();   // each drains for up to 2 s
+}
+
+static thread_local SerialPortPtr t_current;
+
+SerialPortPtr Current() { return t_current; }
+
+Scope::Scope(SerialPortPtr port) : prev_(std::move(t_current)) { t_current = std::move(port); }
+Scope::~Scope() { t_current = std::move(prev_); }
+
+} // namespace serial_ports
+
+// ---- Primary port shortcuts ----
+
+bool initSerial(const std::string& port, int baudrate, const SerialOptions& opts) {
+    if (port.empty() || baudrate <= 0) return false;
+    return serial_ports::add(SerialPortConfig{port, baudrate, opts});
+}
+
+bool serialSend(const std::string& data) {
+    auto p = serial_ports::Primary();
+    return p && p->send(data);
+}
+
+bool serialSendWait(const std::string& data, int timeout_ms) {
+    auto p = serial_ports::Primary();
+    return p && p->sendWait(data, timeout_ms);
+}
+
+bool serialSendText(const std::string& text) {
+    auto p = serial_ports::Primary();
+    return p && p->sendText(text);
+}
+
+void serialEndText() {
+    if (auto p = serial_ports::Primary()) p->endText();
+}
+
+SerialTxStats serialTxStats() {
+    auto p = serial_ports::Primary();
+    return p ? p->txStats() : SerialTxStats{};
+}
+
+int serialFd() {
+    auto p = serial_ports::Primary();
+    return p ? p->fd() : -1;
+}
+
+std::string serialReadAvailable() {
+    auto p = serial_ports::Primary();
+    return p ? p->readAvailable() : std::string();
+}
+
+void closeSerial() {
+    serial_ports::CloseAll();
 }
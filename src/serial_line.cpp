@@ -0,0 +1,52 @@
+#include "serial_line.h"
+
+SerialLineDiscipline::SerialLineDiscipline(bool echo, bool crlf, size_t maxLine)
+    : echo_(echo), crlf_(crlf), max_line_(maxLine) {}
+
+SerialLineDiscipline::Input SerialLineDiscipline::feed(const std::string& bytes) {
+    Input in;
+    for (char ch : bytes) {
+        unsigned char c = (unsigned char)ch;
+        bool after_cr = last_cr_;
+        last_cr_ = false;
+        switch (c) {
+        case '\n':
+            if (after_cr) break;
+            [[fallthrough]];
+        case '\r':
+            last_cr_ = c == '\r';
+            in.lines.push_back(line_);
+            line_.clear();
+            if (echo_) in.echo += crlf_ ? "\r\n" : "\n";
+            break;
+        case 0x08: case 0x7F:      // BS / DEL
+            erase(in);
+            break;
+        case 0x15:                 // Ctrl-U
+            while (!line_.empty()) erase(in);
+            break;
+        case 0x03:                 // Ctrl-C
+            line_.clear();
+            in.interrupt = true;
+            if (echo_) in.echo += crlf_ ? "^C\r\n" : "^C\n";
+            break;
+        default:
+            if (c < 0x20 && c != '\t') break;   // other control characters
+            if (line_.size() >= max_line_) {
+                if (echo_) in.echo += '\a';
+                break;
+            }
+            line_ += ch;
+            if (echo_) in.echo += ch;
+        }
+    }
+    return in;
+}
+
+// Removes the last character (all bytes of a UTF-8 sequence) and rubs it out
+void SerialLineDiscipline::erase(Input& in) {
+    if (line_.empty()) return;
+    while (line_.size() > 1 && ((unsigned char)line_.back() & 0xC0) == 0x80) line_.pop_back();
+    line_.pop_back();
+    if (echo_) in.echo += "\b \b";
+}
@@ -0,0 +1,165 @@
+#include "serial_text.h"
+
+// Stand-ins for the typographic characters models like to emit
+static const char* asciiFallback(unsigned cp) {
+    switch (cp) {
+        case 0x2018: case 0x2019: case 0x201A: case 0x2032: return "'";
+        case 0x201C: case 0x201D: case 0x201E: case 0x2033: return "\"";
+        case 0x2010: case 0x2011: case 0x2013: case 0x2014: case 0x2212: return "-";
+        case 0x2026: return "...";
+        case 0x2022: case 0x00B7: return "*";
+        case 0x00D7: return "x";
+        case 0x2192: return "->";
+        case 0x2190: return "<-";
+        case 0x00A9: return "(c)";
+        case 0x00AE: return "(r)";
+        default: return "?";
+    }
+}
+
+static void encodeUtf8(std::string& out, unsigned cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+SerialTextTransform::SerialTextTransform(const SerialTextOptions& opts) : opts_(opts) {}
+
+std::string SerialTextTransform::feed(const std::string& text) {
+    std::string in = utf8_partial_ + text;
+    utf8_partial_.clear();
+    std::string out;
+    size_t i = 0;
+    while (i < in.size()) {
+        unsigned char c = (unsigned char)in[i];
+        size_t len = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+        if (len == 0) {                 // stray continuation / invalid lead byte
+            putCodepoint(out, 0xFFFD);
+            ++i;
+            continue;
+        }
+        if (i + len > in.size()) {      // rest arrives with the next token
+            utf8_partial_ = in.substr(i);
+            break;
+        }
+        unsigned cp = len == 1 ? c : c & (0x7F >> len);
+        for (size_t k = 1; k < len; ++k) cp = (cp << 6) | ((unsigned char)in[i + k] & 0x3F);
+        putCodepoint(out, cp);
+        i += len;
+    }
+    return out;
+}
+
+std::string SerialTextTransform::finish() {
+    std::string out;
+    utf8_partial_.clear();
+    flushWord(out);
+    if (column_ > 0) newline(out);
+    space_ = false;
+    return out;
+}
+
+void SerialTextTransform::putCodepoint(std::string& out, unsigned cp) {
+    // ANSI colour/cursor sequences (ESC [ ... final byte) from console output
+    if (esc_ == 1) {
+        esc_ = cp == '[' ? 2 : 0;
+        return;
+    }
+    if (esc_ == 2) {
+        if (cp >= 0x40 && cp <= 0x7E) esc_ = 0;
+        return;
+    }
+    if (cp == 0x1B) {
+        esc_ = 1;
+        return;
+    }
+    if (cp == '\n') {
+        flushWord(out);
+        newline(out);
+        return;
+    }
+    if (cp == '\t' || cp == 0xA0) cp = ' ';
+    if (cp < 0x20 || cp == 0x7F) return;
+
+    if (cp == ' ') {
+        flushWord(out);
+        if (opts_.line_width <= 0) {
+            out += ' ';
+            ++column_;
+        } else if (column_ > 0) {
+            space_ = true;              // sent with the next word if it fits
+        } else if (!wrapped_) {
+            out += ' ';                 // indentation at the start of a real line
+            ++column_;
+        }
+        return;
+    }
+
+    std::string glyph;
+    if (opts_.charset == "ascii") {
+        glyph = cp < 0x80 ? std::string(1, (char)cp) : asciiFallback(cp);
+    } else if (opts_.charset == "latin1") {
+        glyph = cp < 0x100 ? std::string(1, (char)cp) : asciiFallback(cp);
+    } else {
+        encodeUtf8(glyph, cp);
+    }
+    putGlyph(out, glyph);
+}
+
+void SerialTextTransform::putGlyph(std::string& out, const std::string& glyph) {
+    int cols = opts_.charset == "utf8" ? 1 : (int)glyph.size();
+    if (opts_.line_width <= 0) {
+        out += glyph;
+        column_ += cols;
+        return;
+    }
+    word_ += glyph;
+    word_cols_ += cols;
+    // A word wider than the line is broken at the margin
+    if (word_cols_ >= opts_.line_width) {
+        if (column_ > 0) newline(out);
+        wrapped_ = true;
+        out += word_;
+        column_ = word_cols_;
+        word_.clear();
+        word_cols_ = 0;
+    }
+}
+
+void SerialTextTransform::flushWord(std::string& out) {
+    if (word_.empty()) return;
+    if (opts_.line_width > 0 && column_ > 0) {
+        int sep = space_ ? 1 : 0;
+        if (column_ + sep + word_cols_ > opts_.line_width) {
+            newline(out);
+            wrapped_ = true;
+        } else if (space_) {
+            out += ' ';
+            ++column_;
+        }
+    }
+    space_ = false;
+    out += word_;
+    column_ += word_cols_;
+    word_.clear();
+    word_cols_ = 0;
+}
+
+void SerialTextTransform::newline(std::string& out) {
+    out += opts_.crlf ? "\r\n" : "\n";
+    column_ = 0;
+    space_ = false;
+    wrapped_ = false;
+}
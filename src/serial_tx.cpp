@@ -0,0 +1,331 @@
+#include "serial_tx.h"
+#include <libserialport.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <thread>
+
+using clock_type = std::chrono::steady_clock;
+static const auto kRateWindow = std::chrono::seconds(5);
+
+// The single thread that drains every port's queue
+class SerialTxWriter {
+public:
+    static SerialTxWriter& instance() {
+        static SerialTxWriter w;
+        return w;
+    }
+
+    void add(SerialTxQueue* q) {
+        {
+            std::lock_guard<std::mutex> L(mtx_);
+            queues_.push_back(q);
+            if (!thread_.joinable()) thread_ = std::thread([this] { run(); });
+        }
+        wake();
+    }
+
+    // Once this returns the writer no longer touches q
+    void remove(SerialTxQueue* q) {
+        std::lock_guard<std::mutex> L(mtx_);
+        queues_.erase(std::remove(queues_.begin(), queues_.end(), q), queues_.end());
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        (void)!write(wake_fd_, &one, sizeof(one));
+    }
+
+private:
+    SerialTxWriter() : wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+    ~SerialTxWriter() {
+        {
+            std::lock_guard<std::mutex> L(mtx_);
+            stop_ = true;
+        }
+        wake();
+        if (thread_.joinable()) thread_.join();
+        close(wake_fd_);
+    }
+
+    void run() {
+        std::vector<pollfd> fds;
+        std::vector<SerialTxQueue*> polled;
+        for (;;) {
+            auto now = clock_type::now();
+            auto wake_at = now + std::chrono::seconds(1);
+            fds.assign(1, pollfd{wake_fd_, POLLIN, 0});
+            polled.clear();
+            {
+                std::lock_guard<std::mutex> L(mtx_);
+                if (stop_) return;
+                for (auto* q : queues_) {
+                    if (!q->ready(now, wake_at)) continue;
+                    if (q->fd_ < 0) {           // no pollable handle: just try
+                        q->writeFrame(now);
+                        wake_at = std::min(wake_at, now + std::chrono::milliseconds(10));
+                        continue;
+                    }
+                    fds.push_back(pollfd{q->fd_, POLLOUT, 0});
+                    polled.push_back(q);
+                }
+            }
+
+            int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(
+                wake_at - clock_type::now()).count();
+            int n = poll(fds.data(), fds.size(), std::max(0, timeout) + 1);
+            if (n <= 0) continue;
+            if (fds[0].revents) {
+                uint64_t v;
+                while (read(wake_fd_, &v, sizeof(v)) > 0) {}
+            }
+
+            std::lock_guard<std::mutex> L(mtx_);
+            now = clock_type::now();
+            for (size_t i = 0; i < polled.size(); ++i) {
+                if (!(fds[i + 1].revents & (POLLOUT | POLLERR))) continue;
+                // Skip queues removed while we were polling
+                if (std::find(queues_.begin(), queues_.end(), polled[i]) == queues_.end()) continue;
+                polled[i]->writeFrame(now);
+            }
+        }
+    }
+
+    int wake_fd_;
+    std::mutex mtx_;
+    std::vector<SerialTxQueue*> queues_;
+    std::thread thread_;
+    bool stop_ = false;
+};
+
+SerialTxQueue::SerialTxQueue(sp_port* port, int baudrate, size_t capacity, int linger_ms, bool framed)
+    : port_(port), baudrate_(baudrate > 0 ? baudrate : 9600), ring_(std::max<size_t>(capacity, 64)),
+      linger_ms_(std::max(0, linger_ms)), framed_(framed) {
+    // About 100 ms of line time per write (10 bits per byte on an 8N1 link)
+    frame_ = std::max<size_t>(16, (size_t)baudrate_ / 100);
+    stats_.capacity = ring_.size();
+    stats_.framed = framed_;
+    if (framed_) {
+        // Per-frame overhead and compression both favour bigger frames: on a
+        // slow link, coalesce for about as long as 64 bytes take to send
+        if (linger_ms_ > 0) linger_ms_ = std::max(linger_ms_, 64 * 10000 / baudrate_);
+        queueControl(enc_.sync());   // the device starts from a clean history
+        ++stats_.syncs;
+    }
+    if (port_ && sp_get_port_handle(port_, &fd_) != SP_OK) fd_ = -1;
+    SerialTxWriter::instance().add(this);
+}
+
+SerialTxQueue::~SerialTxQueue() {
+    flush(2000);
+    SerialTxWriter::instance().remove(this);
+    space_cv_.notify_all();
+}
+
+bool SerialTxQueue::pushLocked(const std::string& data) {
+    if (data.size() > ring_.size() - size_) return false;
+    if (size_ == 0) {
+        first_queued_ = progress_ = clock_type::now();
+        stalled_ = false;
+    }
+    newlines_ += std::count(data.begin(), data.end(), '\n');
+    size_t tail = (head_ + size_) % ring_.size();
+    size_t first = std::min(data.size(), ring_.size() - tail);
+    std::copy(data.data(), data.data() + first, ring_.begin() + tail);
+    std::copy(data.data() + first, data.data() + data.size(), ring_.begin());
+    size_ += data.size();
+    stats_.peak_queued = std::max(stats_.peak_queued, size_);
+    return true;
+}
+
+bool SerialTxQueue::enqueue(const std::string& data) {
+    if (data.empty()) return true;
+    {
+        std::lock_guard<std::mutex> L(mtx_);
+        if (!pushLocked(data)) {
+            stats_.bytes_dropped += data.size();
+            ++stats_.chunks_dropped;
+            return false;
+        }
+    }
+    SerialTxWriter::instance().wake();
+    return true;
+}
+
+bool SerialTxQueue::enqueueWait(const std::string& data, int timeout_ms) {
+    if (data.empty()) return true;
+    {
+        std::unique_lock<std::mutex> L(mtx_);
+        bool room = data.size() <= ring_.size() &&
+            space_cv_.wait_for(L, std::chrono::milliseconds(timeout_ms),
+                               [&] { return data.size() <= ring_.size() - size_; });
+        if (!room || !pushLocked(data)) {
+            stats_.bytes_dropped += data.size();
+            ++stats_.chunks_dropped;
+            return false;
+        }
+    }
+    SerialTxWriter::instance().wake();
+    return true;
+}
+
+bool SerialTxQueue::flush(int timeout_ms) {
+    std::unique_lock<std::mutex> L(mtx_);
+    return space_cv_.wait_for(L, std::chrono::milliseconds(timeout_ms),
+                              [&] { return size_ == 0 && !wirePending(); });
+}
+
+SerialTxStats SerialTxQueue::stats() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    SerialTxStats s = stats_;
+    s.queued = size_;
+    auto now = clock_type::now();
+    size_t bytes = 0;
+    for (const auto& r : recent_)
+        if (now - r.first <= kRateWindow) bytes += r.second;
+    s.bytes_per_sec = bytes / std::chrono::duration<double>(kRateWindow).count();
+    return s;
+}
+
+void SerialTxQueue::queueControl(const std::string& frames) {
+    if (size_ == 0 && !wirePending()) progress_ = clock_type::now();
+    control_ += frames;
+}
+
+void SerialTxQueue::onPeerFrame(const serial_frame::Frame& f) {
+    {
+        std::lock_guard<std::mutex> L(mtx_);
+        if (!framed_) return;
+        auto now = clock_type::now();
+        if (f.type == serial_frame::kAck) {
+            peer_acks_ = true;
+            if (enc_.ack(f.seq)) ack_progress_ = now;
+            return;
+        }
+        if (f.type == serial_frame::kSync) {
+            queueControl(enc_.sync());
+            ++stats_.syncs;
+        } else if (f.type == serial_frame::kNak) {
+            ++stats_.naks;
+            peer_acks_ = true;
+            enc_.ack(f.seq);
+            // One resend per gap: NAKs for it are ignored until it has had time to arrive
+            if (f.seq == last_nak_ && now < nak_quiet_until_) return;
+            size_t frames = 0;
+            std::string again = enc_.resendFrom(f.seq, &frames);
+            size_t ahead = wire_.size() - wire_off_ + control_.size() + frame_ + again.size();
+            last_nak_ = f.seq;
+            nak_quiet_until_ = now + std::chrono::milliseconds(100 + ahead * 10000 / baudrate_);
+            ack_progress_ = now;
+            if (!again.empty()) {
+                queueControl(again);
+                stats_.frames_resent += frames;
+            } else if (f.seq != enc_.next()) {   // no longer kept: start over
+                queueControl(enc_.sync());
+                ++stats_.syncs;
+            }
+        } else {
+            return;
+        }
+    }
+    SerialTxWriter::instance().wake();
+}
+
+// A device that ACKs gets unacknowledged frames again after a quiet spell
+// (covers a lost last frame or a lost NAK)
+void SerialTxQueue::checkResend(clock::time_point now, clock::time_point& wake) {
+    if (!peer_acks_ || enc_.unacked() == 0 || wirePending()) return;
+    auto rto = std::chrono::milliseconds(1000 + enc_.unackedBytes() * 10000 / baudrate_);
+    if (now < ack_progress_ + rto) {
+        wake = std::min(wake, ack_progress_ + rto);
+        return;
+    }
+    size_t frames = 0;
+    queueControl(enc_.resendFrom(enc_.oldest(), &frames));
+    stats_.frames_resent += frames;
+    ack_progress_ = now;
+}
+
+bool SerialTxQueue::ready(clock::time_point now, clock::time_point& wake) {
+    std::lock_guard<std::mutex> L(mtx_);
+    if (framed_) checkResend(now, wake);
+    bool wire = wirePending();
+    if (size_ == 0 && !wire) return false;
+    auto frame_time = std::chrono::milliseconds(frame_ * 10000 / baudrate_);
+
+    // No progress for a while: the far end is holding us off (or the link is gone)
+    auto stall_at = progress_ + std::chrono::milliseconds(500) + frame_time;
+    if (now >= stall_at && !stalled_) {
+        ++stats_.write_stalls;
+        stalled_ = true;
+    }
+    if (!stalled_) wake = std::min(wake, stall_at);
+
+    // Coalesce: give a partial line a moment to become a line or a frame.
+    // Framed, a line end is no reason to cut a frame short.
+    auto linger_end = first_queued_ + std::chrono::milliseconds(linger_ms_);
+    bool partial = framed_ ? size_ < serial_frame::kMaxPlain : newlines_ == 0 && size_ < frame_;
+    if (!wire && linger_ms_ > 0 && partial && now < linger_end) {
+        wake = std::min(wake, linger_end);
+        return false;
+    }
+    // Keep at most a frame in the driver so depth and drops are measured here
+    int in_driver = sp_output_waiting(port_);
+    if (in_driver >= (int)frame_) {
+        wake = std::min(wake, now + std::max<clock::duration>(frame_time / 2, std::chrono::milliseconds(10)));
+        return false;
+    }
+    return true;
+}
+
+// Framed: the next frame(s) to write, resends first
+void SerialTxQueue::nextWire(clock::time_point now) {
+    wire_.clear();
+    wire_off_ = 0;
+    if (!control_.empty()) {
+        wire_.swap(control_);
+        return;
+    }
+    if (size_ == 0) return;
+    std::string text(std::min(size_, serial_frame::kMaxPlain), '\0');
+    for (size_t i = 0; i < text.size(); ++i) text[i] = ring_[(head_ + i) % ring_.size()];
+    newlines_ -= std::count(text.begin(), text.end(), '\n');
+    head_ = (head_ + text.size()) % ring_.size();
+    size_ -= text.size();
+    if (enc_.unacked() == 0) ack_progress_ = now;
+    wire_ = enc_.data(text.data(), text.size());
+    stats_.text_bytes += text.size();
+    ++stats_.frames;
+}
+
+void SerialTxQueue::writeFrame(clock::time_point now) {
+    {
+        std::lock_guard<std::mutex> L(mtx_);
+        if (framed_ && wire_off_ == wire_.size()) nextWire(now);
+        const char* data = framed_ ? wire_.data() + wire_off_ : ring_.data() + head_;
+        size_t n = framed_ ? std::min(wire_.size() - wire_off_, frame_)
+                           : std::min({size_, frame_, ring_.size() - head_});
+        if (n == 0) return;
+        int wrote = sp_nonblocking_write(port_, data, n);
+        if (wrote < 0) {
+            ++stats_.write_errors;
+            return;
+        }
+        if (wrote == 0) return;
+        if (framed_) {
+            wire_off_ += wrote;
+        } else {
+            newlines_ -= std::count(ring_.begin() + head_, ring_.begin() + head_ + wrote, '\n');
+            head_ = (head_ + wrote) % ring_.size();
+            size_ -= wrote;
+        }
+        progress_ = now;
+        stalled_ = false;
+        stats_.bytes_sent += wrote;
+        ++stats_.writes;
+        recent_.emplace_back(now, (size_t)wrote);
+        while (!recent_.empty() && now - recent_.front().first > kRateWindow) recent_.pop_front();
+    }
+    space_cv_.notify_all();
+}
@@ -0,0 +1,57 @@
+#include "stream_sink.h"
+#include "serial_handler.h"
+#include <iostream>
+#include <fstream>
+
+static thread_local StreamSinkFn t_sink;   // set by StreamSinkScope
+static thread_local StreamSinkFn t_status;
+
+void streamSinkLog(const std::string& text) {
+    if (serial_available) {
+        serialSendText(text);   // queued; the writer thread paces the link
+        return;
+    }
+    std::ofstream log("log.txt", std::ios::app);
+    if (log.is_open()) {
+        log << text;
+        log.flush();
+    }
+}
+
+void streamSinkLogEnd() {
+    if (serial_available) serialEndText();
+}
+
+void streamSinkWrite(const std::string& text) {
+    if (text.empty()) return;
+    if (t_sink) {
+        t_sink(text);
+        return;
+    }
+    std::cout << "\033[32m" << text << "\033[0m" << std::flush;  // Green output
+    streamSinkLog(text);
+}
+
+void streamSinkStatus(const std::string& line) {
+    if (t_status) {
+        t_status(line);
+        return;
+    }
+    if (line.empty()) streamSinkLogEnd();
+    std::cout << line << std::endl;
+}
+
+StreamSinkScope::StreamSinkScope(StreamSinkFn fn, StreamSinkFn status)
+    : prev_(std::move(t_sink)), prev_status_(t_status) {
+    t_sink = std::move(fn);
+    if (status) t_status = std::move(status);
+}
+
+StreamSinkScope::~StreamSinkScope() {
+    t_sink = std::move(prev_);
+    t_status = std::move(prev_status_);
+}
+
+StreamSinks streamSinkCurrent() {
+    return StreamSinks{t_sink, t_status};
+}
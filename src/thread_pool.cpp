@@ -0,0 +1,59 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t threads) : threads_(threads > 0 ? threads : 1) {}
+
+ThreadPool::~ThreadPool() { stop(); }
+
+void ThreadPool::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> L(mtx_);
+        if (!stopping_) {
+            if (workers_.empty())
+                for (size_t i = 0; i < threads_; ++i) workers_.emplace_back([this]{ worker(); });
+            queue_.push_back(std::move(task));
+            cv_.notify_one();
+            return;
+        }
+    }
+    try { task(); } catch (...) {}
+}
+
+void ThreadPool::setThreads(size_t n) {
+    std::lock_guard<std::mutex> L(mtx_);
+    if (n > 0 && workers_.empty()) threads_ = n;
+}
+
+size_t ThreadPool::threads() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return threads_;
+}
+
+size_t ThreadPool::pending() const {
+    std::lock_guard<std::mutex> L(mtx_);
+    return queue_.size();
+}
+
+void ThreadPool::stop() {
+    std::vector<std::thread> ws;
+    {
+        std::lock_guard<std::mutex> L(mtx_);
+        stopping_ = true;
+        ws.swap(workers_);
+    }
+    cv_.notify_all();
+    for (auto& t : ws) if (t.joinable()) t.join();
+}
+
+void ThreadPool::worker() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> L(mtx_);
+            cv_.wait(L, [&]{ return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) return; // stopping and drained
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        try { task(); } catch (...) {}
+    }
+}
@@ -0,0 +1,474 @@
+// Mock Ollama server for offline, deterministic benchmarks and regression runs.
+//
+// Implements the endpoints this client uses: /api/chat and /api/generate
+// (streaming NDJSON or a single reply), /api/embeddings, /api/embed and
+// /api/tags (plus / and /api/version). Generated text and embeddings depend
+// only on the request, so two runs against the same build give the same
+// answers and the same retrieval results; only timing is configurable:
+// time to first token, tokens per second and a seeded jitter.
+//
+// Embeddings are feature-hashed bags of words and character trigrams,
+// L2-normalised, so texts that share words score high on cosine similarity
+// and retrieval behaves plausibly.
+#include "json.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+using json = nlohmann::json;
+
+struct MockConfig {
+    std::string host = "127.0.0.1";
+    int port = 11434;
+    double ttft_ms = 200;      // before the first token (and before a non-streamed reply)
+    double tps = 50;           // tokens per second after that
+    int tokens = 64;           // tokens per answer unless options.num_predict says otherwise
+    int dim = 768;             // embedding dimension
+    double jitter_ms = 0;      // each delay varies by up to +/- this much
+    double embed_ms = 5;       // latency of one embedding request
+    uint64_t seed = 1;         // jitter sequence
+    std::vector<std::string> models{"mock:latest", "mock-embed:latest"};
+    bool verbose = false;
+};
+
+static MockConfig g_cfg;
+static std::atomic<uint64_t> g_requests{0};
+
+static const char* kVocab[] = {
+    "the", "model", "answer", "index", "query", "context", "document", "chunk", "vector", "search",
+    "result", "serial", "port", "token", "stream", "latency", "memory", "file", "page", "section",
+    "is", "are", "can", "will", "should", "uses", "returns", "contains", "reads", "writes",
+    "a", "an", "this", "that", "each", "every", "some", "most", "more", "less",
+    "and", "or", "but", "so", "because", "when", "while", "after", "before", "with",
+    "in", "on", "of", "for", "from", "to", "by", "at", "into", "over",
+    "fast", "slow", "small", "large", "new", "old", "local", "remote", "simple", "useful",
+};
+static const size_t kVocabSize = sizeof(kVocab) / sizeof(kVocab[0]);
+
+static uint64_t fnv1a(const std::string& s, uint64_t h = 1469598103934665603ULL) {
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t splitmix(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Base delay with seeded jitter (never negative)
+static std::chrono::microseconds delay(double base_ms) {
+    uint64_t st = g_cfg.seed * 1000003ULL + g_requests.fetch_add(1);
+    double u = (double)(splitmix(st) >> 11) / (double)(1ULL << 53);   // [0,1)
+    double ms = std::max(0.0, base_ms + (2 * u - 1) * g_cfg.jitter_ms);
+    return std::chrono::microseconds((long long)(ms * 1000));
+}
+
+// Deterministic answer: the same prompt always gives the same words
+static std::vector<std::string> answerTokens(const std::string& prompt, int n) {
+    std::vector<std::string> out;
+    uint64_t st = fnv1a(prompt);
+    int in_sentence = 0, sentence_len = 0;
+    for (int i = 0; i < n; ++i) {
+        if (in_sentence == 0) sentence_len = 6 + (int)(splitmix(st) % 9);
+        std::string w = kVocab[splitmix(st) % kVocabSize];
+        if (in_sentence == 0) w[0] = (char)toupper((unsigned char)w[0]);
+        ++in_sentence;
+        if (in_sentence == sentence_len || i == n - 1) {
+            w += ".";
+            in_sentence = 0;
+        }
+        out.push_back((i == 0 ? "" : " ") + w);
+    }
+    return out;
+}
+
+static std::vector<float> embedText(const std::string& text) {
+    std::vector<float> v(g_cfg.dim, 0.0f);
+    auto add = [&](const std::string& feature, float weight) {
+        uint64_t h = fnv1a(feature);
+        v[h % v.size()] += (h >> 63) ? -weight : weight;
+    };
+    std::string word;
+    auto flush = [&]() {
+        if (word.empty()) return;
+        add(word, 1.0f);
+        std::string padded = " " + word + " ";
+        for (size_t i = 0; i + 3 <= padded.size(); ++i) add(padded.substr(i, 3), 0.3f);
+        word.clear();
+    };
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c >= 0x80) word += (char)std::tolower(c);
+        else flush();
+    }
+    flush();
+    double norm = 0;
+    for (float x : v) norm += (double)x * x;
+    if (norm == 0) {
+        v[0] = 1.0f;
+        return v;
+    }
+    float inv = (float)(1.0 / std::sqrt(norm));
+    for (float& x : v) x *= inv;
+    return v;
+}
+
+static int wordCount(const std::string& s) {
+    int n = 0;
+    bool in = false;
+    for (unsigned char c : s) {
+        bool w = !std::isspace(c);
+        if (w && !in) ++n;
+        in = w;
+    }
+    return n;
+}
+
+static std::string nowIso() {
+    auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+    return buf;
+}
+
+// ---- HTTP ----
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(fd, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += (size_t)n;
+    }
+    return true;
+}
+
+static bool reply(int fd, int code, const std::string& body, const char* type = "application/json") {
+    const char* reason = code == 200 ? "OK" : code == 400 ? "Bad Request" : code == 404 ? "Not Found" : "Error";
+    std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\nContent-Type: " + type +
+                       "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    return sendAll(fd, head + body);
+}
+
+static bool sendChunk(int fd, const json& j) {
+    std::string line = j.dump() + "\n";
+    char len[16];
+    snprintf(len, sizeof(len), "%zx\r\n", line.size());
+    return sendAll(fd, len + line + "\r\n");
+}
+
+struct Request {
+    std::string method, path, body;
+    std::string error;         // set for a request that must be answered with 400
+    bool keep_alive = true;
+};
+
+static const unsigned long long kMaxBody = 64ull << 20;
+
+// Reads one request; false when the peer closed or sent garbage. A bad
+// Content-Length sets req.error instead, since the body cannot be framed.
+static bool readRequest(int fd, std::string& buf, Request& req) {
+    req = Request();
+    size_t header_end;
+    while ((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0 || buf.size() > (1 << 20)) return false;
+        buf.append(tmp, (size_t)n);
+    }
+    std::string head = buf.substr(0, header_end);
+    buf.erase(0, header_end + 4);
+
+    size_t sp1 = head.find(' '), sp2 = head.find(' ', sp1 + 1);
+    if (sp1 == std::string::npos || sp2 == std::string::npos) return false;
+    req.method = head.substr(0, sp1);
+    req.path = head.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.keep_alive = head.compare(sp2 + 1, 8, "HTTP/1.0") != 0;
+
+    size_t content_length = 0;
+    bool expect_continue = false;
+    size_t pos = head.find("\r\n");
+    while (pos != std::string::npos) {
+        size_t next = head.find("\r\n", pos + 2);
+        std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+        pos = next;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon), value = line.substr(colon + 1);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        value.erase(0, value.find_first_not_of(" \t"));
+        std::string lower = value;
+        std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+        if (name == "content-length") {
+            char* end = nullptr;
+            unsigned long long v = std::strtoull(value.c_str(), &end, 10);
+            if (!isdigit((unsigned char)value[0]) || end[strspn(end, " \t")] != '\0' || v > kMaxBody) {
+                req.error = "bad Content-Length";
+                req.keep_alive = false;
+                return true;
+            }
+            content_length = (size_t)v;
+        } else if (name == "connection") req.keep_alive = lower != "close";
+        else if (name == "expect") expect_continue = lower == "100-continue";
+    }
+    if (expect_continue && !sendAll(fd, "HTTP/1.1 100 Continue\r\n\r\n")) return false;
+
+    while (buf.size() < content_length) {
+        char tmp[65536];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0) return false;
+        buf.append(tmp, (size_t)n);
+    }
+    req.body = buf.substr(0, content_length);
+    buf.erase(0, content_length);
+    return true;
+}
+
+// ---- Endpoints ----
+
+// in[key] if it has type T, fallback when absent or null; any other type is a client
+// error (json::value() would throw a type_error instead)
+template <class T>
+static T field(const json& in, const char* key, T fallback) {
+    auto it = in.find(key);
+    if (it == in.end() || it->is_null()) return fallback;
+    bool ok = std::is_same<T, std::string>::value ? it->is_string()
+            : std::is_same<T, bool>::value        ? it->is_boolean()
+                                                  : it->is_number();
+    if (!ok) throw std::invalid_argument(std::string("field '") + key + "' has the wrong type");
+    return it->get<T>();
+}
+
+// /api/chat and /api/generate share everything but the field names
+static bool handleGenerate(int fd, const json& in, bool chat) {
+    std::string prompt;
+    if (chat) {
+        auto msgs = in.find("messages");
+        if (msgs != in.end() && !msgs->is_null() && !msgs->is_array())
+            throw std::invalid_argument("field 'messages' has the wrong type");
+        if (msgs != in.end() && msgs->is_array())
+            for (const auto& m : *msgs) {
+                if (!m.is_object()) throw std::invalid_argument("messages must be objects");
+                if (field<std::string>(m, "role", "") == "user") prompt = field<std::string>(m, "content", "");
+            }
+    } else {
+        prompt = field<std::string>(in, "prompt", "");
+    }
+    std::string model = field<std::string>(in, "model", g_cfg.models.front());
+    int n = g_cfg.tokens;
+    if (in.contains("options") && in["options"].is_object())
+        n = field<int>(in["options"], "num_predict", n);
+    if (n < 0) n = g_cfg.tokens;
+    auto tokens = answerTokens(prompt, n);
+
+    auto t0 = std::chrono::steady_clock::now();
+    auto piece = [&](const std::string& text, bool done) {
+        json j = {{"model", model}, {"created_at", nowIso()}, {"done", done}};
+        if (chat) j["message"] = {{"role", "assistant"}, {"content", text}};
+        else j["response"] = text;
+        if (done) {
+            long long total = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t0).count();
+            j["done_reason"] = "stop";
+            j["total_duration"] = total;
+            j["load_duration"] = 0;
+            j["prompt_eval_count"] = wordCount(prompt);
+            j["prompt_eval_duration"] = (long long)(g_cfg.ttft_ms * 1e6);
+            j["eval_count"] = (int)tokens.size();
+            j["eval_duration"] = (long long)(tokens.size() / std::max(g_cfg.tps, 1e-3) * 1e9);
+        }
+        return j;
+    };
+
+    std::this_thread::sleep_for(delay(g_cfg.ttft_ms));
+    if (!field<bool>(in, "stream", true)) {
+        std::string all;
+        for (const auto& t : tokens) all += t;
+        std::this_thread::sleep_for(delay(tokens.size() * 1000.0 / std::max(g_cfg.tps, 1e-3)));
+        return reply(fd, 200, piece(all, true).dump());
+    }
+
+    std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\n\r\n";
+    if (!sendAll(fd, head)) return false;
+    double gap_ms = 1000.0 / std::max(g_cfg.tps, 1e-3);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (i > 0) std::this_thread::sleep_for(delay(gap_ms));
+        if (!sendChunk(fd, piece(tokens[i], false))) return false;   // client went away
+    }
+    return sendChunk(fd, piece("", true)) && sendAll(fd, "0\r\n\r\n");
+}
+
+static bool handle(int fd, const Request& req) {
+    if (req.method == "GET" && (req.path == "/" || req.path.empty()))
+        return reply(fd, 200, "Ollama is running", "text/plain");
+    if (req.method == "GET" && req.path == "/api/version")
+        return reply(fd, 200, json{{"version", "0.0.0-mock"}}.dump());
+    if (req.method == "GET" && req.path == "/api/tags") {
+        json models = json::array();
+        for (const auto& m : g_cfg.models)
+            models.push_back({{"name", m}, {"model", m}, {"modified_at", nowIso()}, {"size", 0},
+                              {"digest", std::to_string(fnv1a(m))},
+                              {"details", {{"family", "mock"}, {"parameter_size", "0B"}}}});
+        return reply(fd, 200, json{{"models", models}}.dump());
+    }
+    static const char* kPosts[] = {"/api/chat", "/api/generate", "/api/embeddings", "/api/embed"};
+    if (req.method != "POST" || std::find(std::begin(kPosts), std::end(kPosts), req.path) == std::end(kPosts))
+        return reply(fd, 404, json{{"error", "not found"}}.dump());
+
+    json in = json::parse(req.body, nullptr, false);
+    if (!in.is_object()) return reply(fd, 400, json{{"error", "invalid JSON body"}}.dump());
+
+    if (req.path == "/api/chat") return handleGenerate(fd, in, true);
+    if (req.path == "/api/generate") return handleGenerate(fd, in, false);
+    if (req.path == "/api/embeddings") {
+        std::string prompt = field<std::string>(in, "prompt", "");
+        std::this_thread::sleep_for(delay(g_cfg.embed_ms));
+        return reply(fd, 200, json{{"embedding", embedText(prompt)}}.dump());
+    }
+    if (req.path == "/api/embed") {
+        std::vector<std::string> inputs;
+        if (in.contains("input") && in["input"].is_array()) {
+            for (const auto& s : in["input"]) inputs.push_back(s.is_string() ? s.get<std::string>() : s.dump());
+        } else {
+            inputs.push_back(field<std::string>(in, "input", ""));
+        }
+        std::this_thread::sleep_for(delay(g_cfg.embed_ms * inputs.size()));
+        json out = json::array();
+        int words = 0;
+        for (const auto& s : inputs) {
+            out.push_back(embedText(s));
+            words += wordCount(s);
+        }
+        return reply(fd, 200, json{{"model", field<std::string>(in, "model", g_cfg.models.back())}, {"embeddings", out},
+                                   {"prompt_eval_count", words}}.dump());
+    }
+    return false;
+}
+
+static void serveConnection(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::string buf;
+    Request req;
+    while (readRequest(fd, buf, req)) {
+        auto t0 = std::chrono::steady_clock::now();
+        bool ok;
+        try {
+            ok = req.error.empty() ? handle(fd, req) : reply(fd, 400, json{{"error", req.error}}.dump());
+        } catch (const std::exception& e) {   // thrown before any of the reply was sent
+            ok = reply(fd, 400, json{{"error", e.what()}}.dump());
+        }
+        if (g_cfg.verbose) {
+            static std::mutex log_mtx;
+            std::lock_guard<std::mutex> L(log_mtx);
+            std::cerr << "[mock_ollama] " << req.method << " " << req.path << " "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - t0).count()
+                      << " ms" << (ok ? "" : " (client gone)") << std::endl;
+        }
+        if (!ok || !req.keep_alive) break;
+    }
+    close(fd);
+}
+
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [options]\n"
+              << "  --host ADDR       listen address (default 127.0.0.1)\n"
+              << "  --port N          listen port (default 11434)\n"
+              << "  --ttft MS         time to first token (default 200)\n"
+              << "  --tps N           tokens per second (default 50)\n"
+              << "  --tokens N        tokens per answer (default 64; options.num_predict wins)\n"
+              << "  --dim N           embedding dimension (default 768)\n"
+              << "  --embed-ms MS     latency per embedding (default 5)\n"
+              << "  --jitter MS       +/- random variation of every delay (default 0)\n"
+              << "  --seed N          jitter seed (default 1)\n"
+              << "  --model NAME      model listed by /api/tags (repeatable)\n"
+              << "  --verbose         log each request" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    bool models_given = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage(argv[0]);
+                exit(1);
+            }
+            return argv[++i];
+        };
+        try {
+            if (a == "--host") g_cfg.host = next();
+            else if (a == "--port") g_cfg.port = std::stoi(next());
+            else if (a == "--ttft") g_cfg.ttft_ms = std::stod(next());
+            else if (a == "--tps") g_cfg.tps = std::stod(next());
+            else if (a == "--tokens") g_cfg.tokens = std::stoi(next());
+            else if (a == "--dim") g_cfg.dim = std::max(1, std::stoi(next()));
+            else if (a == "--embed-ms") g_cfg.embed_ms = std::stod(next());
+            else if (a == "--jitter") g_cfg.jitter_ms = std::stod(next());
+            else if (a == "--seed") g_cfg.seed = std::stoull(next());
+            else if (a == "--verbose") g_cfg.verbose = true;
+            else if (a == "--model") {
+                if (!models_given) g_cfg.models.clear();
+                models_given = true;
+                g_cfg.models.push_back(next());
+            } else {
+                usage(argv[0]);
+                return a == "--help" || a == "-h" ? 0 : 1;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "[Error] Invalid value for " << a << std::endl;
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    int srv = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)g_cfg.port);
+    if (inet_pton(AF_INET, g_cfg.host.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "[Error] Invalid --host: " << g_cfg.host << std::endl;
+        return 1;
+    }
+    if (bind(srv, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(srv, 128) != 0) {
+        std::cerr << "[Error] Cannot listen on " << g_cfg.host << ":" << g_cfg.port << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    std::cerr << "[mock_ollama] listening on http://" << g_cfg.host << ":" << g_cfg.port << " (ttft " << g_cfg.ttft_ms
+              << " ms, " << g_cfg.tps << " tok/s, " << g_cfg.tokens << " tokens, dim " << g_cfg.dim << ", jitter "
+              << g_cfg.jitter_ms << " ms)" << std::endl;
+
+    for (;;) {
+        int fd = accept(srv, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "[Error] accept: " << strerror(errno) << std::endl;
+            continue;
+        }
+        std::thread(serveConnection, fd).detach();
+    }
+}